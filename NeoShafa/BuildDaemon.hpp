@@ -0,0 +1,334 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "Util.hpp"
+#include "ContentHash.hpp"
+#include "ProjectData.hpp"
+
+namespace NeoShafa::Daemon {
+	// Protocol: the client sends one request line ("build"), the server streams the
+	// build output back, then a NUL byte followed by "exit <code>\n".
+	constexpr std::string_view g_buildRequest{ "build" };
+
+	// neoshafa.sock in the configuration's cache, or a name derived from the project and
+	// configuration in the temporary directory when that path does not fit into sockaddr_un.
+	inline std::filesystem::path socket_path(const ProjectEnvironment& projectEnvironment)
+	{
+#ifndef _WIN32
+		if (projectEnvironment.projectServerSocketFilePath.native().size() < sizeof(::sockaddr_un::sun_path))
+			return projectEnvironment.projectServerSocketFilePath;
+#endif
+		std::error_code errorCode{};
+		return std::filesystem::temp_directory_path(errorCode) / std::format(
+			"neoshafa-{}.sock",
+			ContentHash::hash(std::format("{}\n{}", projectEnvironment.projectRoot.string(), projectEnvironment.projectConfiguration)).to_string().substr(0, 16)
+		);
+	}
+
+	class Server {
+	public:
+		using Handler = std::function<int32_t(std::string_view request)>;
+
+	public:
+		Server() = default;
+		inline ~Server() { stop(); }
+
+		Server(const Server&) = delete;
+		Server& operator=(const Server&) = delete;
+
+		inline Core::ExpectedVoid listen(const std::filesystem::path& socketPath)
+		{
+#ifdef _WIN32
+			return std::unexpected(
+				Core::make_error(Core::ErrorCode::BuildServerError, "The build server is not supported on this platform.")
+			);
+#else
+			::sockaddr_un address{};
+			if (!make_address(socketPath, address))
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::BuildServerError, std::format("Socket path {} is too long.", socketPath.string()))
+				);
+
+			if (is_listening(socketPath))
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::BuildServerError, std::format("A build server is already listening on {}.", socketPath.string()))
+				);
+
+			// A socket file left behind by a server that did not shut down cleanly.
+			std::error_code errorCode{};
+			std::filesystem::remove(socketPath, errorCode);
+
+			::signal(SIGPIPE, SIG_IGN);
+			m_socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+			if (m_socket < 0 ||
+				::bind(m_socket, reinterpret_cast<const ::sockaddr*>(&address), sizeof(address)) != 0 ||
+				::listen(m_socket, m_backlog) != 0) {
+				stop();
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::BuildServerError, std::format("Cannot listen on {}.", socketPath.string()))
+				);
+			}
+
+			m_socketPath = socketPath;
+			return {};
+#endif
+		}
+
+		// Serves requests one at a time, so concurrent clients queue up instead of
+		// racing on the same outputs, and returns once no client came for idleTimeout.
+		inline void serve(std::chrono::seconds idleTimeout, const Handler& handler)
+		{
+#ifndef _WIN32
+			while (m_socket >= 0) {
+				::pollfd descriptor{ m_socket, POLLIN, 0 };
+				const int ready = ::poll(&descriptor, 1, static_cast<int>(std::chrono::milliseconds{ idleTimeout }.count()));
+				if (ready == 0) {
+					std::println("INFO: Build server idle for {}s, shutting down.", idleTimeout.count());
+					break;
+				}
+				if (ready < 0)
+					continue;
+
+				const int client = ::accept4(m_socket, nullptr, nullptr, SOCK_CLOEXEC);
+				if (client >= 0) {
+					handle(client, handler);
+					::close(client);
+				}
+			}
+#endif
+			stop();
+		}
+
+		inline void stop()
+		{
+#ifndef _WIN32
+			if (m_socket >= 0) {
+				::close(m_socket);
+				m_socket = -1;
+			}
+			if (!m_socketPath.empty()) {
+				std::error_code errorCode{};
+				std::filesystem::remove(m_socketPath, errorCode);
+				m_socketPath.clear();
+			}
+#endif
+		}
+
+	private:
+#ifndef _WIN32
+		// Points stdout and stderr at the client while it lives, and back at the server's
+		// own once it goes out of scope, also when the handler threw. Output goes through a
+		// pipe a relay thread copies to the client, so writes never fail in the build: once
+		// the client is gone the relay only drains the pipe.
+		class RedirectedOutput {
+		public:
+			inline explicit RedirectedOutput(int client) : m_client(client)
+			{
+				flush();
+				if (::pipe2(m_pipe, O_CLOEXEC) != 0) {
+					::dup2(client, STDOUT_FILENO);
+					::dup2(client, STDERR_FILENO);
+					return;
+				}
+				m_relay = std::jthread{ [this] { relay(); } };
+				::dup2(m_pipe[1], STDOUT_FILENO);
+				::dup2(m_pipe[1], STDERR_FILENO);
+				::close(m_pipe[1]);
+			}
+			inline ~RedirectedOutput()
+			{
+				flush();
+				::dup2(m_savedOutput, STDOUT_FILENO);
+				::dup2(m_savedError, STDERR_FILENO);
+				::close(m_savedOutput);
+				::close(m_savedError);
+				// The restored descriptors were the last writers, the relay sees the end.
+				if (m_relay.joinable()) {
+					m_relay.join();
+					::close(m_pipe[0]);
+				}
+			}
+
+			RedirectedOutput(const RedirectedOutput&) = delete;
+			RedirectedOutput& operator=(const RedirectedOutput&) = delete;
+
+		private:
+			inline void relay() const
+			{
+				char buffer[4096];
+				ssize_t length{};
+				bool connected{ true };
+				while ((length = ::read(m_pipe[0], buffer, sizeof(buffer))) > 0)
+					if (connected)
+						connected = write_all(m_client, { buffer, static_cast<size_t>(length) });
+			}
+
+			inline static void flush()
+			{
+				std::fflush(stdout);
+				std::fflush(stderr);
+				std::cout.flush();
+				std::cerr.flush();
+			}
+
+		private:
+			int m_client{ -1 };
+			int m_pipe[2]{ -1, -1 };
+			int m_savedOutput{ ::dup(STDOUT_FILENO) };
+			int m_savedError{ ::dup(STDERR_FILENO) };
+			std::jthread m_relay{};
+		};
+
+		// Build output is written with std::print and std::cerr throughout, so stdout and
+		// stderr point at the client for the duration of the request. A client that
+		// disconnects mid-build does not stop the server.
+		inline static void handle(int client, const Handler& handler)
+		{
+			std::string request{};
+			char character{};
+			while (request.size() < m_maxRequestSize && ::read(client, &character, 1) == 1 && character != '\n')
+				request.push_back(character);
+			// is_listening connects and closes without a request.
+			if (request.empty())
+				return;
+
+			int32_t exitCode{ static_cast<int32_t>(Core::ErrorCode::BuildServerError) };
+			try {
+				RedirectedOutput redirectedOutput{ client };
+				exitCode = handler(request);
+			}
+			catch (const std::exception& exception) {
+				std::println(std::cerr, "ERROR: Build request failed: {}", exception.what());
+			}
+
+			const std::string trailer = std::format("{}exit {}\n", '\0', exitCode);
+			write_all(client, trailer);
+		}
+#endif
+
+	private:
+		std::filesystem::path m_socketPath{};
+#ifndef _WIN32
+		int m_socket{ -1 };
+#endif
+
+		constexpr static int m_backlog{ 16 };
+		constexpr static size_t m_maxRequestSize{ 4096 };
+
+#ifndef _WIN32
+	public:
+		inline static bool make_address(const std::filesystem::path& socketPath, ::sockaddr_un& address)
+		{
+			const std::string& path = socketPath.native();
+			if (path.size() >= sizeof(address.sun_path))
+				return false;
+
+			address.sun_family = AF_UNIX;
+			path.copy(address.sun_path, path.size());
+			address.sun_path[path.size()] = '\0';
+			return true;
+		}
+
+		inline static int connect(const std::filesystem::path& socketPath)
+		{
+			::sockaddr_un address{};
+			if (!make_address(socketPath, address))
+				return -1;
+
+			const int socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+			if (socket < 0)
+				return -1;
+			if (::connect(socket, reinterpret_cast<const ::sockaddr*>(&address), sizeof(address)) != 0) {
+				::close(socket);
+				return -1;
+			}
+			return socket;
+		}
+
+		inline static bool is_listening(const std::filesystem::path& socketPath)
+		{
+			const int socket = connect(socketPath);
+			if (socket < 0) return false;
+			::close(socket);
+			return true;
+		}
+
+		inline static bool write_all(int socket, std::string_view content)
+		{
+			while (!content.empty()) {
+				const ssize_t written = ::write(socket, content.data(), content.size());
+				if (written <= 0) return false;
+				content.remove_prefix(static_cast<size_t>(written));
+			}
+			return true;
+		}
+#endif
+	};
+
+	// Sends the request to the project's build server and streams its output to stdout.
+	// Returns the build's exit code, or nothing when no server is listening so the
+	// caller can build in-process.
+	inline std::optional<int32_t> request(const std::filesystem::path& socketPath, std::string_view command)
+	{
+#ifdef _WIN32
+		return std::nullopt;
+#else
+		if (!std::filesystem::exists(socketPath))
+			return std::nullopt;
+
+		const int socket = Server::connect(socketPath);
+		if (socket < 0)
+			return std::nullopt;
+
+		::signal(SIGPIPE, SIG_IGN);
+		if (!Server::write_all(socket, std::format("{}\n", command))) {
+			::close(socket);
+			return std::nullopt;
+		}
+
+		std::string trailer{};
+		bool inTrailer{ false };
+		char buffer[4096];
+		ssize_t length{};
+		while ((length = ::read(socket, buffer, sizeof(buffer))) > 0) {
+			std::string_view chunk{ buffer, static_cast<size_t>(length) };
+			if (!inTrailer) {
+				const size_t terminator = chunk.find('\0');
+				std::fwrite(chunk.data(), 1, std::min(terminator, chunk.size()), stdout);
+				if (terminator == std::string_view::npos)
+					continue;
+				inTrailer = true;
+				chunk.remove_prefix(terminator + 1);
+			}
+			trailer.append(chunk);
+		}
+		::close(socket);
+		std::fflush(stdout);
+
+		int32_t exitCode{};
+		if (!trailer.starts_with("exit ") || std::sscanf(trailer.c_str() + 5, "%d", &exitCode) != 1) {
+			std::println(std::cerr, "ERROR: Build server closed the connection before the build finished.");
+			return 1;
+		}
+		return exitCode;
+#endif
+	}
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Util.hpp"
+#include "Json.hpp"
+#include "JobPool.hpp"
+
+namespace NeoShafa {
+	// Timeline of a NeoShafa run in the Chrome trace-event format, written by `--trace` and
+	// readable by chrome://tracing or ui.perfetto.dev. Every span lands on the lane of the
+	// thread that recorded it: 0 for the main thread, 1 and up for the job pool workers and
+	// the lane a thread outside the pool claimed with enter_lane(), like a workspace member.
+	// Child processes get lanes of their own from process_lane(). Nothing is recorded until
+	// start() is called.
+	class BuildTrace {
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		struct Event {
+			std::string name{};
+			std::string_view category{};
+			std::vector<std::pair<std::string_view, std::string>> arguments{};
+			int64_t begin{};
+			int64_t duration{};
+			uint32_t lane{};
+		};
+
+		class Span {
+		public:
+			Span() = default;
+			inline Span(BuildTrace* trace, std::string name, std::string_view category) :
+				m_trace(trace), m_begin(Clock::now())
+			{
+				m_event.name = std::move(name);
+				m_event.category = category;
+			}
+			inline ~Span() { finish(); }
+
+			Span(const Span&) = delete;
+			Span& operator=(const Span&) = delete;
+
+			inline Span(Span&& other) noexcept :
+				m_trace(std::exchange(other.m_trace, nullptr)), m_begin(other.m_begin), m_event(std::move(other.m_event)) {}
+
+			inline Span& operator=(Span&& other) noexcept
+			{
+				if (this != &other) {
+					finish();
+					m_trace = std::exchange(other.m_trace, nullptr);
+					m_begin = other.m_begin;
+					m_event = std::move(other.m_event);
+				}
+				return *this;
+			}
+
+			inline Span& argument(std::string_view key, std::string value)
+			{
+				if (m_trace)
+					m_event.arguments.emplace_back(key, std::move(value));
+				return *this;
+			}
+
+			inline void finish()
+			{
+				if (!m_trace)
+					return;
+				std::exchange(m_trace, nullptr)->record(std::move(m_event), m_begin, Clock::now());
+			}
+
+		private:
+			BuildTrace* m_trace{};
+			Clock::time_point m_begin{};
+			Event m_event{};
+		};
+
+	public:
+		BuildTrace() = default;
+		~BuildTrace() = default;
+
+		BuildTrace(const BuildTrace&) = delete;
+		BuildTrace& operator=(const BuildTrace&) = delete;
+
+		inline void start(const std::filesystem::path& outputPath)
+		{
+			std::scoped_lock lock{ m_mutex };
+			m_outputPath = outputPath;
+			m_enabled = true;
+		}
+
+		inline bool enabled() const noexcept { return m_enabled; }
+
+		// Lane for a child process in the given ProcessEngine slot, after every worker lane.
+		inline static uint32_t process_lane(uint32_t slot) noexcept { return m_processLaneBase + slot; }
+
+		// Lane for the thread of the n-th workspace member, between the worker and the
+		// process lanes.
+		inline static uint32_t member_lane(size_t index) noexcept { return m_memberLaneBase + static_cast<uint32_t>(index); }
+
+		// Spans recorded by the calling thread land on `lane`, named `name` in the trace.
+		inline void enter_lane(uint32_t lane, std::string name)
+		{
+			m_threadLane = lane;
+			std::scoped_lock lock{ m_mutex };
+			m_laneNames[lane] = std::move(name);
+		}
+
+		// Times everything until the span is destroyed or finished.
+		inline Span span(std::string name, std::string_view category) {
+			return m_enabled ? Span{ this, std::move(name), category } : Span{};
+		}
+
+		// For spans that began before tracing was enabled, like the command line parse, or
+		// that did not run on the recording thread, like a child process.
+		inline void record(Event event, Clock::time_point begin, Clock::time_point end, std::optional<uint32_t> lane = std::nullopt)
+		{
+			if (!m_enabled)
+				return;
+			event.begin = std::chrono::duration_cast<std::chrono::microseconds>(begin - m_origin).count();
+			event.duration = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+			event.lane = lane.value_or(m_threadLane.value_or(JobPool::current_lane()));
+
+			std::scoped_lock lock{ m_mutex };
+			m_events.push_back(std::move(event));
+		}
+
+		// Rewrites the whole file, so a long --watch session can be opened at any point.
+		inline Core::ExpectedVoid write() const
+		{
+			std::scoped_lock lock{ m_mutex };
+			if (!m_enabled)
+				return {};
+
+			std::set<uint32_t> lanes{ 0 };
+			for (const auto& event : m_events)
+				lanes.insert(event.lane);
+
+			std::string content{ "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" };
+			content.append(R"({"name":"process_name","ph":"M","pid":1,"tid":0,"args":{"name":"NeoShafa"}})");
+			for (const uint32_t lane : lanes)
+				content.append(std::format(
+					",\n{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":{}}}}}",
+					lane, Json::quote(m_laneNames.contains(lane) ? m_laneNames.at(lane) : lane_name(lane))
+				));
+
+			for (const auto& event : m_events) {
+				content.append(std::format(
+					",\n{{\"name\":{},\"cat\":{},\"ph\":\"X\",\"ts\":{},\"dur\":{},\"pid\":1,\"tid\":{},\"args\":{{",
+					Json::quote(event.name), Json::quote(event.category), event.begin, event.duration, event.lane
+				));
+				for (size_t i = 0; i < event.arguments.size(); ++i)
+					content.append(i == 0 ? "" : ",")
+						.append(Json::quote(event.arguments[i].first))
+						.append(":")
+						.append(Json::quote(event.arguments[i].second));
+				content.append("}}");
+			}
+			content.append("\n]}\n");
+
+			return Util::write_atomic(m_outputPath, content);
+		}
+
+	private:
+		inline static std::string lane_name(uint32_t lane)
+		{
+			if (lane == 0)
+				return "main";
+			if (lane > m_processLaneBase)
+				return std::format("process {}", lane - m_processLaneBase);
+			return std::format("worker {}", lane);
+		}
+
+	private:
+		inline static constexpr uint32_t m_memberLaneBase{ 500 };
+		inline static constexpr uint32_t m_processLaneBase{ 1000 };
+		inline static thread_local std::optional<uint32_t> m_threadLane{};
+
+		mutable std::mutex m_mutex{};
+		std::atomic<bool> m_enabled{ false };
+		std::filesystem::path m_outputPath{};
+
+		// Timestamps count from process start, when the global trace is constructed.
+		Clock::time_point m_origin{ Clock::now() };
+		std::vector<Event> m_events{};
+		std::map<uint32_t, std::string> m_laneNames{};
+	};
+
+	inline BuildTrace g_buildTrace{};
+}
@@ -0,0 +1,580 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+#if !defined(NEOSHAFA_DISABLE_SIMD) && defined(__AVX2__)
+#define NEOSHAFA_HASH_AVX2
+#include <immintrin.h>
+#elif !defined(NEOSHAFA_DISABLE_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define NEOSHAFA_HASH_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+// XXH3-128 (seed 0, default secret) as specified by xxHash 0.8. The digest is
+// fixed by the specification, so caches hashed by one NeoShafa build stay valid
+// for any other build regardless of compiler, platform or SIMD kernel.
+namespace NeoShafa::ContentHash {
+	struct Digest {
+		uint64_t low{};
+		uint64_t high{};
+
+		constexpr bool operator==(const Digest&) const = default;
+
+		// Canonical xxHash notation: high half first, big-endian hex.
+		inline std::string to_string() const {
+			return std::format("{:016x}{:016x}", high, low);
+		}
+
+		inline static std::optional<Digest> from_string(std::string_view string)
+		{
+			if (string.size() != 32)
+				return std::nullopt;
+
+			Digest digest{};
+			for (size_t i = 0; i < 32; ++i) {
+				const char character = string[i];
+				uint64_t nibble{};
+				if (character >= '0' && character <= '9') nibble = static_cast<uint64_t>(character - '0');
+				else if (character >= 'a' && character <= 'f') nibble = static_cast<uint64_t>(character - 'a' + 10);
+				else if (character >= 'A' && character <= 'F') nibble = static_cast<uint64_t>(character - 'A' + 10);
+				else return std::nullopt;
+
+				uint64_t& half = i < 16 ? digest.high : digest.low;
+				half = (half << 4) | nibble;
+			}
+			return digest;
+		}
+	};
+
+	struct DigestHasher {
+		inline size_t operator()(const Digest& digest) const noexcept {
+			return static_cast<size_t>(digest.low ^ (digest.high * 0x9E3779B185EBCA87ULL));
+		}
+	};
+
+	namespace Detail {
+		constexpr uint32_t g_prime32_1{ 0x9E3779B1U };
+		constexpr uint32_t g_prime32_2{ 0x85EBCA77U };
+		constexpr uint32_t g_prime32_3{ 0xC2B2AE3DU };
+		constexpr uint64_t g_prime64_1{ 0x9E3779B185EBCA87ULL };
+		constexpr uint64_t g_prime64_2{ 0xC2B2AE3D27D4EB4FULL };
+		constexpr uint64_t g_prime64_3{ 0x165667B19E3779F9ULL };
+		constexpr uint64_t g_prime64_4{ 0x85EBCA77C2B2AE63ULL };
+		constexpr uint64_t g_prime64_5{ 0x27D4EB2F165667C5ULL };
+		constexpr uint64_t g_primeMx1{ 0x165667919E3779F9ULL };
+		constexpr uint64_t g_primeMx2{ 0x9FB21C651E98DF25ULL };
+
+		constexpr size_t g_stripeLength{ 64 };
+		constexpr size_t g_secretConsumeRate{ 8 };
+		constexpr size_t g_accumulatorCount{ g_stripeLength / sizeof(uint64_t) };
+		constexpr size_t g_secretMergeStart{ 11 };
+		constexpr size_t g_secretLastAccumulatorStart{ 7 };
+		constexpr size_t g_midSizeMax{ 240 };
+		constexpr size_t g_midSizeStartOffset{ 3 };
+		constexpr size_t g_midSizeLastOffset{ 17 };
+		constexpr size_t g_secretSizeMin{ 136 };
+
+		alignas(64) constexpr std::array<uint8_t, 192> g_secret{
+			0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+			0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+			0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+			0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+			0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+			0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+			0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+			0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+			0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+			0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+			0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+			0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+		};
+
+		inline uint64_t read64(const uint8_t* data) noexcept
+		{
+			uint64_t value{};
+			std::memcpy(&value, data, sizeof(value));
+			if constexpr (std::endian::native == std::endian::big)
+				value = std::byteswap(value);
+			return value;
+		}
+
+		inline uint32_t read32(const uint8_t* data) noexcept
+		{
+			uint32_t value{};
+			std::memcpy(&value, data, sizeof(value));
+			if constexpr (std::endian::native == std::endian::big)
+				value = std::byteswap(value);
+			return value;
+		}
+
+		inline Digest multiply64to128(uint64_t lhs, uint64_t rhs) noexcept
+		{
+#if defined(__SIZEOF_INT128__)
+			const unsigned __int128 product = static_cast<unsigned __int128>(lhs) * rhs;
+			return { static_cast<uint64_t>(product), static_cast<uint64_t>(product >> 64) };
+#elif defined(_MSC_VER) && defined(_M_X64)
+			uint64_t high{};
+			const uint64_t low = _umul128(lhs, rhs, &high);
+			return { low, high };
+#else
+			const uint64_t loLo = (lhs & 0xFFFFFFFF) * (rhs & 0xFFFFFFFF);
+			const uint64_t hiLo = (lhs >> 32) * (rhs & 0xFFFFFFFF);
+			const uint64_t loHi = (lhs & 0xFFFFFFFF) * (rhs >> 32);
+			const uint64_t hiHi = (lhs >> 32) * (rhs >> 32);
+			const uint64_t cross = (loLo >> 32) + (hiLo & 0xFFFFFFFF) + loHi;
+			return { (cross << 32) | (loLo & 0xFFFFFFFF), (hiLo >> 32) + (cross >> 32) + hiHi };
+#endif
+		}
+
+		inline uint64_t multiply_fold64(uint64_t lhs, uint64_t rhs) noexcept
+		{
+			const Digest product = multiply64to128(lhs, rhs);
+			return product.low ^ product.high;
+		}
+
+		inline uint64_t xorshift64(uint64_t value, int shift) noexcept {
+			return value ^ (value >> shift);
+		}
+
+		inline uint64_t avalanche(uint64_t hash) noexcept
+		{
+			hash = xorshift64(hash, 37);
+			hash *= g_primeMx1;
+			return xorshift64(hash, 32);
+		}
+
+		inline uint64_t avalanche_xxh64(uint64_t hash) noexcept
+		{
+			hash ^= hash >> 33;
+			hash *= g_prime64_2;
+			hash ^= hash >> 29;
+			hash *= g_prime64_3;
+			hash ^= hash >> 32;
+			return hash;
+		}
+
+		inline uint64_t mix16(const uint8_t* input, const uint8_t* secret) noexcept {
+			return multiply_fold64(read64(input) ^ read64(secret), read64(input + 8) ^ read64(secret + 8));
+		}
+
+		inline Digest mix32(Digest accumulator, const uint8_t* first, const uint8_t* second, const uint8_t* secret) noexcept
+		{
+			accumulator.low += mix16(first, secret);
+			accumulator.low ^= read64(second) + read64(second + 8);
+			accumulator.high += mix16(second, secret + 16);
+			accumulator.high ^= read64(first) + read64(first + 8);
+			return accumulator;
+		}
+
+		inline Digest finalize_mid(Digest accumulator, size_t length) noexcept
+		{
+			Digest digest{};
+			digest.low = avalanche(accumulator.low + accumulator.high);
+			digest.high = 0 - avalanche(
+				(accumulator.low * g_prime64_1) +
+				(accumulator.high * g_prime64_4) +
+				(static_cast<uint64_t>(length) * g_prime64_2)
+			);
+			return digest;
+		}
+
+		inline Digest hash_0to16(const uint8_t* input, size_t length) noexcept
+		{
+			const uint8_t* secret = g_secret.data();
+
+			if (length > 8) {
+				const uint64_t bitflipLow = read64(secret + 32) ^ read64(secret + 40);
+				const uint64_t bitflipHigh = read64(secret + 48) ^ read64(secret + 56);
+				const uint64_t inputLow = read64(input);
+				uint64_t inputHigh = read64(input + length - 8);
+
+				Digest product = multiply64to128(inputLow ^ inputHigh ^ bitflipLow, g_prime64_1);
+				product.low += static_cast<uint64_t>(length - 1) << 54;
+				inputHigh ^= bitflipHigh;
+				product.high += inputHigh + static_cast<uint64_t>(static_cast<uint32_t>(inputHigh)) * (g_prime32_2 - 1);
+				product.low ^= std::byteswap(product.high);
+
+				Digest digest = multiply64to128(product.low, g_prime64_2);
+				digest.high += product.high * g_prime64_2;
+				return { avalanche(digest.low), avalanche(digest.high) };
+			}
+
+			if (length >= 4) {
+				const uint64_t inputLow = read32(input);
+				const uint64_t inputHigh = read32(input + length - 4);
+				const uint64_t combined = inputLow + (inputHigh << 32);
+				const uint64_t bitflip = read64(secret + 16) ^ read64(secret + 24);
+
+				Digest digest = multiply64to128(combined ^ bitflip, g_prime64_1 + (static_cast<uint64_t>(length) << 2));
+				digest.high += digest.low << 1;
+				digest.low ^= digest.high >> 3;
+				digest.low = xorshift64(digest.low, 35);
+				digest.low *= g_primeMx2;
+				digest.low = xorshift64(digest.low, 28);
+				digest.high = avalanche(digest.high);
+				return digest;
+			}
+
+			if (length > 0) {
+				const uint32_t combinedLow =
+					(static_cast<uint32_t>(input[0]) << 16) |
+					(static_cast<uint32_t>(input[length >> 1]) << 24) |
+					static_cast<uint32_t>(input[length - 1]) |
+					(static_cast<uint32_t>(length) << 8);
+				const uint32_t combinedHigh = std::rotl(std::byteswap(combinedLow), 13);
+				const uint64_t bitflipLow = read32(secret) ^ read32(secret + 4);
+				const uint64_t bitflipHigh = read32(secret + 8) ^ read32(secret + 12);
+				return {
+					avalanche_xxh64(combinedLow ^ bitflipLow),
+					avalanche_xxh64(combinedHigh ^ bitflipHigh)
+				};
+			}
+
+			return {
+				avalanche_xxh64(read64(secret + 64) ^ read64(secret + 72)),
+				avalanche_xxh64(read64(secret + 80) ^ read64(secret + 88))
+			};
+		}
+
+		inline Digest hash_17to128(const uint8_t* input, size_t length) noexcept
+		{
+			const uint8_t* secret = g_secret.data();
+			Digest accumulator{ static_cast<uint64_t>(length) * g_prime64_1, 0 };
+
+			if (length > 32) {
+				if (length > 64) {
+					if (length > 96)
+						accumulator = mix32(accumulator, input + 48, input + length - 64, secret + 96);
+					accumulator = mix32(accumulator, input + 32, input + length - 48, secret + 64);
+				}
+				accumulator = mix32(accumulator, input + 16, input + length - 32, secret + 32);
+			}
+			accumulator = mix32(accumulator, input, input + length - 16, secret);
+
+			return finalize_mid(accumulator, length);
+		}
+
+		inline Digest hash_129to240(const uint8_t* input, size_t length) noexcept
+		{
+			const uint8_t* secret = g_secret.data();
+			Digest accumulator{ static_cast<uint64_t>(length) * g_prime64_1, 0 };
+
+			for (size_t i = 32; i < 160; i += 32)
+				accumulator = mix32(accumulator, input + i - 32, input + i - 16, secret + i - 32);
+
+			accumulator.low = avalanche(accumulator.low);
+			accumulator.high = avalanche(accumulator.high);
+
+			for (size_t i = 160; i <= length; i += 32)
+				accumulator = mix32(accumulator, input + i - 32, input + i - 16, secret + g_midSizeStartOffset + i - 160);
+
+			accumulator = mix32(
+				accumulator,
+				input + length - 16,
+				input + length - 32,
+				secret + g_secretSizeMin - g_midSizeLastOffset - 16
+			);
+
+			return finalize_mid(accumulator, length);
+		}
+
+		// Accumulation kernels for inputs above 240 bytes. Each processes one 64-byte stripe.
+		struct ScalarKernel {
+			inline static void accumulate(uint64_t* accumulators, const uint8_t* input, const uint8_t* secret) noexcept
+			{
+				for (size_t lane = 0; lane < g_accumulatorCount; ++lane) {
+					const uint64_t data = read64(input + lane * 8);
+					const uint64_t key = data ^ read64(secret + lane * 8);
+					accumulators[lane ^ 1] += data;
+					accumulators[lane] += (key & 0xFFFFFFFF) * (key >> 32);
+				}
+			}
+
+			inline static void scramble(uint64_t* accumulators, const uint8_t* secret) noexcept
+			{
+				for (size_t lane = 0; lane < g_accumulatorCount; ++lane) {
+					uint64_t accumulator = xorshift64(accumulators[lane], 47);
+					accumulator ^= read64(secret + lane * 8);
+					accumulators[lane] = accumulator * g_prime32_1;
+				}
+			}
+		};
+
+#if defined(NEOSHAFA_HASH_AVX2)
+		struct SimdKernel {
+			inline static void accumulate(uint64_t* accumulators, const uint8_t* input, const uint8_t* secret) noexcept
+			{
+				auto* vectorAccumulators = reinterpret_cast<__m256i*>(accumulators);
+				for (size_t i = 0; i < g_stripeLength / sizeof(__m256i); ++i) {
+					const __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input) + i);
+					const __m256i key = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(secret) + i);
+					const __m256i dataKey = _mm256_xor_si256(data, key);
+					const __m256i product = _mm256_mul_epu32(dataKey, _mm256_srli_epi64(dataKey, 32));
+					const __m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+					const __m256i accumulator = _mm256_load_si256(vectorAccumulators + i);
+					_mm256_store_si256(vectorAccumulators + i, _mm256_add_epi64(product, _mm256_add_epi64(accumulator, swapped)));
+				}
+			}
+
+			inline static void scramble(uint64_t* accumulators, const uint8_t* secret) noexcept
+			{
+				auto* vectorAccumulators = reinterpret_cast<__m256i*>(accumulators);
+				const __m256i prime = _mm256_set1_epi32(static_cast<int>(g_prime32_1));
+				for (size_t i = 0; i < g_stripeLength / sizeof(__m256i); ++i) {
+					const __m256i accumulator = _mm256_load_si256(vectorAccumulators + i);
+					const __m256i mixed = _mm256_xor_si256(accumulator, _mm256_srli_epi64(accumulator, 47));
+					const __m256i key = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(secret) + i);
+					const __m256i dataKey = _mm256_xor_si256(mixed, key);
+					const __m256i productLow = _mm256_mul_epu32(dataKey, prime);
+					const __m256i productHigh = _mm256_mul_epu32(_mm256_srli_epi64(dataKey, 32), prime);
+					_mm256_store_si256(vectorAccumulators + i, _mm256_add_epi64(productLow, _mm256_slli_epi64(productHigh, 32)));
+				}
+			}
+		};
+#elif defined(NEOSHAFA_HASH_SSE2)
+		struct SimdKernel {
+			inline static void accumulate(uint64_t* accumulators, const uint8_t* input, const uint8_t* secret) noexcept
+			{
+				auto* vectorAccumulators = reinterpret_cast<__m128i*>(accumulators);
+				for (size_t i = 0; i < g_stripeLength / sizeof(__m128i); ++i) {
+					const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input) + i);
+					const __m128i key = _mm_loadu_si128(reinterpret_cast<const __m128i*>(secret) + i);
+					const __m128i dataKey = _mm_xor_si128(data, key);
+					const __m128i product = _mm_mul_epu32(dataKey, _mm_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1)));
+					const __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+					const __m128i accumulator = _mm_load_si128(vectorAccumulators + i);
+					_mm_store_si128(vectorAccumulators + i, _mm_add_epi64(product, _mm_add_epi64(accumulator, swapped)));
+				}
+			}
+
+			inline static void scramble(uint64_t* accumulators, const uint8_t* secret) noexcept
+			{
+				auto* vectorAccumulators = reinterpret_cast<__m128i*>(accumulators);
+				const __m128i prime = _mm_set1_epi32(static_cast<int>(g_prime32_1));
+				for (size_t i = 0; i < g_stripeLength / sizeof(__m128i); ++i) {
+					const __m128i accumulator = _mm_load_si128(vectorAccumulators + i);
+					const __m128i mixed = _mm_xor_si128(accumulator, _mm_srli_epi64(accumulator, 47));
+					const __m128i key = _mm_loadu_si128(reinterpret_cast<const __m128i*>(secret) + i);
+					const __m128i dataKey = _mm_xor_si128(mixed, key);
+					const __m128i productLow = _mm_mul_epu32(dataKey, prime);
+					const __m128i productHigh = _mm_mul_epu32(_mm_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+					_mm_store_si128(vectorAccumulators + i, _mm_add_epi64(productLow, _mm_slli_epi64(productHigh, 32)));
+				}
+			}
+		};
+#else
+		using SimdKernel = ScalarKernel;
+#endif
+
+		inline uint64_t merge_accumulators(const uint64_t* accumulators, const uint8_t* secret, uint64_t start) noexcept
+		{
+			uint64_t result = start;
+			for (size_t i = 0; i < 4; ++i)
+				result += multiply_fold64(
+					accumulators[2 * i] ^ read64(secret + 16 * i),
+					accumulators[2 * i + 1] ^ read64(secret + 16 * i + 8)
+				);
+			return avalanche(result);
+		}
+
+		// Accumulates `count` stripes, the n-th with the secret advanced by n * 8 bytes.
+		template <typename Kernel>
+		inline void accumulate_stripes(uint64_t* accumulators, const uint8_t* input, size_t count, const uint8_t* secret) noexcept
+		{
+			for (size_t stripe = 0; stripe < count; ++stripe)
+				Kernel::accumulate(accumulators, input + stripe * g_stripeLength, secret + stripe * g_secretConsumeRate);
+		}
+
+		template <typename Kernel>
+		inline Digest hash_long(const uint8_t* input, size_t length) noexcept
+		{
+			const uint8_t* secret = g_secret.data();
+			constexpr size_t secretSize = g_secret.size();
+			constexpr size_t stripesPerBlock = (secretSize - g_stripeLength) / g_secretConsumeRate;
+			constexpr size_t blockLength = g_stripeLength * stripesPerBlock;
+
+			alignas(64) uint64_t accumulators[g_accumulatorCount]{
+				g_prime32_3, g_prime64_1, g_prime64_2, g_prime64_3,
+				g_prime64_4, g_prime32_2, g_prime64_5, g_prime32_1
+			};
+
+			const size_t blockCount = (length - 1) / blockLength;
+			for (size_t block = 0; block < blockCount; ++block) {
+				const uint8_t* blockInput = input + block * blockLength;
+				accumulate_stripes<Kernel>(accumulators, blockInput, stripesPerBlock, secret);
+				Kernel::scramble(accumulators, secret + secretSize - g_stripeLength);
+			}
+
+			const size_t stripeCount = ((length - 1) - blockLength * blockCount) / g_stripeLength;
+			const uint8_t* lastBlock = input + blockCount * blockLength;
+			accumulate_stripes<Kernel>(accumulators, lastBlock, stripeCount, secret);
+
+			Kernel::accumulate(
+				accumulators,
+				input + length - g_stripeLength,
+				secret + secretSize - g_stripeLength - g_secretLastAccumulatorStart
+			);
+
+			return {
+				merge_accumulators(accumulators, secret + g_secretMergeStart, static_cast<uint64_t>(length) * g_prime64_1),
+				merge_accumulators(
+					accumulators,
+					secret + secretSize - sizeof(accumulators) - g_secretMergeStart,
+					~(static_cast<uint64_t>(length) * g_prime64_2)
+				)
+			};
+		}
+	}
+
+	inline Digest hash(std::span<const std::byte> data) noexcept
+	{
+		const auto* input = reinterpret_cast<const uint8_t*>(data.data());
+		const size_t length = data.size();
+
+		if (length <= 16)
+			return Detail::hash_0to16(input, length);
+		if (length <= 128)
+			return Detail::hash_17to128(input, length);
+		if (length <= Detail::g_midSizeMax)
+			return Detail::hash_129to240(input, length);
+		return Detail::hash_long<Detail::SimdKernel>(input, length);
+	}
+
+	inline Digest hash(std::string_view string) noexcept {
+		return hash(std::as_bytes(std::span{ string.data(), string.size() }));
+	}
+
+	// Incremental form of hash(): feeding the input in pieces of any size gives the digest
+	// of the whole, while only the accumulators and one 256-byte buffer are kept. Follows
+	// the streaming state of the xxHash reference.
+	class Hasher {
+	public:
+		Hasher() = default;
+		~Hasher() = default;
+
+		inline void reset() noexcept { *this = Hasher{}; }
+
+		inline void update(std::span<const std::byte> data) noexcept
+		{
+			if (data.empty())
+				return;
+
+			const auto* input = reinterpret_cast<const uint8_t*>(data.data());
+			const uint8_t* const end = input + data.size();
+			m_totalLength += data.size();
+
+			if (m_bufferedSize + data.size() <= m_bufferSize) {
+				std::memcpy(m_buffer + m_bufferedSize, input, data.size());
+				m_bufferedSize += data.size();
+				return;
+			}
+
+			// The buffer is only consumed once more input follows, so the digest always
+			// has the last stripe at hand.
+			if (m_bufferedSize != 0) {
+				const size_t loadSize = m_bufferSize - m_bufferedSize;
+				std::memcpy(m_buffer + m_bufferedSize, input, loadSize);
+				input += loadSize;
+				consume_stripes(m_accumulators, m_stripesSoFar, m_buffer, m_bufferSize / Detail::g_stripeLength);
+				m_bufferedSize = 0;
+			}
+
+			if (end - input > static_cast<ptrdiff_t>(m_bufferSize)) {
+				const uint8_t* const limit = end - m_bufferSize;
+				do {
+					consume_stripes(m_accumulators, m_stripesSoFar, input, m_bufferSize / Detail::g_stripeLength);
+					input += m_bufferSize;
+				} while (input < limit);
+				std::memcpy(m_buffer + m_bufferSize - Detail::g_stripeLength, input - Detail::g_stripeLength, Detail::g_stripeLength);
+			}
+
+			m_bufferedSize = static_cast<size_t>(end - input);
+			std::memcpy(m_buffer, input, m_bufferedSize);
+		}
+
+		inline void update(std::string_view string) noexcept {
+			update(std::as_bytes(std::span{ string.data(), string.size() }));
+		}
+
+		inline Digest digest() const noexcept
+		{
+			if (m_totalLength <= Detail::g_midSizeMax)
+				return hash(std::as_bytes(std::span{ m_buffer, static_cast<size_t>(m_totalLength) }));
+
+			const uint8_t* secret = Detail::g_secret.data();
+			alignas(64) uint64_t accumulators[Detail::g_accumulatorCount]{};
+			std::memcpy(accumulators, m_accumulators, sizeof(accumulators));
+
+			if (m_bufferedSize >= Detail::g_stripeLength) {
+				size_t stripesSoFar = m_stripesSoFar;
+				consume_stripes(accumulators, stripesSoFar, m_buffer, (m_bufferedSize - 1) / Detail::g_stripeLength);
+				Detail::SimdKernel::accumulate(accumulators, m_buffer + m_bufferedSize - Detail::g_stripeLength, secret + m_secretLimit - Detail::g_secretLastAccumulatorStart);
+			}
+			else {
+				// The last stripe starts in the previous, already consumed buffer.
+				uint8_t lastStripe[Detail::g_stripeLength]{};
+				const size_t catchUp = Detail::g_stripeLength - m_bufferedSize;
+				std::memcpy(lastStripe, m_buffer + m_bufferSize - catchUp, catchUp);
+				std::memcpy(lastStripe + catchUp, m_buffer, m_bufferedSize);
+				Detail::SimdKernel::accumulate(accumulators, lastStripe, secret + m_secretLimit - Detail::g_secretLastAccumulatorStart);
+			}
+
+			return {
+				Detail::merge_accumulators(accumulators, secret + Detail::g_secretMergeStart, m_totalLength * Detail::g_prime64_1),
+				Detail::merge_accumulators(
+					accumulators,
+					secret + Detail::g_secret.size() - sizeof(accumulators) - Detail::g_secretMergeStart,
+					~(m_totalLength * Detail::g_prime64_2)
+				)
+			};
+		}
+
+	private:
+		// Accumulates stripes continuing the current block, scrambling when it is full.
+		inline static void consume_stripes(uint64_t* accumulators, size_t& stripesSoFar, const uint8_t* input, size_t count) noexcept
+		{
+			const uint8_t* secret = Detail::g_secret.data();
+			if (m_stripesPerBlock - stripesSoFar <= count) {
+				const size_t toEnd = m_stripesPerBlock - stripesSoFar;
+				Detail::accumulate_stripes<Detail::SimdKernel>(accumulators, input, toEnd, secret + stripesSoFar * Detail::g_secretConsumeRate);
+				Detail::SimdKernel::scramble(accumulators, secret + m_secretLimit);
+				Detail::accumulate_stripes<Detail::SimdKernel>(accumulators, input + toEnd * Detail::g_stripeLength, count - toEnd, secret);
+				stripesSoFar = count - toEnd;
+			}
+			else {
+				Detail::accumulate_stripes<Detail::SimdKernel>(accumulators, input, count, secret + stripesSoFar * Detail::g_secretConsumeRate);
+				stripesSoFar += count;
+			}
+		}
+
+	private:
+		constexpr static size_t m_bufferSize{ 256 };
+		constexpr static size_t m_secretLimit{ Detail::g_secret.size() - Detail::g_stripeLength };
+		constexpr static size_t m_stripesPerBlock{ m_secretLimit / Detail::g_secretConsumeRate };
+
+		alignas(64) uint64_t m_accumulators[Detail::g_accumulatorCount]{
+			Detail::g_prime32_3, Detail::g_prime64_1, Detail::g_prime64_2, Detail::g_prime64_3,
+			Detail::g_prime64_4, Detail::g_prime32_2, Detail::g_prime64_5, Detail::g_prime32_1
+		};
+		alignas(64) uint8_t m_buffer[m_bufferSize]{};
+		size_t m_bufferedSize{};
+		size_t m_stripesSoFar{};
+		uint64_t m_totalLength{};
+	};
+}
+
+template <>
+struct std::hash<NeoShafa::ContentHash::Digest> : NeoShafa::ContentHash::DigestHasher {};
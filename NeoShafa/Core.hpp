@@ -42,6 +42,7 @@ namespace NeoShafa::Core {
         MissingProjectCppVersion,
 
         UnexpectedProjectTypeError,
+        UnexpectedJsonParsingError,
 
         GenericProjectConfigureError = 200,
         InvalidEnvironmentError,
@@ -59,9 +60,17 @@ namespace NeoShafa::Core {
         InvalidLibPathError,
         InvalidLinkPathError,
 
+        ReadingDependencyFileError,
+        ReadingObjectManifestError,
+        FileWatcherError,
+        BuildServerError,
+        ReadingModuleCacheError,
+        WorkspaceConfigError,
+
         GenericBuildError = 300,
 
 		RunningCommandError,
+		ProfileTrainingError,
 
         CannotReadFileError = 400,
         CannotWriteFileError,
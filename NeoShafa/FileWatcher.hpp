@@ -0,0 +1,305 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "Util.hpp"
+
+namespace NeoShafa {
+	// Reports files changed under a root directory. Uses inotify on Linux and
+	// ReadDirectoryChangesW on Windows, and compares file stamps on a timer elsewhere.
+	class FileWatcher {
+	public:
+		struct Changes {
+			std::vector<std::filesystem::path> paths{};
+			// Set when individual paths are unreliable, e.g. after a queue overflow or a new
+			// directory, and the caller has to rescan the tree.
+			bool rescan{ false };
+		};
+
+	public:
+		FileWatcher() = default;
+		inline ~FileWatcher() { stop(); }
+
+		FileWatcher(const FileWatcher&) = delete;
+		FileWatcher& operator=(const FileWatcher&) = delete;
+
+		inline Core::ExpectedVoid start(
+			const std::filesystem::path& root,
+			std::vector<std::filesystem::path> excludedPaths
+		) {
+			stop();
+			m_root = root;
+			m_excludedPaths = std::move(excludedPaths);
+
+#ifdef _WIN32
+			m_directory = ::CreateFileW(
+				root.wstring().c_str(), FILE_LIST_DIRECTORY,
+				FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+				nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr
+			);
+			if (m_directory == INVALID_HANDLE_VALUE)
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::FileWatcherError, std::format("Cannot open {} for watching: {}", root.string(), ::GetLastError()))
+				);
+
+			m_overlapped.hEvent = ::CreateEventW(nullptr, TRUE, FALSE, nullptr);
+			m_buffer.resize(m_bufferSize / sizeof(DWORD));
+			if (!m_overlapped.hEvent || !request_changes())
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::FileWatcherError, std::format("Cannot watch {}: {}", root.string(), ::GetLastError()))
+				);
+#elif defined(__linux__)
+			m_descriptor = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+			if (m_descriptor < 0)
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::FileWatcherError, "Cannot initialize inotify.")
+				);
+
+			if (!add_watches(root))
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::FileWatcherError, std::format("Cannot watch {}.", root.string()))
+				);
+#else
+			Changes ignored{};
+			scan_stamps(ignored);
+#endif
+			return {};
+		}
+
+		inline void stop()
+		{
+#ifdef _WIN32
+			if (m_directory != INVALID_HANDLE_VALUE) {
+				::CancelIo(m_directory);
+				::CloseHandle(m_directory);
+				m_directory = INVALID_HANDLE_VALUE;
+			}
+			if (m_overlapped.hEvent) {
+				::CloseHandle(m_overlapped.hEvent);
+				m_overlapped = {};
+			}
+#elif defined(__linux__)
+			if (m_descriptor >= 0) {
+				::close(m_descriptor);
+				m_descriptor = -1;
+			}
+			m_watches.clear();
+#else
+			m_stamps.clear();
+#endif
+		}
+
+		// Blocks until something changes, then keeps collecting until the tree has been
+		// quiet for the debounce interval, so a burst of saves becomes one rebuild.
+		inline Changes wait(std::chrono::milliseconds debounce)
+		{
+			Changes changes{};
+			while (!poll(m_idleTimeout, changes)) {}
+			while (poll(debounce, changes)) {}
+
+			return deduplicate(std::move(changes));
+		}
+
+		// Everything reported so far, without blocking.
+		inline Changes drain()
+		{
+			Changes changes{};
+			while (poll(std::chrono::milliseconds{ 0 }, changes)) {}
+
+			return deduplicate(std::move(changes));
+		}
+
+	private:
+		inline static Changes deduplicate(Changes changes)
+		{
+			std::ranges::sort(changes.paths);
+			const auto [first, last] = std::ranges::unique(changes.paths);
+			changes.paths.erase(first, last);
+			return changes;
+		}
+
+		inline bool is_excluded(const std::filesystem::path& path) const
+		{
+			return std::ranges::any_of(m_excludedPaths, [&](const std::filesystem::path& excludedPath) {
+				const auto relative = path.lexically_relative(excludedPath);
+				return !relative.empty() && !relative.native().starts_with(std::filesystem::path{ ".." }.native());
+			});
+		}
+
+#ifdef _WIN32
+		inline bool request_changes()
+		{
+			::ResetEvent(m_overlapped.hEvent);
+			return ::ReadDirectoryChangesW(
+				m_directory, m_buffer.data(), static_cast<DWORD>(m_buffer.size() * sizeof(DWORD)), TRUE,
+				FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE,
+				nullptr, &m_overlapped, nullptr
+			);
+		}
+
+		inline bool poll(std::chrono::milliseconds timeout, Changes& changes)
+		{
+			if (::WaitForSingleObject(m_overlapped.hEvent, static_cast<DWORD>(timeout.count())) != WAIT_OBJECT_0)
+				return false;
+
+			DWORD bytes{};
+			const bool completed = ::GetOverlappedResult(m_directory, &m_overlapped, &bytes, FALSE);
+			if (!completed || bytes == 0)
+				changes.rescan = true;
+			else {
+				const auto* buffer = reinterpret_cast<const std::byte*>(m_buffer.data());
+				for (DWORD offset = 0;;) {
+					const auto* information = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(buffer + offset);
+					const std::filesystem::path path = m_root / std::wstring_view{ information->FileName, information->FileNameLength / sizeof(WCHAR) };
+					if (!is_excluded(path)) {
+						if ((information->Action == FILE_ACTION_ADDED || information->Action == FILE_ACTION_RENAMED_NEW_NAME) &&
+							std::filesystem::is_directory(path))
+							changes.rescan = true;
+						else
+							changes.paths.push_back(path);
+					}
+
+					if (information->NextEntryOffset == 0) break;
+					offset += information->NextEntryOffset;
+				}
+			}
+
+			if (!request_changes())
+				changes.rescan = true;
+			return true;
+		}
+#elif defined(__linux__)
+		inline bool add_watches(const std::filesystem::path& directory)
+		{
+			if (is_excluded(directory))
+				return true;
+
+			constexpr uint32_t mask = IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF;
+			const int watch = ::inotify_add_watch(m_descriptor, directory.c_str(), mask);
+			if (watch < 0)
+				return false;
+			m_watches.insert_or_assign(watch, directory);
+
+			std::error_code errorCode{};
+			for (auto it = std::filesystem::directory_iterator(directory, errorCode);
+				!errorCode && it != std::filesystem::directory_iterator(); it.increment(errorCode))
+				if (it->is_directory(errorCode) && !it->is_symlink(errorCode))
+					add_watches(it->path());
+			return true;
+		}
+
+		inline bool poll(std::chrono::milliseconds timeout, Changes& changes)
+		{
+			::pollfd descriptor{ m_descriptor, POLLIN, 0 };
+			if (::poll(&descriptor, 1, static_cast<int>(timeout.count())) <= 0)
+				return false;
+
+			alignas(::inotify_event) char buffer[m_bufferSize];
+			ssize_t length{};
+			while ((length = ::read(m_descriptor, buffer, sizeof(buffer))) > 0) {
+				for (ssize_t offset = 0; offset < length;) {
+					const auto* event = reinterpret_cast<const ::inotify_event*>(buffer + offset);
+					offset += static_cast<ssize_t>(sizeof(::inotify_event) + event->len);
+
+					if (event->mask & IN_Q_OVERFLOW) {
+						changes.rescan = true;
+						continue;
+					}
+
+					const auto it = m_watches.find(event->wd);
+					if (it == m_watches.end())
+						continue;
+					if (event->mask & IN_IGNORED) {
+						m_watches.erase(it);
+						continue;
+					}
+					if (event->len == 0)
+						continue;
+
+					const std::filesystem::path path = it->second / event->name;
+					if (is_excluded(path))
+						continue;
+
+					// A new directory may already hold files created before its watch existed.
+					if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+						add_watches(path);
+						changes.rescan = true;
+					}
+					else
+						changes.paths.push_back(path);
+				}
+			}
+			return true;
+		}
+#else
+		inline void scan_stamps(Changes& changes)
+		{
+			std::unordered_map<std::string, Util::FileStamp> stamps{};
+			std::error_code errorCode{};
+			for (auto it = std::filesystem::recursive_directory_iterator(m_root, errorCode);
+				!errorCode && it != std::filesystem::recursive_directory_iterator(); it.increment(errorCode)) {
+				if (is_excluded(it->path())) {
+					if (it->is_directory(errorCode))
+						it.disable_recursion_pending();
+					continue;
+				}
+				if (!it->is_regular_file(errorCode))
+					continue;
+
+				if (const auto stamp = Util::stat(it->path()); stamp) {
+					const auto previous = m_stamps.find(it->path().string());
+					if (previous == m_stamps.end() || !(previous->second == *stamp))
+						changes.paths.push_back(it->path());
+					stamps.emplace(it->path().string(), *stamp);
+				}
+			}
+
+			for (const auto& [path, _] : m_stamps)
+				if (!stamps.contains(path))
+					changes.paths.emplace_back(path);
+			m_stamps = std::move(stamps);
+		}
+
+		inline bool poll(std::chrono::milliseconds timeout, Changes& changes)
+		{
+			std::this_thread::sleep_for(std::min(timeout, m_pollInterval));
+			const size_t previousSize = changes.paths.size();
+			scan_stamps(changes);
+			return changes.paths.size() != previousSize;
+		}
+#endif
+
+	private:
+		std::filesystem::path m_root{};
+		std::vector<std::filesystem::path> m_excludedPaths{};
+
+		constexpr static size_t m_bufferSize{ 64 * 1024 };
+		constexpr static std::chrono::milliseconds m_idleTimeout{ 60'000 };
+
+#ifdef _WIN32
+		HANDLE m_directory{ INVALID_HANDLE_VALUE };
+		OVERLAPPED m_overlapped{};
+		std::vector<DWORD> m_buffer{};
+#elif defined(__linux__)
+		int m_descriptor{ -1 };
+		std::unordered_map<int, std::filesystem::path> m_watches{};
+#else
+		constexpr static std::chrono::milliseconds m_pollInterval{ 500 };
+		std::unordered_map<std::string, Util::FileStamp> m_stamps{};
+#endif
+	};
+}
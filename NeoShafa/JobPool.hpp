@@ -0,0 +1,119 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace NeoShafa {
+	class JobPool {
+	public:
+		JobPool() = default;
+		inline ~JobPool() { stop(); }
+
+		JobPool(const JobPool&) = delete;
+		JobPool& operator=(const JobPool&) = delete;
+
+		inline explicit JobPool(uint32_t workerCount) { start(workerCount); }
+
+		inline static uint32_t default_worker_count() noexcept {
+			const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+			return hardwareThreads == 0 ? 1 : hardwareThreads;
+		}
+
+		inline void start(uint32_t workerCount = 0)
+		{
+			stop();
+			if (workerCount == 0)
+				workerCount = default_worker_count();
+
+			std::scoped_lock lock{ m_mutex };
+			m_stopping = false;
+			m_workers.reserve(workerCount);
+			for (uint32_t lane = 0; lane < workerCount; ++lane)
+				m_workers.emplace_back([this, lane] { worker_loop(lane + 1); });
+		}
+
+		// Finishes every queued job before joining the workers.
+		inline void stop()
+		{
+			{
+				std::scoped_lock lock{ m_mutex };
+				if (m_workers.empty()) return;
+				m_stopping = true;
+			}
+			m_condition.notify_all();
+
+			std::vector<std::jthread> workers{};
+			{
+				std::scoped_lock lock{ m_mutex };
+				workers.swap(m_workers);
+			}
+			workers.clear();
+		}
+
+		inline size_t size() const {
+			std::scoped_lock lock{ m_mutex };
+			return m_workers.size();
+		}
+
+		template <typename Function>
+		inline auto submit(Function&& function) -> std::future<std::invoke_result_t<Function>>
+		{
+			using Result = std::invoke_result_t<Function>;
+
+			auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(function));
+			auto future = task->get_future();
+
+			if (size() == 0)
+				start();
+
+			{
+				std::scoped_lock lock{ m_mutex };
+				m_tasks.emplace_back([task] { (*task)(); });
+			}
+			m_condition.notify_one();
+
+			return future;
+		}
+
+		// 1 and up on the pool's workers, 0 on every other thread.
+		inline static uint32_t current_lane() noexcept { return m_currentLane; }
+
+	private:
+		inline void worker_loop(uint32_t lane)
+		{
+			m_currentLane = lane;
+			while (true) {
+				std::function<void()> task{};
+				{
+					std::unique_lock lock{ m_mutex };
+					m_condition.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+					if (m_tasks.empty())
+						return;
+
+					task = std::move(m_tasks.front());
+					m_tasks.pop_front();
+				}
+				task();
+			}
+		}
+
+	private:
+		mutable std::mutex m_mutex{};
+		std::condition_variable m_condition{};
+
+		std::deque<std::function<void()>> m_tasks{};
+		std::vector<std::jthread> m_workers{};
+
+		bool m_stopping{ false };
+
+		inline static thread_local uint32_t m_currentLane{ 0 };
+	};
+}
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <expected>
+#include <format>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "Core.hpp"
+
+namespace NeoShafa::Json {
+	struct Value;
+
+	using Array = std::vector<Value>;
+	using Object = std::vector<std::pair<std::string, Value>>;
+
+	// Minimal JSON document model, enough for the compiler reports NeoShafa consumes
+	// (MSVC /sourceDependencies, P1689 module scans and Clang -ftime-trace).
+	struct Value {
+		std::variant<std::nullptr_t, bool, double, std::string, Array, Object> data{ nullptr };
+
+		inline bool is_null() const noexcept { return std::holds_alternative<std::nullptr_t>(data); }
+		inline bool is_bool() const noexcept { return std::holds_alternative<bool>(data); }
+		inline bool is_number() const noexcept { return std::holds_alternative<double>(data); }
+		inline bool is_string() const noexcept { return std::holds_alternative<std::string>(data); }
+		inline bool is_array() const noexcept { return std::holds_alternative<Array>(data); }
+		inline bool is_object() const noexcept { return std::holds_alternative<Object>(data); }
+
+		inline bool as_bool() const { return std::get<bool>(data); }
+		inline double as_number() const { return std::get<double>(data); }
+		inline const std::string& as_string() const { return std::get<std::string>(data); }
+		inline const Array& as_array() const { return std::get<Array>(data); }
+		inline const Object& as_object() const { return std::get<Object>(data); }
+
+		inline const Value* find(std::string_view key) const
+		{
+			if (!is_object()) return nullptr;
+			for (const auto& [name, value] : as_object())
+				if (name == key)
+					return &value;
+			return nullptr;
+		}
+
+		inline std::string_view string_or(std::string_view key, std::string_view fallback = {}) const
+		{
+			const Value* value = find(key);
+			return value && value->is_string() ? std::string_view{ value->as_string() } : fallback;
+		}
+
+		inline double number_or(std::string_view key, double fallback = 0.0) const
+		{
+			const Value* value = find(key);
+			return value && value->is_number() ? value->as_number() : fallback;
+		}
+	};
+
+	class Parser {
+	public:
+		inline explicit Parser(std::string_view text) noexcept : m_text(text) {}
+
+		inline Core::Expected<Value> parse()
+		{
+			Value value{};
+			if (!parse_value(value, 0))
+				return std::unexpected(
+					Core::make_error(
+						Core::ErrorCode::UnexpectedJsonParsingError,
+						std::format("Invalid JSON at offset {}.", m_position)
+					)
+				);
+
+			skip_whitespace();
+			if (m_position != m_text.size())
+				return std::unexpected(
+					Core::make_error(
+						Core::ErrorCode::UnexpectedJsonParsingError,
+						std::format("Unexpected trailing data at offset {}.", m_position)
+					)
+				);
+
+			return value;
+		}
+
+	private:
+		inline void skip_whitespace() noexcept
+		{
+			while (m_position < m_text.size()) {
+				const char character = m_text[m_position];
+				if (character != ' ' && character != '\t' && character != '\n' && character != '\r')
+					return;
+				++m_position;
+			}
+		}
+
+		inline bool consume(std::string_view token) noexcept
+		{
+			if (m_text.substr(m_position, token.size()) != token)
+				return false;
+			m_position += token.size();
+			return true;
+		}
+
+		inline bool parse_value(Value& value, uint32_t depth)
+		{
+			if (depth > m_maxDepth)
+				return false;
+
+			skip_whitespace();
+			if (m_position >= m_text.size())
+				return false;
+
+			switch (m_text[m_position])
+			{
+				case '{': return parse_object(value, depth);
+				case '[': return parse_array(value, depth);
+				case '"': {
+					std::string string{};
+					if (!parse_string(string)) return false;
+					value.data = std::move(string);
+					return true;
+				}
+				case 't': value.data = true; return consume("true");
+				case 'f': value.data = false; return consume("false");
+				case 'n': value.data = nullptr; return consume("null");
+				default: return parse_number(value);
+			}
+		}
+
+		inline bool parse_object(Value& value, uint32_t depth)
+		{
+			Object object{};
+			++m_position;
+
+			skip_whitespace();
+			if (consume("}")) {
+				value.data = std::move(object);
+				return true;
+			}
+
+			while (true) {
+				skip_whitespace();
+				std::string key{};
+				if (!parse_string(key)) return false;
+
+				skip_whitespace();
+				if (!consume(":")) return false;
+
+				Value member{};
+				if (!parse_value(member, depth + 1)) return false;
+				object.emplace_back(std::move(key), std::move(member));
+
+				skip_whitespace();
+				if (consume("}")) break;
+				if (!consume(",")) return false;
+			}
+
+			value.data = std::move(object);
+			return true;
+		}
+
+		inline bool parse_array(Value& value, uint32_t depth)
+		{
+			Array array{};
+			++m_position;
+
+			skip_whitespace();
+			if (consume("]")) {
+				value.data = std::move(array);
+				return true;
+			}
+
+			while (true) {
+				Value element{};
+				if (!parse_value(element, depth + 1)) return false;
+				array.push_back(std::move(element));
+
+				skip_whitespace();
+				if (consume("]")) break;
+				if (!consume(",")) return false;
+			}
+
+			value.data = std::move(array);
+			return true;
+		}
+
+		inline bool parse_number(Value& value)
+		{
+			const char* begin = m_text.data() + m_position;
+			const char* end = m_text.data() + m_text.size();
+
+			double number{};
+			const auto [pointer, error] = std::from_chars(begin, end, number);
+			if (error != std::errc{} || pointer == begin)
+				return false;
+
+			m_position += static_cast<size_t>(pointer - begin);
+			value.data = number;
+			return true;
+		}
+
+		inline bool parse_hex4(uint32_t& codePoint)
+		{
+			if (m_position + 4 > m_text.size())
+				return false;
+
+			codePoint = 0;
+			for (size_t i = 0; i < 4; ++i) {
+				const char character = m_text[m_position++];
+				codePoint <<= 4;
+				if (character >= '0' && character <= '9') codePoint |= static_cast<uint32_t>(character - '0');
+				else if (character >= 'a' && character <= 'f') codePoint |= static_cast<uint32_t>(character - 'a' + 10);
+				else if (character >= 'A' && character <= 'F') codePoint |= static_cast<uint32_t>(character - 'A' + 10);
+				else return false;
+			}
+			return true;
+		}
+
+		inline static void append_utf8(std::string& string, uint32_t codePoint)
+		{
+			if (codePoint < 0x80) {
+				string.push_back(static_cast<char>(codePoint));
+			}
+			else if (codePoint < 0x800) {
+				string.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+				string.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+			}
+			else if (codePoint < 0x10000) {
+				string.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+				string.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+				string.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+			}
+			else {
+				string.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+				string.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+				string.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+				string.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+			}
+		}
+
+		inline bool parse_string(std::string& string)
+		{
+			if (!consume("\""))
+				return false;
+
+			while (m_position < m_text.size()) {
+				const char character = m_text[m_position++];
+				if (character == '"')
+					return true;
+				if (character != '\\') {
+					string.push_back(character);
+					continue;
+				}
+
+				if (m_position >= m_text.size())
+					return false;
+
+				switch (m_text[m_position++])
+				{
+					case '"': string.push_back('"'); break;
+					case '\\': string.push_back('\\'); break;
+					case '/': string.push_back('/'); break;
+					case 'b': string.push_back('\b'); break;
+					case 'f': string.push_back('\f'); break;
+					case 'n': string.push_back('\n'); break;
+					case 'r': string.push_back('\r'); break;
+					case 't': string.push_back('\t'); break;
+					case 'u': {
+						uint32_t codePoint{};
+						if (!parse_hex4(codePoint)) return false;
+						if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+							uint32_t lowSurrogate{};
+							if (!consume("\\u") || !parse_hex4(lowSurrogate)) return false;
+							codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (lowSurrogate - 0xDC00);
+						}
+						append_utf8(string, codePoint);
+						break;
+					}
+					default:
+					return false;
+				}
+			}
+
+			return false;
+		}
+
+	private:
+		std::string_view m_text{};
+		size_t m_position{};
+
+		constexpr static uint32_t m_maxDepth{ 256 };
+	};
+
+	inline Core::Expected<Value> parse(std::string_view text) {
+		return Parser{ text }.parse();
+	}
+
+	// Quoted JSON string literal for the reports NeoShafa writes itself.
+	inline std::string quote(std::string_view text)
+	{
+		std::string quoted{ "\"" };
+		quoted.reserve(text.size() + 2);
+		for (const char character : text) {
+			switch (character)
+			{
+				case '"': quoted.append("\\\""); break;
+				case '\\': quoted.append("\\\\"); break;
+				case '\n': quoted.append("\\n"); break;
+				case '\r': quoted.append("\\r"); break;
+				case '\t': quoted.append("\\t"); break;
+				default:
+					if (static_cast<unsigned char>(character) < 0x20)
+						quoted.append(std::format("\\u{:04x}", static_cast<unsigned char>(character)));
+					else
+						quoted.push_back(character);
+					break;
+			}
+		}
+		quoted.push_back('"');
+		return quoted;
+	}
+}
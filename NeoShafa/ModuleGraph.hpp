@@ -0,0 +1,273 @@
+#pragma once
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Util.hpp"
+#include "Json.hpp"
+#include "ContentHash.hpp"
+#include "ProjectData.hpp"
+#include "ProjectDependencies.hpp"
+
+namespace NeoShafa {
+	// Named modules every translation unit provides and imports, taken from the
+	// compiler's P1689 dependency scan and persisted in .shafaCache between builds. A unit
+	// is scanned again only when its source or scan command changes.
+	class ModuleGraph {
+	public:
+		struct Unit {
+			std::filesystem::path source{};
+			ContentHash::Digest key{};
+			// Module or partition whose BMI the unit produces, empty for plain units.
+			std::string provides{};
+			bool isInterface{};
+			std::vector<std::string> imports{};
+		};
+
+	public:
+		ModuleGraph() = default;
+		~ModuleGraph() = default;
+
+		inline explicit ModuleGraph(
+			const ProjectEnvironment* projectEnvironment
+		) noexcept : m_projectEnvironment(projectEnvironment) {}
+
+		inline Core::ExpectedVoid load()
+		{
+			m_units.clear();
+			m_providers.clear();
+			if (!std::filesystem::exists(m_projectEnvironment->projectModuleCacheFilePath))
+				return {};
+
+			auto res = Util::read(m_projectEnvironment->projectModuleCacheFilePath);
+			if (!res)
+				return std::unexpected(
+					Core::make_error(
+						Core::ErrorCode::ReadingModuleCacheError,
+						std::format("Reading module cache error: {}({})", res.error().message, static_cast<int32_t>(res.error().code))
+					)
+				);
+
+			const std::vector<std::string>& lines = res.value();
+			if (lines.empty() || lines.front() != m_cacheHeader) {
+				std::println("WARNING: Module cache has an unknown format, every translation unit will be scanned again.");
+				return {};
+			}
+
+			// key \t source \t provides \t interface \t space separated imports
+			for (size_t i = 1; i < lines.size(); ++i) {
+				std::vector<std::string_view> fields{};
+				std::string_view line{ lines[i] };
+				for (size_t separator = line.find('\t'); separator != std::string_view::npos; separator = line.find('\t')) {
+					fields.push_back(line.substr(0, separator));
+					line.remove_prefix(separator + 1);
+				}
+				fields.push_back(line);
+				if (fields.size() != 5)
+					continue;
+
+				const auto key = ContentHash::Digest::from_string(fields[0]);
+				if (!key)
+					continue;
+
+				Unit unit{ fields[1], *key, std::string{ fields[2] }, fields[3] == "1" };
+				for (std::string_view imports = fields[4]; !imports.empty();) {
+					const size_t separator = imports.find(' ');
+					if (separator != 0)
+						unit.imports.emplace_back(imports.substr(0, separator));
+					imports.remove_prefix(separator == std::string_view::npos ? imports.size() : separator + 1);
+				}
+				update(std::move(unit));
+			}
+
+			return {};
+		}
+
+		inline Core::ExpectedVoid save() const
+		{
+			std::vector<const Unit*> units{};
+			units.reserve(m_units.size());
+			for (const auto& [_, unit] : m_units)
+				units.push_back(&unit);
+			std::ranges::sort(units, {}, [](const Unit* unit) { return unit->source; });
+
+			std::string content{ m_cacheHeader };
+			content.push_back('\n');
+			for (const Unit* unit : units) {
+				content.append(unit->key.to_string())
+					.append("\t").append(unit->source.string())
+					.append("\t").append(unit->provides)
+					.append("\t").append(unit->isInterface ? "1" : "0")
+					.append("\t");
+				for (size_t i = 0; i < unit->imports.size(); ++i)
+					content.append(i == 0 ? "" : " ").append(unit->imports[i]);
+				content.push_back('\n');
+			}
+
+			return Util::write_atomic(m_projectEnvironment->projectModuleCacheFilePath, content);
+		}
+
+		inline void update(Unit unit)
+		{
+			const std::string sourceKey = ProjectDependencies::key(unit.source);
+			if (const auto it = m_units.find(sourceKey); it != m_units.end() && !it->second.provides.empty())
+				m_providers.erase(it->second.provides);
+			if (!unit.provides.empty())
+				m_providers.insert_or_assign(unit.provides, sourceKey);
+			m_units.insert_or_assign(sourceKey, std::move(unit));
+		}
+
+		inline void remove(const std::filesystem::path& source)
+		{
+			const auto it = m_units.find(ProjectDependencies::key(source));
+			if (it == m_units.end())
+				return;
+			if (!it->second.provides.empty())
+				m_providers.erase(it->second.provides);
+			m_units.erase(it);
+		}
+
+		// Forgets the units of translation units that no longer exist.
+		inline void retain(const std::vector<std::filesystem::path>& translationUnits)
+		{
+			std::unordered_set<std::string> sourceKeys{};
+			sourceKeys.reserve(translationUnits.size());
+			for (const auto& translationUnit : translationUnits)
+				sourceKeys.insert(ProjectDependencies::key(translationUnit));
+
+			std::vector<std::filesystem::path> removedUnits{};
+			for (const auto& [sourceKey, unit] : m_units)
+				if (!sourceKeys.contains(sourceKey))
+					removedUnits.push_back(unit.source);
+			for (const auto& source : removedUnits)
+				remove(source);
+		}
+
+		inline const Unit* find(const std::filesystem::path& source) const
+		{
+			const auto it = m_units.find(ProjectDependencies::key(source));
+			return it == m_units.end() ? nullptr : &it->second;
+		}
+
+		inline const Unit* provider_of(std::string_view moduleName) const
+		{
+			const auto it = m_providers.find(std::string{ moduleName });
+			if (it == m_providers.end())
+				return nullptr;
+			const auto unit = m_units.find(it->second);
+			return unit == m_units.end() ? nullptr : &unit->second;
+		}
+
+		// Project modules the unit imports directly or through other project modules, in
+		// a stable order. Modules no project unit provides, such as std, are left to the
+		// compiler.
+		inline std::vector<std::string> imports_closure(const Unit& unit) const
+		{
+			std::vector<std::string> closure{};
+			std::unordered_set<std::string> visited{};
+			std::vector<const Unit*> pending{ &unit };
+			while (!pending.empty()) {
+				const Unit* current = pending.back();
+				pending.pop_back();
+				for (const auto& moduleName : current->imports) {
+					const Unit* provider = provider_of(moduleName);
+					if (!provider || !visited.insert(moduleName).second)
+						continue;
+					closure.push_back(moduleName);
+					pending.push_back(provider);
+				}
+			}
+			std::ranges::sort(closure);
+			return closure;
+		}
+
+		// Units importing any of the given modules, directly or transitively.
+		inline std::vector<std::filesystem::path> importers_of(std::vector<std::string> moduleNames) const
+		{
+			std::unordered_set<std::string> visited{ moduleNames.begin(), moduleNames.end() };
+			std::unordered_set<std::string> importerKeys{};
+			std::vector<std::filesystem::path> importers{};
+			while (!moduleNames.empty()) {
+				const std::string moduleName = std::move(moduleNames.back());
+				moduleNames.pop_back();
+				for (const auto& [sourceKey, unit] : m_units) {
+					if (std::ranges::find(unit.imports, moduleName) == unit.imports.end() || !importerKeys.insert(sourceKey).second)
+						continue;
+					importers.push_back(unit.source);
+					if (!unit.provides.empty() && visited.insert(unit.provides).second)
+						moduleNames.push_back(unit.provides);
+				}
+			}
+			std::ranges::sort(importers);
+			return importers;
+		}
+
+		inline std::vector<std::string> module_names() const
+		{
+			std::vector<std::string> moduleNames{};
+			moduleNames.reserve(m_providers.size());
+			for (const auto& [moduleName, _] : m_providers)
+				moduleNames.push_back(moduleName);
+			std::ranges::sort(moduleNames);
+			return moduleNames;
+		}
+
+		inline bool uses_modules(const Unit& unit) const noexcept {
+			return !unit.provides.empty() || !unit.imports.empty();
+		}
+
+		inline size_t size() const noexcept { return m_units.size(); }
+
+	public:
+		// P1689 report with a single rule: { "rules": [ { "provides": [ { "logical-name": ...,
+		// "is-interface": ... } ], "requires": [ { "logical-name": ... } ] } ] }. Header
+		// units are imported through the include path and are not part of the graph.
+		inline static Core::Expected<Unit> parse_p1689(std::string_view content)
+		{
+			auto document = Json::parse(content);
+			if (!document) return std::unexpected(document.error());
+
+			const Json::Value* rules = document->find("rules");
+			if (!rules || !rules->is_array())
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::ReadingModuleCacheError, "Module scan has no rules array.")
+				);
+
+			Unit unit{};
+			for (const auto& rule : rules->as_array()) {
+				if (const Json::Value* provides = rule.find("provides"); provides && provides->is_array())
+					for (const auto& provided : provides->as_array()) {
+						unit.provides = provided.string_or("logical-name");
+						const Json::Value* isInterface = provided.find("is-interface");
+						unit.isInterface = !isInterface || !isInterface->is_bool() || isInterface->as_bool();
+					}
+
+				if (const Json::Value* requirements = rule.find("requires"); requirements && requirements->is_array())
+					for (const auto& required : requirements->as_array()) {
+						if (required.find("lookup-method"))
+							continue;
+						if (const std::string_view moduleName = required.string_or("logical-name"); !moduleName.empty())
+							unit.imports.emplace_back(moduleName);
+					}
+			}
+
+			std::ranges::sort(unit.imports);
+			const auto [first, last] = std::ranges::unique(unit.imports);
+			unit.imports.erase(first, last);
+			return unit;
+		}
+
+	private:
+		const ProjectEnvironment* m_projectEnvironment{};
+
+		constexpr static std::string_view m_cacheHeader{ "NeoShafaModules 1" };
+
+		std::unordered_map<std::string, Unit> m_units{};
+		std::unordered_map<std::string, std::string> m_providers{};
+	};
+}
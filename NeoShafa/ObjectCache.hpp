@@ -0,0 +1,335 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Util.hpp"
+#include "ContentHash.hpp"
+#include "ProjectData.hpp"
+#include "ProjectDependencies.hpp"
+
+namespace NeoShafa {
+	// Content-addressed store of compiled objects under .shafaCache/objects, looked up in
+	// direct mode: the compile signature and source digest select a manifest listing the
+	// header sets seen for that pair, and the first set whose digests still match names
+	// the cached object and depfile. Restored objects are hard links where possible.
+	class ObjectCache {
+	public:
+		ObjectCache() = default;
+		~ObjectCache() = default;
+
+		ObjectCache(const ObjectCache&) = delete;
+		ObjectCache& operator=(const ObjectCache&) = delete;
+
+		inline ObjectCache(
+			const ProjectEnvironment* projectEnvironment,
+			const ProjectStatistics* projectStatistics
+		) noexcept : m_projectEnvironment(projectEnvironment), m_projectStatistics(projectStatistics) {}
+
+		inline bool enabled() const noexcept {
+			return m_projectStatistics->projectObjectCache && m_projectStatistics->projectObjectCacheSize != 0;
+		}
+
+		// Starts a build with the digests the source scan already produced, so only files
+		// outside the project (system and third-party headers) are hashed again.
+		inline void begin_build(const std::vector<SourceFile>& sourceFiles)
+		{
+			std::scoped_lock lock{ m_mutex };
+			m_digests.clear();
+			m_digests.reserve(sourceFiles.size());
+			for (const auto& sourceFile : sourceFiles)
+				m_digests.insert_or_assign(ProjectDependencies::key(sourceFile.path), sourceFile.hash);
+			m_storedEntries = 0;
+		}
+
+		inline bool restore(
+			const std::filesystem::path& source,
+			const std::filesystem::path& object,
+			const std::filesystem::path& dependencyFile,
+			const ContentHash::Digest& signature
+		) {
+			if (!enabled()) return false;
+
+			const auto baseKey = base_key(source, signature);
+			if (!baseKey) return false;
+
+			const auto manifestPath = entry_path(*baseKey, ".manifest");
+			for (const auto& candidate : read_manifest(manifestPath)) {
+				const bool headersMatch = std::ranges::all_of(candidate.dependencies, [&](const Dependency& dependency) {
+					const auto digest = digest_of(dependency.path);
+					return digest && *digest == dependency.digest;
+				});
+				if (!headersMatch)
+					continue;
+
+				const auto cachedObject = entry_path(candidate.result, object.extension().string());
+				const auto cachedDependencyFile = entry_path(candidate.result, dependencyFile.extension().string());
+				if (!link_or_copy(cachedObject, object) || !copy(cachedDependencyFile, dependencyFile))
+					return false;
+
+				mark_used({ cachedObject, cachedDependencyFile, manifestPath });
+				return true;
+			}
+
+			return false;
+		}
+
+		inline void store(
+			const std::filesystem::path& source,
+			const std::filesystem::path& object,
+			const std::filesystem::path& dependencyFile,
+			const ContentHash::Digest& signature,
+			const std::vector<std::filesystem::path>& dependencies
+		) {
+			if (!enabled()) return;
+
+			const auto baseKey = base_key(source, signature);
+			if (!baseKey) return;
+
+			Candidate candidate{};
+			std::string resultInput{ baseKey->to_string() };
+			for (const auto& path : dependencies) {
+				const auto digest = digest_of(path);
+				if (!digest) return;
+
+				candidate.dependencies.push_back({ path, *digest });
+				resultInput.append(1, '\0').append(path.string()).append(1, '\0').append(digest->to_string());
+			}
+			candidate.result = ContentHash::hash(resultInput);
+
+			if (!publish(object, entry_path(candidate.result, object.extension().string()), true) ||
+				!publish(dependencyFile, entry_path(candidate.result, dependencyFile.extension().string()), false))
+				return;
+
+			const auto manifestPath = entry_path(*baseKey, ".manifest");
+			std::vector<Candidate> candidates = read_manifest(manifestPath);
+			std::erase_if(candidates, [&](const Candidate& other) { return other.result == candidate.result; });
+			candidates.insert(candidates.begin(), std::move(candidate));
+			if (candidates.size() > m_maxCandidates)
+				candidates.resize(m_maxCandidates);
+
+			if (write_manifest(manifestPath, candidates))
+				++m_storedEntries;
+		}
+
+		// Drops the least recently used entries once the store outgrows its size limit,
+		// down to 90% of the limit so the next few builds do not evict again.
+		inline Core::ExpectedVoid evict()
+		{
+			if (!enabled() || m_storedEntries == 0 || !std::filesystem::exists(m_projectEnvironment->projectObjectCachePath))
+				return {};
+
+			struct CachedFile {
+				std::filesystem::path path{};
+				std::filesystem::file_time_type lastUse{};
+				uintmax_t size{};
+			};
+
+			std::vector<CachedFile> cachedFiles{};
+			uintmax_t totalSize{};
+			std::error_code errorCode{};
+			for (auto it = std::filesystem::recursive_directory_iterator(m_projectEnvironment->projectObjectCachePath, errorCode);
+				!errorCode && it != std::filesystem::recursive_directory_iterator(); it.increment(errorCode)) {
+				if (!it->is_regular_file(errorCode))
+					continue;
+
+				CachedFile cachedFile{ it->path(), it->last_write_time(errorCode), it->file_size(errorCode) };
+				if (errorCode) continue;
+
+				totalSize += cachedFile.size;
+				cachedFiles.push_back(std::move(cachedFile));
+			}
+			if (errorCode)
+				return std::unexpected(
+					Core::make_error(
+						Core::ErrorCode::DirectoryIterationError,
+						std::format("Cannot scan object cache: {}", errorCode.message())
+					)
+				);
+
+			const uintmax_t limit = m_projectStatistics->projectObjectCacheSize * 1024 * 1024;
+			if (totalSize <= limit)
+				return {};
+
+			std::ranges::sort(cachedFiles, {}, &CachedFile::lastUse);
+			size_t evicted{};
+			for (const auto& cachedFile : cachedFiles) {
+				if (totalSize <= limit / 10 * 9)
+					break;
+				if (std::filesystem::remove(cachedFile.path, errorCode)) {
+					totalSize -= cachedFile.size;
+					++evicted;
+				}
+			}
+
+			std::println("INFO: Evicted {} file(s) from the object cache.", evicted);
+			return {};
+		}
+
+	private:
+		struct Dependency {
+			std::filesystem::path path{};
+			ContentHash::Digest digest{};
+		};
+
+		struct Candidate {
+			ContentHash::Digest result{};
+			std::vector<Dependency> dependencies{};
+		};
+
+		inline std::optional<ContentHash::Digest> digest_of(const std::filesystem::path& path)
+		{
+			const std::string pathKey = ProjectDependencies::key(path);
+			{
+				std::scoped_lock lock{ m_mutex };
+				if (const auto it = m_digests.find(pathKey); it != m_digests.end())
+					return it->second;
+			}
+
+			const auto res = Util::hash(path);
+			if (!res) return std::nullopt;
+
+			std::scoped_lock lock{ m_mutex };
+			m_digests.insert_or_assign(pathKey, res.value());
+			return res.value();
+		}
+
+		inline std::optional<ContentHash::Digest> base_key(const std::filesystem::path& source, const ContentHash::Digest& signature)
+		{
+			const auto sourceDigest = digest_of(source);
+			if (!sourceDigest) return std::nullopt;
+			return ContentHash::hash(signature.to_string() + sourceDigest->to_string());
+		}
+
+		inline std::filesystem::path entry_path(const ContentHash::Digest& key, std::string_view extension) const
+		{
+			const std::string name = key.to_string();
+			return m_projectEnvironment->projectObjectCachePath / name.substr(0, 2) / (name.substr(2) + std::string{ extension });
+		}
+
+		// manifest: header, then per candidate a result line followed by "\t<digest>\t<path>" lines.
+		inline static std::vector<Candidate> read_manifest(const std::filesystem::path& manifestPath)
+		{
+			std::vector<Candidate> candidates{};
+			if (!std::filesystem::exists(manifestPath))
+				return candidates;
+
+			auto res = Util::read(manifestPath);
+			if (!res || res->empty() || res->front() != m_manifestHeader)
+				return candidates;
+
+			for (size_t i = 1; i < res->size(); ++i) {
+				const std::string_view line{ (*res)[i] };
+				if (line.empty()) continue;
+
+				if (line.front() != '\t') {
+					const auto result = ContentHash::Digest::from_string(line);
+					if (!result) return {};
+					candidates.push_back({ *result, {} });
+					continue;
+				}
+
+				const size_t pathStart = line.find('\t', 1);
+				const auto digest = pathStart == std::string_view::npos
+					? std::nullopt
+					: ContentHash::Digest::from_string(line.substr(1, pathStart - 1));
+				if (!digest || candidates.empty()) return {};
+				candidates.back().dependencies.push_back({ std::filesystem::path{ line.substr(pathStart + 1) }, *digest });
+			}
+
+			return candidates;
+		}
+
+		inline static bool write_manifest(const std::filesystem::path& manifestPath, const std::vector<Candidate>& candidates)
+		{
+			std::string content{ m_manifestHeader };
+			content.push_back('\n');
+			for (const auto& candidate : candidates) {
+				content.append(candidate.result.to_string()).push_back('\n');
+				for (const auto& dependency : candidate.dependencies)
+					content.append("\t").append(dependency.digest.to_string())
+						.append("\t").append(dependency.path.string())
+						.push_back('\n');
+			}
+
+			std::error_code errorCode{};
+			std::filesystem::create_directories(manifestPath.parent_path(), errorCode);
+			return Util::write_atomic(manifestPath, content).has_value();
+		}
+
+		// Cache entries are immutable once published: they are linked or copied to a
+		// temporary name of this writer's own and then renamed into place, so builds
+		// publishing the same entry at once (workspace members, the build server next to a
+		// command line build, checkouts sharing a cache) never see a half-written file.
+		// Objects may be shared by hard link because the build removes an object before
+		// recompiling it.
+		inline static bool publish(const std::filesystem::path& source, const std::filesystem::path& entry, bool allowLink)
+		{
+			std::error_code errorCode{};
+			if (std::filesystem::exists(entry, errorCode)) {
+				mark_used({ entry });
+				return true;
+			}
+
+			std::filesystem::create_directories(entry.parent_path(), errorCode);
+			const std::filesystem::path temporaryEntry = Util::temporary_path(entry);
+			if (!(allowLink ? link_or_copy(source, temporaryEntry) : copy(source, temporaryEntry)))
+				return false;
+
+			std::filesystem::rename(temporaryEntry, entry, errorCode);
+			if (errorCode) {
+				// Windows refuses to replace an entry another build just published and
+				// may hold open; that entry has the same content.
+				std::filesystem::remove(temporaryEntry, errorCode);
+				return std::filesystem::exists(entry, errorCode);
+			}
+			return true;
+		}
+
+		inline static bool link_or_copy(const std::filesystem::path& from, const std::filesystem::path& to)
+		{
+			std::error_code errorCode{};
+			std::filesystem::remove(to, errorCode);
+			std::filesystem::create_hard_link(from, to, errorCode);
+			if (!errorCode) return true;
+
+			return copy(from, to);
+		}
+
+		inline static bool copy(const std::filesystem::path& from, const std::filesystem::path& to)
+		{
+			std::error_code errorCode{};
+			std::filesystem::copy_file(from, to, std::filesystem::copy_options::overwrite_existing, errorCode);
+			return !errorCode;
+		}
+
+		// Eviction drops the files written longest ago first, so every use of an entry moves
+		// its files to the front again.
+		inline static void mark_used(std::initializer_list<std::filesystem::path> paths)
+		{
+			const auto now = std::filesystem::file_time_type::clock::now();
+			std::error_code errorCode{};
+			for (const auto& path : paths)
+				std::filesystem::last_write_time(path, now, errorCode);
+		}
+
+	private:
+		const ProjectEnvironment* m_projectEnvironment{};
+		const ProjectStatistics* m_projectStatistics{};
+
+		constexpr static std::string_view m_manifestHeader{ "NeoShafaObjectCache 1" };
+		constexpr static size_t m_maxCandidates{ 16 };
+
+		std::mutex m_mutex{};
+		std::unordered_map<std::string, ContentHash::Digest> m_digests{};
+		std::atomic<size_t> m_storedEntries{};
+	};
+}
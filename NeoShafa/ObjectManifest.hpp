@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Util.hpp"
+#include "ContentHash.hpp"
+#include "ProjectData.hpp"
+#include "ProjectDependencies.hpp"
+
+namespace NeoShafa {
+	// Object produced for every translation unit together with the signature of the
+	// command that produced it, persisted in .shafaCache between builds.
+	class ObjectManifest {
+	public:
+		struct Entry {
+			std::filesystem::path source{};
+			std::filesystem::path object{};
+			ContentHash::Digest signature{};
+		};
+
+	public:
+		ObjectManifest() = default;
+		~ObjectManifest() = default;
+
+		inline explicit ObjectManifest(
+			const ProjectEnvironment* projectEnvironment
+		) noexcept : m_projectEnvironment(projectEnvironment) {}
+
+		inline Core::ExpectedVoid load()
+		{
+			m_entries.clear();
+			m_linkSignature.reset();
+			if (!std::filesystem::exists(m_projectEnvironment->projectObjectManifestFilePath))
+				return {};
+
+			auto res = Util::read(m_projectEnvironment->projectObjectManifestFilePath);
+			if (!res)
+				return std::unexpected(
+					Core::make_error(
+						Core::ErrorCode::ReadingObjectManifestError,
+						std::format("Reading object manifest error: {}({})", res.error().message, static_cast<int32_t>(res.error().code))
+					)
+				);
+
+			const std::vector<std::string>& lines = res.value();
+			if (lines.empty() || lines.front() != m_manifestHeader) {
+				std::println("WARNING: Object manifest has an unknown format, every translation unit will be recompiled.");
+				return {};
+			}
+
+			// signature \t object \t source, plus one "link \t signature" line
+			for (size_t i = 1; i < lines.size(); ++i) {
+				const std::string_view line{ lines[i] };
+				if (line.starts_with(m_linkPrefix)) {
+					m_linkSignature = ContentHash::Digest::from_string(line.substr(m_linkPrefix.size()));
+					continue;
+				}
+
+				const size_t objectStart = line.find('\t');
+				const size_t sourceStart = objectStart == std::string_view::npos ? objectStart : line.find('\t', objectStart + 1);
+				if (sourceStart == std::string_view::npos)
+					continue;
+
+				const auto signature = ContentHash::Digest::from_string(line.substr(0, objectStart));
+				if (!signature)
+					continue;
+
+				update(
+					line.substr(sourceStart + 1),
+					line.substr(objectStart + 1, sourceStart - objectStart - 1),
+					signature.value()
+				);
+			}
+
+			return {};
+		}
+
+		inline Core::ExpectedVoid save() const
+		{
+			std::vector<const Entry*> entries{};
+			entries.reserve(m_entries.size());
+			for (const auto& [_, entry] : m_entries)
+				entries.push_back(&entry);
+			std::ranges::sort(entries, {}, [](const Entry* entry) { return entry->source; });
+
+			std::string content{ m_manifestHeader };
+			content.push_back('\n');
+			if (m_linkSignature)
+				content.append(m_linkPrefix).append(m_linkSignature->to_string()).push_back('\n');
+			for (const Entry* entry : entries)
+				content.append(entry->signature.to_string())
+					.append("\t").append(entry->object.string())
+					.append("\t").append(entry->source.string())
+					.push_back('\n');
+
+			return Util::write_atomic(m_projectEnvironment->projectObjectManifestFilePath, content);
+		}
+
+		inline void update(
+			const std::filesystem::path& source,
+			const std::filesystem::path& object,
+			const ContentHash::Digest& signature
+		) {
+			m_entries.insert_or_assign(ProjectDependencies::key(source), Entry{ source, object, signature });
+		}
+
+		inline void remove(const std::filesystem::path& source) {
+			m_entries.erase(ProjectDependencies::key(source));
+		}
+
+		inline const Entry* find(const std::filesystem::path& source) const
+		{
+			const auto it = m_entries.find(ProjectDependencies::key(source));
+			return it == m_entries.end() ? nullptr : &it->second;
+		}
+
+		// True when the object is missing or was produced by a different command.
+		inline bool is_stale(
+			const std::filesystem::path& source,
+			const std::filesystem::path& object,
+			const ContentHash::Digest& signature
+		) const {
+			const Entry* entry = find(source);
+			return !entry || entry->signature != signature || entry->object != object || !std::filesystem::exists(object);
+		}
+
+		// Link inputs, ordered by source so the link line is stable between builds.
+		inline std::vector<std::filesystem::path> objects() const
+		{
+			std::vector<const Entry*> entries{};
+			entries.reserve(m_entries.size());
+			for (const auto& [_, entry] : m_entries)
+				entries.push_back(&entry);
+			std::ranges::sort(entries, {}, [](const Entry* entry) { return entry->source; });
+
+			std::vector<std::filesystem::path> objectFiles{};
+			objectFiles.reserve(entries.size());
+			for (const Entry* entry : entries)
+				objectFiles.push_back(entry->object);
+			return objectFiles;
+		}
+
+		inline std::vector<std::filesystem::path> sources() const
+		{
+			std::vector<std::filesystem::path> sourceFiles{};
+			sourceFiles.reserve(m_entries.size());
+			for (const auto& [_, entry] : m_entries)
+				sourceFiles.push_back(entry.source);
+			return sourceFiles;
+		}
+
+		inline const std::optional<ContentHash::Digest>& link_signature() const noexcept { return m_linkSignature; }
+		inline void set_link_signature(const ContentHash::Digest& linkSignature) { m_linkSignature = linkSignature; }
+
+		inline size_t size() const noexcept { return m_entries.size(); }
+
+	private:
+		const ProjectEnvironment* m_projectEnvironment{};
+
+		constexpr static std::string_view m_manifestHeader{ "NeoShafaObjects 1" };
+		constexpr static std::string_view m_linkPrefix{ "link\t" };
+
+		std::unordered_map<std::string, Entry> m_entries{};
+		std::optional<ContentHash::Digest> m_linkSignature{};
+	};
+}
@@ -0,0 +1,284 @@
+#pragma once
+
+#include <algorithm>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Util.hpp"
+#include "ContentHash.hpp"
+#include "ProjectData.hpp"
+
+namespace NeoShafa {
+	// Files of one precompiled header under .shafaCache/pch/<signature>. The compiled
+	// header always wraps a generated pch.hpp, so nothing is written next to the
+	// project's own headers and every compiler sees the same include name.
+	struct PrecompiledHeaderArtifact {
+		std::filesystem::path directory{};
+		std::filesystem::path header{};
+		std::filesystem::path source{};
+		std::filesystem::path output{};
+		std::filesystem::path object{};
+		std::filesystem::path dependencyFile{};
+		ContentHash::Digest fingerprint{};
+	};
+
+	// Chooses and records the project's precompiled header. `ProjectPrecompiledHeader`
+	// names a header relative to the project root, or "auto" to precompile the system
+	// headers most translation units include.
+	class PrecompiledHeader {
+	public:
+		PrecompiledHeader() = default;
+		~PrecompiledHeader() = default;
+
+		inline PrecompiledHeader(
+			const ProjectEnvironment* projectEnvironment,
+			const ProjectStatistics* projectStatistics
+		) noexcept : m_projectEnvironment(projectEnvironment), m_projectStatistics(projectStatistics) {}
+
+		inline bool enabled() const noexcept {
+			return !m_projectStatistics->projectPrecompiledHeader.empty();
+		}
+
+		inline bool is_automatic() const noexcept {
+			return m_projectStatistics->projectPrecompiledHeader == m_automaticHeader;
+		}
+
+		inline PrecompiledHeaderArtifact artifact(const ContentHash::Digest& signature) const
+		{
+			PrecompiledHeaderArtifact artifact{};
+			artifact.directory = m_projectEnvironment->projectPrecompiledHeaderPath / signature.to_string().substr(0, 16);
+			artifact.header = artifact.directory / "pch.hpp";
+			artifact.source = artifact.directory / "pch.cpp";
+			switch (m_projectStatistics->projectCompilationData.projectCompilers)
+			{
+				case Core::SupportedCompilers::MSVC:
+				artifact.output = artifact.directory / "pch.pch";
+				artifact.object = artifact.directory / "pch.obj";
+				artifact.dependencyFile = artifact.directory / "pch.json";
+				break;
+				case Core::SupportedCompilers::Clang:
+				artifact.output = artifact.directory / "pch.hpp.pch";
+				artifact.dependencyFile = artifact.directory / "pch.d";
+				break;
+				default:
+				artifact.output = artifact.directory / "pch.hpp.gch";
+				artifact.dependencyFile = artifact.directory / "pch.d";
+				break;
+			}
+			return artifact;
+		}
+
+		// Writes pch.hpp (and pch.cpp for MSVC /Yc) only when their content changes, so
+		// their stamps keep the recorded inputs valid. Returns false when automatic mode
+		// found no header worth precompiling.
+		inline Core::Expected<bool> write_header(
+			const PrecompiledHeaderArtifact& artifact,
+			const std::vector<SourceFile>& translationUnits
+		) {
+			std::string content{};
+			if (is_automatic()) {
+				const std::vector<std::string>& headers = automatic_headers(translationUnits);
+				if (headers.empty())
+					return false;
+				for (const auto& header : headers)
+					content.append(std::format("#include <{}>\n", header));
+			}
+			else {
+				const std::filesystem::path header = (m_projectEnvironment->projectRoot / m_projectStatistics->projectPrecompiledHeader).lexically_normal();
+				if (!std::filesystem::exists(header))
+					return std::unexpected(
+						Core::make_error(
+							Core::ErrorCode::FileNotFoundError,
+							std::format("Precompiled header {} does not exist.", header.string())
+						)
+					);
+				content = std::format("#include \"{}\"\n", header.generic_string());
+			}
+
+			std::error_code errorCode{};
+			std::filesystem::create_directories(artifact.directory, errorCode);
+			if (auto res = write_if_changed(artifact.header, content); !res)
+				return std::unexpected(res.error());
+			if (m_projectStatistics->projectCompilationData.projectCompilers == Core::SupportedCompilers::MSVC)
+				if (auto res = write_if_changed(artifact.source, std::format("#include \"{}\"\n", artifact.header.string())); !res)
+					return std::unexpected(res.error());
+
+			return true;
+		}
+
+		// Fingerprint of the compiled header when it exists and none of the files it was
+		// built from changed since.
+		inline static std::optional<ContentHash::Digest> current_fingerprint(const PrecompiledHeaderArtifact& artifact)
+		{
+			if (!std::filesystem::exists(artifact.output))
+				return std::nullopt;
+
+			auto res = Util::read(artifact.directory / m_inputsFileName);
+			if (!res || res->size() < 2 || res->front() != m_inputsHeader)
+				return std::nullopt;
+
+			const std::vector<std::string>& lines = res.value();
+			for (size_t i = 2; i < lines.size(); ++i) {
+				const std::string_view line = lines[i];
+				const size_t separator = line.find('\t');
+				if (separator == std::string_view::npos)
+					return std::nullopt;
+
+				const auto stamp = Util::stat(std::filesystem::path{ line.substr(separator + 1) });
+				if (!stamp || std::format("{}:{}", stamp->modificationTime, stamp->size) != line.substr(0, separator))
+					return std::nullopt;
+			}
+
+			return ContentHash::Digest::from_string(lines[1]);
+		}
+
+		// Records the stamps of every file the compiler read and returns the digest of
+		// their content, which becomes part of every translation unit's compile signature.
+		inline static Core::Expected<ContentHash::Digest> record_inputs(
+			const PrecompiledHeaderArtifact& artifact,
+			const std::vector<std::filesystem::path>& dependencies
+		) {
+			std::string inputs{};
+			std::string digests{};
+			for (const auto& dependency : dependencies) {
+				const auto stamp = Util::stat(dependency);
+				const auto digest = Util::hash(dependency);
+				if (!stamp || !digest)
+					continue;
+
+				inputs.append(std::format("{}:{}\t{}\n", stamp->modificationTime, stamp->size, dependency.string()));
+				digests.append(dependency.string()).append(1, '\0').append(digest->to_string()).append(1, '\n');
+			}
+
+			const ContentHash::Digest fingerprint = ContentHash::hash(digests);
+			if (auto res = Util::write_atomic(
+				artifact.directory / m_inputsFileName,
+				std::format("{}\n{}\n{}", m_inputsHeader, fingerprint.to_string(), inputs)
+			); !res)
+				return std::unexpected(res.error());
+
+			return fingerprint;
+		}
+
+	private:
+		// Angle-bracket includes outside any conditional block that at least half of the
+		// translation units share, in the order they first appear. The selection is keyed on
+		// the content hashes of the source table and kept in the project cache, so the
+		// translation units are only read again once one of them was added, removed or edited.
+		inline const std::vector<std::string>& automatic_headers(const std::vector<SourceFile>& translationUnits)
+		{
+			std::string unitsKey{};
+			for (const auto& translationUnit : translationUnits)
+				unitsKey.append(translationUnit.path.string()).append(1, '\0').append(translationUnit.hash.to_string()).append(1, '\n');
+			const ContentHash::Digest key = ContentHash::hash(unitsKey);
+			if (m_automaticHeadersKey && *m_automaticHeadersKey == key)
+				return m_automaticHeaders;
+
+			const std::filesystem::path selectionPath = m_projectEnvironment->projectPrecompiledHeaderPath / m_automaticHeadersFileName;
+			if (auto res = Util::read(selectionPath); res && res->size() >= 2 && res->front() == m_automaticHeadersHeader && res->at(1) == key.to_string()) {
+				m_automaticHeadersKey = key;
+				m_automaticHeaders.assign(res->begin() + 2, res->end());
+				return m_automaticHeaders;
+			}
+
+			std::vector<std::string> order{};
+			std::unordered_map<std::string, size_t> counts{};
+			for (const auto& translationUnit : translationUnits) {
+				auto res = Util::read_all(translationUnit.path);
+				if (!res) continue;
+
+				std::unordered_set<std::string> seen{};
+				for (auto& header : top_level_includes(res.value())) {
+					if (!seen.insert(header).second)
+						continue;
+					if (counts[header]++ == 0)
+						order.push_back(std::move(header));
+				}
+			}
+
+			// Keep first-appearance order, so headers that rely on an earlier one still see it.
+			std::vector<std::string> selected{};
+			const size_t threshold = std::max<size_t>(2, (translationUnits.size() + 1) / 2);
+			for (const auto& header : order)
+				if (counts[header] >= threshold && selected.size() < m_maxAutomaticHeaders)
+					selected.push_back(header);
+
+			std::string selection{ std::format("{}\n{}\n", m_automaticHeadersHeader, key.to_string()) };
+			for (const auto& header : selected)
+				selection.append(header).append(1, '\n');
+			std::error_code errorCode{};
+			std::filesystem::create_directories(selectionPath.parent_path(), errorCode);
+			if (const auto res = Util::write_atomic(selectionPath, selection); !res)
+				std::println("WARNING: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+
+			m_automaticHeadersKey = key;
+			m_automaticHeaders = std::move(selected);
+			return m_automaticHeaders;
+		}
+
+		inline static std::vector<std::string> top_level_includes(std::string_view content)
+		{
+			std::vector<std::string> headers{};
+			size_t depth{};
+			bool inComment{};
+			while (!content.empty()) {
+				const size_t end = content.find('\n');
+				std::string_view line = content.substr(0, end);
+				content.remove_prefix(end == std::string_view::npos ? content.size() : end + 1);
+
+				if (inComment) {
+					if (line.find("*/") != std::string_view::npos)
+						inComment = false;
+					continue;
+				}
+				line.remove_prefix(std::min(line.find_first_not_of(" \t"), line.size()));
+				if (line.starts_with("/*") && line.find("*/") == std::string_view::npos) {
+					inComment = true;
+					continue;
+				}
+				if (!line.starts_with('#'))
+					continue;
+
+				line.remove_prefix(1);
+				line.remove_prefix(std::min(line.find_first_not_of(" \t"), line.size()));
+				if (line.starts_with("if"))
+					++depth;
+				else if (line.starts_with("endif"))
+					depth -= depth != 0;
+				else if (depth == 0 && line.starts_with("include")) {
+					const size_t open = line.find('<');
+					const size_t close = line.find('>', open);
+					if (open != std::string_view::npos && close != std::string_view::npos)
+						headers.emplace_back(line.substr(open + 1, close - open - 1));
+				}
+			}
+			return headers;
+		}
+
+		inline static Core::ExpectedVoid write_if_changed(const std::filesystem::path& path, std::string_view content)
+		{
+			if (auto res = Util::read_all(path); res && res.value() == content)
+				return {};
+			return Util::write_atomic(path, content);
+		}
+
+	private:
+		const ProjectEnvironment* m_projectEnvironment{};
+		const ProjectStatistics* m_projectStatistics{};
+
+		constexpr static std::string_view m_automaticHeader{ "auto" };
+		constexpr static std::string_view m_inputsFileName{ "pch.inputs" };
+		constexpr static std::string_view m_inputsHeader{ "NeoShafaPrecompiledHeader 1" };
+		constexpr static std::string_view m_automaticHeadersFileName{ "automatic.headers" };
+		constexpr static std::string_view m_automaticHeadersHeader{ "NeoShafaAutomaticHeaders 1" };
+		constexpr static size_t m_maxAutomaticHeaders{ 32 };
+
+		std::optional<ContentHash::Digest> m_automaticHeadersKey{};
+		std::vector<std::string> m_automaticHeaders{};
+	};
+}
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <expected>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/process.hpp>
+#include <boost/process/async.hpp>
+
+#include "Core.hpp"
+
+namespace NeoShafa {
+	struct ProcessResult {
+		using Clock = std::chrono::steady_clock;
+
+		int32_t exitCode{};
+		std::string standardOutput{};
+		std::string standardError{};
+		Clock::time_point begin{};
+		Clock::time_point end{};
+		// 1 and up, unique among the children running at the same time.
+		uint32_t slot{};
+
+		// Both streams the way a terminal would show them, without the trailing newlines.
+		inline std::string output() const
+		{
+			std::string out{ standardOutput };
+			if (!out.empty() && !standardError.empty() && out.back() != '\n')
+				out.push_back('\n');
+			out.append(standardError);
+			out.erase(out.find_last_not_of("\r\n") + 1);
+			return out;
+		}
+	};
+
+	// Runs child processes on one Boost.Asio thread. Both pipes of every child are read as
+	// data arrives, so a child filling stderr first can not stall, and any number of
+	// children can be waited on without a thread each. Launches beyond max_running() wait
+	// in order for a slot.
+	class ProcessEngine {
+	public:
+		using Callback = std::function<void(Core::Expected<ProcessResult>)>;
+
+	public:
+		ProcessEngine() = default;
+		inline ~ProcessEngine() { stop(); }
+
+		ProcessEngine(const ProcessEngine&) = delete;
+		ProcessEngine& operator=(const ProcessEngine&) = delete;
+
+		inline static uint32_t default_max_running() noexcept {
+			const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+			return hardwareThreads == 0 ? 1 : hardwareThreads;
+		}
+
+		inline void set_max_running(uint32_t maxRunning)
+		{
+			boost::asio::post(m_context, [this, maxRunning] {
+				m_maxRunning = maxRunning == 0 ? default_max_running() : maxRunning;
+				launch_waiting();
+			});
+			start();
+		}
+
+		// The callback runs on the engine thread, so it must hand any slow work elsewhere and
+		// never wait on another child itself. Children start in `workingDirectory`, or in the
+		// current directory when it is empty.
+		inline void launch(
+			std::filesystem::path executable,
+			std::vector<std::string> arguments,
+			Callback callback,
+			std::filesystem::path workingDirectory = {}
+		) {
+			auto launch = std::make_shared<Launch>(std::move(executable), std::move(arguments), std::move(callback), std::move(workingDirectory));
+			boost::asio::post(m_context, [this, launch] {
+				m_waiting.push_back(launch);
+				launch_waiting();
+			});
+			start();
+		}
+
+		// Blocks the calling thread only, the engine keeps serving every other child.
+		inline Core::Expected<ProcessResult> run(
+			std::filesystem::path executable,
+			std::vector<std::string> arguments,
+			std::filesystem::path workingDirectory = {}
+		) {
+			auto promise = std::make_shared<std::promise<Core::Expected<ProcessResult>>>();
+			auto future = promise->get_future();
+			launch(std::move(executable), std::move(arguments), [promise](Core::Expected<ProcessResult> result) {
+				promise->set_value(std::move(result));
+			}, std::move(workingDirectory));
+			return future.get();
+		}
+
+		// Children still running are waited for before the thread is joined.
+		inline void stop()
+		{
+			std::scoped_lock lock{ m_mutex };
+			if (!m_thread.joinable())
+				return;
+			m_workGuard.reset();
+			m_thread.join();
+		}
+
+	private:
+		struct Launch {
+			inline Launch(std::filesystem::path executable, std::vector<std::string> arguments, Callback callback, std::filesystem::path workingDirectory) :
+				executable(std::move(executable)), arguments(std::move(arguments)), callback(std::move(callback)), workingDirectory(std::move(workingDirectory)) {}
+
+			std::filesystem::path executable{};
+			std::vector<std::string> arguments{};
+			Callback callback{};
+			std::filesystem::path workingDirectory{};
+		};
+
+		struct Running {
+			inline explicit Running(boost::asio::io_context& context) : outputPipe(context), errorPipe(context) {}
+
+			boost::process::async_pipe outputPipe;
+			boost::process::async_pipe errorPipe;
+			boost::process::child child{};
+			ProcessResult result{};
+			Callback callback{};
+			// Both pipes reaching EOF and the exit itself.
+			uint32_t pendingEvents{ 3 };
+		};
+
+	private:
+		inline void start()
+		{
+			std::scoped_lock lock{ m_mutex };
+			if (m_thread.joinable())
+				return;
+			if (m_context.stopped())
+				m_context.restart();
+			m_workGuard.emplace(m_context.get_executor());
+			m_thread = std::thread{ [this] { m_context.run(); } };
+		}
+
+		// Everything below runs on the engine thread only.
+		inline void launch_waiting()
+		{
+			while (!m_waiting.empty() && m_runningCount < m_maxRunning) {
+				auto launch = std::move(m_waiting.front());
+				m_waiting.pop_front();
+				spawn(*launch);
+			}
+		}
+
+		inline void spawn(Launch& launch)
+		{
+			if (!std::filesystem::exists(launch.executable)) {
+				launch.callback(std::unexpected(
+					Core::make_error(
+						Core::ErrorCode::RunningCommandError,
+						std::format("Executable not found at {}", launch.executable.string())
+					)
+				));
+				return;
+			}
+
+			auto running = std::make_shared<Running>(m_context);
+			running->callback = std::move(launch.callback);
+			running->result.slot = acquire_slot();
+			running->result.begin = ProcessResult::Clock::now();
+			++m_runningCount;
+
+			try {
+				running->child = boost::process::child{
+					launch.executable.string(),
+					launch.arguments,
+					boost::process::start_dir = (launch.workingDirectory.empty() ? std::filesystem::current_path() : launch.workingDirectory).string(),
+					boost::process::std_out > running->outputPipe,
+					boost::process::std_err > running->errorPipe,
+					boost::process::std_in < boost::process::null,
+					// Boost.Process walks its list of waiting children while calling this, so
+					// launching the next child from inside it would invalidate that list.
+					boost::process::on_exit([this, running](int exitCode, const std::error_code&) {
+						running->result.exitCode = exitCode;
+						running->result.end = ProcessResult::Clock::now();
+						boost::asio::post(m_context, [this, running] { finish_event(running); });
+					}),
+					m_context
+				};
+			}
+			catch (const boost::process::process_error& error) {
+				--m_runningCount;
+				release_slot(running->result.slot);
+				running->callback(std::unexpected(
+					Core::make_error(
+						Core::ErrorCode::RunningCommandError,
+						std::format("Error executing command: {}", error.what())
+					)
+				));
+				launch_waiting();
+				return;
+			}
+
+			read_until_eof(running, running->outputPipe, running->result.standardOutput);
+			read_until_eof(running, running->errorPipe, running->result.standardError);
+		}
+
+		inline void read_until_eof(const std::shared_ptr<Running>& running, boost::process::async_pipe& pipe, std::string& buffer)
+		{
+			boost::asio::async_read(pipe, boost::asio::dynamic_buffer(buffer), [this, running](const boost::system::error_code&, size_t) {
+				finish_event(running);
+			});
+		}
+
+		inline void finish_event(const std::shared_ptr<Running>& running)
+		{
+			if (--running->pendingEvents != 0)
+				return;
+
+			--m_runningCount;
+			release_slot(running->result.slot);
+			running->callback(std::move(running->result));
+			launch_waiting();
+		}
+
+		inline uint32_t acquire_slot()
+		{
+			for (uint32_t slot = 0; slot < m_slots.size(); ++slot)
+				if (!m_slots[slot]) {
+					m_slots[slot] = true;
+					return slot + 1;
+				}
+			m_slots.push_back(true);
+			return static_cast<uint32_t>(m_slots.size());
+		}
+
+		inline void release_slot(uint32_t slot) { m_slots[slot - 1] = false; }
+
+	private:
+		std::mutex m_mutex{};
+		boost::asio::io_context m_context{};
+		std::optional<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> m_workGuard{};
+		std::thread m_thread{};
+
+		uint32_t m_maxRunning{ default_max_running() };
+		uint32_t m_runningCount{};
+		std::deque<std::shared_ptr<Launch>> m_waiting{};
+		std::vector<bool> m_slots{};
+	};
+
+	inline ProcessEngine g_processEngine{};
+}
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <print>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+#include "Util.hpp"
+#include "JobPool.hpp"
+#include "ContentHash.hpp"
+#include "ProjectData.hpp"
+#include "ProjectDataScraper.hpp"
+#include "ProjectSession.hpp"
+
+namespace NeoShafa {
+	// --pgo: builds the selected configuration, Release without one, instrumented, runs the
+	// ProjectPgoTraining command of config.toml on it and rebuilds it with the profile and
+	// LTO. Both builds are derived configurations with partitions of their own, so each
+	// stage stays incremental. The profile is stored under a hash of every scanned source,
+	// the instrumented compile and link commands and the training command, training runs
+	// again only once one of them changed.
+	class ProfileGuidedBuild {
+	public:
+		inline ProfileGuidedBuild(const std::filesystem::path& projectRoot, JobPool* jobPool) noexcept :
+			m_projectRoot(projectRoot), m_jobPool(jobPool) {}
+		~ProfileGuidedBuild() = default;
+
+		ProfileGuidedBuild(const ProfileGuidedBuild&) = delete;
+		ProfileGuidedBuild& operator=(const ProfileGuidedBuild&) = delete;
+
+		inline void set_configuration(std::string configuration) { m_configuration = std::move(configuration); }
+
+		inline Core::ExpectedVoid run()
+		{
+			ProjectEnvironment projectEnvironment{ m_projectRoot };
+			ProjectStatistics projectStatistics{};
+			if (const auto res = ProjectDataScraper{ &projectEnvironment, &projectStatistics }.project_setup(); !res)
+				return res;
+
+			const auto& compilationData = projectStatistics.projectCompilationData;
+			m_compiler = compilationData.projectCompilers;
+			if (m_compiler != Core::SupportedCompilers::GCC && m_compiler != Core::SupportedCompilers::Clang)
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::ProfileTrainingError, std::format("--pgo does not support {} yet.", Core::to_string(m_compiler)))
+				);
+			if (compilationData.projectType == (*ProjectCompilationData::supportedProjectTypes)[ProjectCompilationData::supportedProjectTypes.StaticLibrary])
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::ProfileTrainingError, "--pgo needs an executable or a shared library to train.")
+				);
+			if (projectStatistics.projectPgoTraining.empty())
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::ProfileTrainingError, "--pgo needs a ProjectPgoTraining command.")
+				);
+			m_training = projectStatistics.projectPgoTraining;
+
+			std::string configuration = m_configuration.value_or(projectStatistics.projectConfiguration);
+			if (configuration.empty())
+				configuration = "Release";
+			if (auto res = m_instrumentEnvironment.set_configuration(std::format("{}-pgo-instrument", configuration)); !res)
+				return res;
+			if (auto res = m_optimizeEnvironment.set_configuration(std::format("{}-pgo", configuration)); !res)
+				return res;
+
+			std::println("INFO: Building {} instrumented.", configuration);
+			ProjectSession instrument{ m_projectRoot, m_jobPool };
+			if (auto res = instrument.set_configuration(configuration); !res)
+				return res;
+			if (auto res = instrument.set_derived_configuration(instrument_configuration()); !res)
+				return res;
+			if (!instrument.prepare_build() || !instrument.build_changes())
+				return std::unexpected(Core::make_error(Core::ErrorCode::GenericBuildError, "Instrumented build failed."));
+			m_compilerPath = instrument.statistics().projectCompilationData.cppCompilerPath;
+
+			const std::filesystem::path profileFolder = m_optimizeEnvironment.projectConfigurationCachePath / g_projectProfileFolderName;
+			const std::filesystem::path profile = profileFolder / profile_key(instrument);
+			if (std::filesystem::exists(profile))
+				std::println("INFO: Sources, flags and training command are unchanged, reusing the profile.");
+			else if (const auto res = train(instrument.build().link_output_path(), profileFolder, profile); !res)
+				return res;
+
+			std::println("INFO: Building {} with the profile.", configuration);
+			ProjectSession optimize{ m_projectRoot, m_jobPool };
+			if (auto res = optimize.set_configuration(configuration); !res)
+				return res;
+			if (auto res = optimize.set_derived_configuration(optimize_configuration(profile)); !res)
+				return res;
+			if (!optimize.prepare_build() || !optimize.build_changes())
+				return std::unexpected(Core::make_error(Core::ErrorCode::GenericBuildError, "Profile-guided build failed."));
+
+			std::println("INFO: Profile-guided build is {}.", optimize.build().link_output_path().string());
+			return {};
+		}
+
+	private:
+		// Profiles are written below the cache partition of the instrumented build, GCC one
+		// .gcda per object at <folder>/<absolute object path>.
+		inline std::filesystem::path raw_profile_folder() const {
+			return m_instrumentEnvironment.projectConfigurationCachePath / "profile-raw";
+		}
+
+		inline BuildConfiguration instrument_configuration() const
+		{
+			const std::string rawProfile = raw_profile_folder().string();
+			if (m_compiler == Core::SupportedCompilers::GCC) {
+				const std::string generate = std::format("-fprofile-generate={}", rawProfile);
+				return { m_instrumentEnvironment.projectConfiguration, { generate, "-fprofile-update=atomic" }, {}, { generate } };
+			}
+			const std::string generate = std::format("-fprofile-instr-generate={}", (raw_profile_folder() / "%m.profraw").string());
+			return { m_instrumentEnvironment.projectConfiguration, { generate }, {}, { generate } };
+		}
+
+		// The profile is part of the compile command, so a new one recompiles every object.
+		inline BuildConfiguration optimize_configuration(const std::filesystem::path& profile) const
+		{
+			if (m_compiler == Core::SupportedCompilers::GCC) {
+				const std::string use = std::format("-fprofile-use={}", profile.string());
+				return {
+					m_optimizeEnvironment.projectConfiguration,
+					{ use, "-fprofile-partial-training", "-Wno-missing-profile", "-flto=auto" },
+					{},
+					{ use, "-flto=auto" }
+				};
+			}
+			return {
+				m_optimizeEnvironment.projectConfiguration,
+				{ std::format("-fprofile-instr-use={}", (profile / m_mergedProfileName).string()), "-flto=thin" },
+				{},
+				{ "-flto=thin" }
+			};
+		}
+
+		// A profile only fits objects compiled exactly like the instrumented ones, GCC rejects
+		// it once e.g. the optimization level changed. The compile signatures of the object
+		// manifest cover the compiler, its flags and defines, the link flags are added.
+		inline std::string profile_key(const ProjectSession& instrument) const
+		{
+			std::string signature{ Core::to_string(m_compiler) };
+			for (const auto& argument : m_training)
+				signature.append(1, '\0').append(argument);
+			signature.append(1, '\n');
+			for (const auto& flag : instrument.statistics().linker_flags())
+				signature.append(1, '\0').append(flag);
+			signature.append(1, '\n');
+			for (const auto& sourceFile : instrument.source_files())
+				signature.append(sourceFile.path.generic_string()).append(1, '\0').append(sourceFile.hash.to_string()).append(1, '\n');
+
+			std::vector<std::filesystem::path> units = instrument.object_manifest().sources();
+			std::ranges::sort(units);
+			for (const auto& unit : units)
+				if (const ObjectManifest::Entry* entry = instrument.object_manifest().find(unit))
+					signature.append(unit.generic_string()).append(1, '\0').append(entry->signature.to_string()).append(1, '\n');
+			return ContentHash::hash(signature).to_string();
+		}
+
+		// Runs the training command on a clean raw profile folder and stores what it wrote
+		// as the profile, dropping the ones of older sources.
+		inline Core::ExpectedVoid train(
+			const std::filesystem::path& output,
+			const std::filesystem::path& profileFolder,
+			const std::filesystem::path& profile
+		) {
+			std::error_code errorCode{};
+			std::filesystem::remove_all(raw_profile_folder(), errorCode);
+			std::filesystem::create_directories(raw_profile_folder(), errorCode);
+
+			std::vector<std::string> command{};
+			for (std::string argument : m_training) {
+				for (size_t position = argument.find(m_outputPlaceholder); position != std::string::npos; position = argument.find(m_outputPlaceholder, position + output.string().size()))
+					argument.replace(position, m_outputPlaceholder.size(), output.string());
+				command.push_back(std::move(argument));
+			}
+			std::filesystem::path executable{ command.front() };
+			if (!executable.has_parent_path())
+				if (const auto found = Util::BoostProcess::search_path(executable.string()); !found.empty())
+					executable = found.string();
+
+			std::println("INFO: Training with {}.", command.front());
+			int32_t exitCode{};
+			const auto res = Util::run_command(executable, { command.begin() + 1, command.end() }, exitCode, m_projectRoot);
+			if (!res) return std::unexpected(res.error());
+			if (!res->empty())
+				std::print("{}{}", *res, res->ends_with('\n') ? "" : "\n");
+			if (exitCode != 0)
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::ProfileTrainingError, std::format("Training command exited with {}.", exitCode))
+				);
+
+			std::filesystem::path staging{ profile };
+			staging += ".partial";
+			std::filesystem::remove_all(staging, errorCode);
+			std::filesystem::create_directories(staging, errorCode);
+			const auto collected = m_compiler == Core::SupportedCompilers::GCC ? relocate_gcda(staging) : merge_profraw(staging);
+			if (!collected) {
+				std::filesystem::remove_all(staging, errorCode);
+				return collected;
+			}
+
+			for (const auto& entry : std::filesystem::directory_iterator{ profileFolder, errorCode })
+				if (entry.path() != staging)
+					std::filesystem::remove_all(entry.path(), errorCode);
+			std::filesystem::rename(staging, profile, errorCode);
+			if (errorCode)
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::CannotWriteFileError, std::format("Cannot store the profile: {}.", errorCode.message()))
+				);
+			return {};
+		}
+
+		// GCC looks a profile up by the absolute path of the object it belongs to, so the
+		// files written for the instrumented objects move to where the optimized ones are.
+		inline Core::ExpectedVoid relocate_gcda(const std::filesystem::path& staging) const
+		{
+			const std::pair<std::filesystem::path, std::filesystem::path> folders[]{
+				{ m_instrumentEnvironment.projectBinaryFolderPath, m_optimizeEnvironment.projectBinaryFolderPath },
+				{ m_instrumentEnvironment.projectConfigurationCachePath, m_optimizeEnvironment.projectConfigurationCachePath }
+			};
+
+			size_t profileCount{};
+			for (const auto& [instrumentFolder, optimizeFolder] : folders) {
+				const std::filesystem::path from = raw_profile_folder() / instrumentFolder.relative_path();
+				std::error_code errorCode{};
+				for (auto it = std::filesystem::recursive_directory_iterator{ from, errorCode }; !errorCode && it != std::filesystem::recursive_directory_iterator{}; it.increment(errorCode)) {
+					if (it->path().extension() != ".gcda" || !it->is_regular_file(errorCode))
+						continue;
+					const std::filesystem::path to = staging / optimizeFolder.relative_path() / it->path().lexically_relative(from);
+					std::error_code copyError{};
+					std::filesystem::create_directories(to.parent_path(), copyError);
+					if (!std::filesystem::copy_file(it->path(), to, std::filesystem::copy_options::overwrite_existing, copyError))
+						return std::unexpected(
+							Core::make_error(Core::ErrorCode::CannotWriteFileError, std::format("Cannot copy {}: {}.", it->path().string(), copyError.message()))
+						);
+					++profileCount;
+				}
+			}
+
+			if (profileCount == 0)
+				return std::unexpected(Core::make_error(Core::ErrorCode::ProfileTrainingError, "Training wrote no profile."));
+			return {};
+		}
+
+		inline Core::ExpectedVoid merge_profraw(const std::filesystem::path& staging) const
+		{
+			std::vector<std::string> arguments{ "merge", std::format("-output={}", (staging / m_mergedProfileName).string()) };
+			std::error_code errorCode{};
+			for (const auto& entry : std::filesystem::directory_iterator{ raw_profile_folder(), errorCode })
+				if (entry.path().extension() == ".profraw")
+					arguments.push_back(entry.path().string());
+			if (arguments.size() == 2)
+				return std::unexpected(Core::make_error(Core::ErrorCode::ProfileTrainingError, "Training wrote no profile."));
+
+			std::filesystem::path profileTool = m_compilerPath.parent_path() / std::filesystem::path{ "llvm-profdata" }.replace_extension(m_compilerPath.extension());
+			if (!std::filesystem::exists(profileTool))
+				profileTool = Util::BoostProcess::search_path("llvm-profdata").string();
+
+			int32_t exitCode{};
+			const auto res = Util::run_command(profileTool, arguments, exitCode, m_projectRoot);
+			if (!res) return std::unexpected(res.error());
+			if (exitCode != 0)
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::ProfileTrainingError, std::format("llvm-profdata failed: {}", *res))
+				);
+			return {};
+		}
+
+	private:
+		inline static constexpr std::string_view m_outputPlaceholder{ "{output}" };
+		inline static constexpr std::string_view m_mergedProfileName{ "merged.profdata" };
+
+		std::filesystem::path m_projectRoot{};
+		JobPool* m_jobPool{};
+		std::optional<std::string> m_configuration{};
+
+		Core::SupportedCompilers m_compiler{ Core::SupportedCompilers::Unknown };
+		std::filesystem::path m_compilerPath{};
+		std::vector<std::string> m_training{};
+		ProjectEnvironment m_instrumentEnvironment{ m_projectRoot };
+		ProjectEnvironment m_optimizeEnvironment{ m_projectRoot };
+	};
+}
@@ -2,12 +2,46 @@
 
 #include <iostream>
 #include <print>
+#include <future>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
 
 #include "Util.hpp"
+#include "JobPool.hpp"
 #include "ProjectData.hpp"
+#include "ProjectDependencies.hpp"
+#include "ObjectManifest.hpp"
+#include "ObjectCache.hpp"
+#include "PrecompiledHeader.hpp"
+#include "ModuleGraph.hpp"
+#include "UnityBuild.hpp"
+#include "BuildTrace.hpp"
+#include "TimeTraceReport.hpp"
 #include "ProjectLuaScriptStarter.hpp"
+#include "ScriptStepCache.hpp"
 
 namespace NeoShafa {
+	struct LinkCommand {
+		std::filesystem::path process{};
+		std::vector<std::string> arguments{};
+		std::vector<std::filesystem::path> inputs{};
+		// Outputs of workspace dependencies, also named in the arguments.
+		std::vector<std::filesystem::path> libraries{};
+		std::filesystem::path output{};
+	};
+
+	struct CompileJobResult {
+		std::filesystem::path source{};
+		std::filesystem::path object{};
+		ContentHash::Digest signature{};
+		int32_t exitCode{};
+		bool restored{};
+		std::string output{};
+		Core::Expected<std::vector<std::filesystem::path>> dependencies{};
+	};
+
 	class ProjectBuild {
 	public:
 		ProjectBuild() = default;
@@ -15,96 +49,1047 @@ namespace NeoShafa {
 
 		inline ProjectBuild(
 			const ProjectEnvironment* projectEnvironment,
-			ProjectStatistics* projectStatistics
-		) noexcept : m_projectEnvironment(projectEnvironment), m_projectStatistics(projectStatistics) {}
+			ProjectStatistics* projectStatistics,
+			ProjectDependencies* projectDependencies,
+			ObjectManifest* objectManifest,
+			ObjectCache* objectCache,
+			ModuleGraph* moduleGraph,
+			JobPool* jobPool
+		) noexcept :
+			m_projectEnvironment(projectEnvironment),
+			m_projectStatistics(projectStatistics),
+			m_projectDependencies(projectDependencies),
+			m_objectManifest(objectManifest),
+			m_objectCache(objectCache),
+			m_moduleGraph(moduleGraph),
+			m_jobPool(jobPool),
+			m_precompiledHeader(projectEnvironment, projectStatistics),
+			m_unityBuild(projectEnvironment, projectStatistics),
+			m_luaScriptStarter(projectEnvironment),
+			m_scriptStepCache(projectEnvironment) {}
 
 		inline Core::ExpectedVoid full_build(
+			const std::vector<SourceFile>& sourceFiles,
 			const std::vector<std::filesystem::path>& diffSource
 		)
 		{ 
-			if (!m_projectStatistics->projectPrebuild.empty())
-				prebuild();
-
-			const auto res = build_to_object(diffSource);
-			if (!res) return res;
+			// A prebuild script that declares its files has already run, see prebuild().
+			if (!m_projectStatistics->projectPrebuild.empty() && !prebuild_step().is_declared()) {
+				auto span = g_buildTrace.span("prebuild", "lua");
+				run_script_step(prebuild_step(), sourceFiles, span);
+			}
 
-			const auto resLink = linking();
-			if (!resLink) return resLink;
+			prune_objects(sourceFiles);
+			auto res = build_to_object(diffSource);
+			if (res)
+				res = linking();
 
-			if(!m_projectStatistics->projectPostbuild.empty())
-				postbuild();
+			if (res && !m_projectStatistics->projectPostbuild.empty())
+				postbuild(sourceFiles);
 
-			return {};
+			// Both scripts share one VM, which is closed once the build is over.
+			m_luaScriptStarter.close();
+			return res;
 		}
 
 		inline Core::ExpectedVoid build_to_object(
 			const std::vector<std::filesystem::path>& diffSource
-		) {	
-			std::vector<std::string> msvcCompileString {
-				std::format("/nologo"),
-				std::format("/c"),
-				std::format("/std:{}", m_projectStatistics->projectCompilationData.cppCompilerVersion),
-				std::format("/Fo:{}", m_projectEnvironment->projectBinaryFolderPath.string().append("\\")),
-				std::format("/Fd:{}", m_projectEnvironment->projectBinaryFolderPath.string().append("\\")),
+		) {
+			std::vector<std::filesystem::path> translationUnits{};
+			std::unordered_set<std::string> scheduledUnits{};
+			for (const auto& filePath : diffSource) {
+				if (!is_translation_unit(filePath))
+					continue;
+				const std::filesystem::path& compileUnit = compile_unit(filePath);
+				if (scheduledUnits.insert(ProjectDependencies::key(compileUnit)).second)
+					translationUnits.push_back(compileUnit);
+			}
+			if (m_modulesEnabled)
+				add_module_dependents(translationUnits);
+
+			// Two units writing one object, e.g. a module interface and its implementation,
+			// would overwrite each other and only one of them would be linked.
+			std::unordered_map<std::string, const std::filesystem::path*> objectOwners{};
+			for (const auto& unit : translationUnits)
+				if (const auto [it, inserted] = objectOwners.emplace(object_path(unit).generic_string(), &unit); !inserted)
+					return std::unexpected(
+						Core::make_error(
+							Core::ErrorCode::GenericBuildError,
+							std::format("{} and {} compile to the same object {}.", it->second->string(), unit.string(), it->first)
+						)
+					);
+
+			if (translationUnits.empty()) {
+				std::println("INFO: No translation units to compile.");
+				return {};
+			}
+
+			std::println("COMPILING {} translation unit(s)", translationUnits.size());
+			auto compileSpan = g_buildTrace.span("compile", "build");
+			compileSpan.argument("units", std::to_string(translationUnits.size()));
+
+			// A unit starts once every unit providing a module it imports has finished, so
+			// BMIs are written before they are read while independent units run in parallel.
+			std::vector<std::vector<size_t>> dependents(translationUnits.size());
+			std::vector<size_t> pendingImports(translationUnits.size());
+			if (m_modulesEnabled)
+				module_edges(translationUnits, dependents, pendingImports);
+
+			const std::string compilerIdentity = build_identity();
+			std::mutex resultMutex{};
+			std::condition_variable resultCondition{};
+			std::deque<std::pair<size_t, CompileJobResult>> results{};
+			size_t runningJobs{};
+			// A pool job only prepares the unit and starts the compiler, the result arrives once
+			// the compiler exits, so running compilers do not hold a worker each.
+			const auto submit = [&](size_t index) {
+				++runningJobs;
+				m_jobPool->submit([&, index] {
+					const auto done = [&, index](CompileJobResult result) {
+						std::scoped_lock lock{ resultMutex };
+						results.emplace_back(index, std::move(result));
+						resultCondition.notify_one();
+					};
+					try {
+						compile_translation_unit(translationUnits[index], compilerIdentity, done);
+					}
+					catch (const std::exception& exception) {
+						done({ translationUnits[index], {}, {}, static_cast<int32_t>(Core::ErrorCode::GenericBuildError), false, exception.what() });
+					}
+				});
 			};
-			std::string otherCompileString{};
+			for (size_t index = 0; index < translationUnits.size(); ++index)
+				if (pendingImports[index] == 0)
+					submit(index);
 
+			size_t failedJobs{};
+			size_t restoredJobs{};
+			while (runningJobs != 0) {
+				std::unique_lock lock{ resultMutex };
+				resultCondition.wait(lock, [&] { return !results.empty(); });
+				auto [index, result] = std::move(results.front());
+				results.pop_front();
+				lock.unlock();
+				--runningJobs;
 
-			
-			switch (m_projectStatistics->projectCompilationData.projectCompilers)
+				std::println(" {} {}", result.source.string(), result.restored ? "(cached)" : "");
+				if (result.restored)
+					++restoredJobs;
+				if (!result.output.empty())
+					std::println("INFO: \n|=>\n{}\n<=|", result.output);
+
+				if (result.exitCode != 0) {
+					std::println(std::cerr, "ERROR: {} exited with code: {}.", result.source.string(), result.exitCode);
+					m_objectManifest->remove(result.source);
+					++failedJobs;
+					continue;
+				}
+
+				m_objectManifest->update(result.source, result.object, result.signature);
+				if (!result.dependencies) {
+					std::println(
+						"WARNING: Header dependencies of {} are unknown: {}({})",
+						result.source.string(),
+						result.dependencies.error().message,
+						static_cast<int32_t>(result.dependencies.error().code)
+					);
+					m_projectDependencies->remove(result.source);
+				}
+				else
+					m_projectDependencies->update(result.source, std::move(*result.dependencies));
+
+				for (const size_t dependent : dependents[index])
+					if (--pendingImports[dependent] == 0)
+						submit(dependent);
+			}
+
+			for (size_t index = 0; index < translationUnits.size(); ++index) {
+				if (pendingImports[index] == 0)
+					continue;
+				std::println(
+					std::cerr,
+					"ERROR: {} was not compiled, {}.",
+					translationUnits[index].string(),
+					failedJobs != 0 ? "a module it imports failed to compile" : "its module imports form a cycle"
+				);
+				m_objectManifest->remove(translationUnits[index]);
+				++failedJobs;
+			}
+
+			if (restoredJobs != 0)
+				std::println("INFO: {} of {} translation unit(s) restored from the object cache.", restoredJobs, translationUnits.size());
+
+			if (failedJobs != 0)
+				return std::unexpected(
+					Core::make_error(
+						Core::ErrorCode::RunningCommandError,
+						std::format("{} of {} translation units failed to compile.", failedJobs, translationUnits.size())
+					)
+				);
+
+			return {};
+		}
+
+		// Restores the object from the cache, or starts the compiler on g_processEngine and
+		// finishes on the job pool once it exits. `done` is called exactly once either way.
+		inline void compile_translation_unit(
+			const std::filesystem::path& sourcePath,
+			std::string_view compilerIdentity,
+			std::function<void(CompileJobResult)> done
+		) const {
+			CompileJobResult result{ sourcePath, object_path(sourcePath) };
+
+			auto arguments = compile_arguments(sourcePath, result.object);
+			result.signature = command_signature(compilerIdentity, arguments);
+
+			// Tracing does not change the object, so it stays out of the signature. A restored
+			// object has no trace, so the cache is only written to while tracing.
+			std::error_code errorCode{};
+			std::filesystem::create_directories(result.object.parent_path(), errorCode);
+			const bool timeTrace = uses_time_trace();
+			std::filesystem::remove(time_trace_path(result.object), errorCode);
+			if (timeTrace)
+				arguments.push_back("-ftime-trace");
+
+			// BMIs are not part of the object cache, so module units are always compiled.
+			const ModuleGraph::Unit* moduleUnit = module_unit(sourcePath);
+			const auto dependencyFilePath = ProjectDependencies::dependency_file_path(result.object);
+			const auto restoreBegin = BuildTrace::Clock::now();
+			if (!moduleUnit && !timeTrace && m_objectCache->restore(sourcePath, result.object, dependencyFilePath, result.signature)) {
+				result.restored = true;
+				result.dependencies = m_projectDependencies->read_dependency_file(dependencyFilePath);
+				trace_compile(sourcePath, "restored", restoreBegin, BuildTrace::Clock::now());
+				done(std::move(result));
+				return;
+			}
+
+			// The previous object may be a hard link into the object cache, so it is removed
+			// rather than overwritten in place.
+			std::filesystem::remove(result.object, errorCode);
+			std::filesystem::remove(dependencyFilePath, errorCode);
+			if (moduleUnit && !moduleUnit->provides.empty())
+				std::filesystem::remove(bmi_path(moduleUnit->provides), errorCode);
+
+			g_processEngine.launch(
+				m_projectStatistics->projectCompilationData.cppCompilerPath,
+				std::move(arguments),
+				[this, result = std::move(result), dependencyFilePath, cacheable = !moduleUnit, done = std::move(done)]
+				(Core::Expected<ProcessResult> process) mutable {
+					// Reading the dependencies and storing the object is file work, which does not
+					// belong on the engine thread.
+					m_jobPool->submit([this, result = std::move(result), dependencyFilePath, cacheable, done = std::move(done), process = std::move(process)]() mutable {
+						try {
+							if (!process) {
+								result.exitCode = static_cast<int32_t>(process.error().code);
+								result.output = process.error().message;
+							}
+							else {
+								result.exitCode = process->exitCode;
+								result.output = process->output();
+								trace_compile(result.source, result.exitCode != 0 ? "failed" : "compiled", process->begin, process->end, BuildTrace::process_lane(process->slot));
+							}
+
+							if (result.exitCode == 0) {
+								result.dependencies = m_projectDependencies->read_dependency_file(dependencyFilePath);
+								if (result.dependencies && cacheable)
+									m_objectCache->store(result.source, result.object, dependencyFilePath, result.signature, *result.dependencies);
+							}
+						}
+						catch (const std::exception& exception) {
+							result.exitCode = static_cast<int32_t>(Core::ErrorCode::GenericBuildError);
+							result.output = exception.what();
+						}
+						done(std::move(result));
+					});
+				},
+				m_projectEnvironment->projectRoot
+			);
+		}
+
+		inline static void trace_compile(
+			const std::filesystem::path& sourcePath,
+			std::string_view result,
+			BuildTrace::Clock::time_point begin,
+			BuildTrace::Clock::time_point end,
+			std::optional<uint32_t> lane = std::nullopt
+		) {
+			g_buildTrace.record(
+				{ sourcePath.filename().string(), "compile", { { "source", sourcePath.string() }, { "result", std::string{ result } } } },
+				begin,
+				end,
+				lane
+			);
+		}
+
+		inline std::vector<std::string> compile_arguments(
+			const std::filesystem::path& sourcePath,
+			const std::filesystem::path& objectPath
+		) const {
+			const auto& compilationData = m_projectStatistics->projectCompilationData;
+			const bool isDynamicLibrary = compilationData.projectType == (*ProjectCompilationData::supportedProjectTypes)[ProjectCompilationData::supportedProjectTypes.DynamicLibrary];
+			// A forced include would land before the global module fragment of a module unit.
+			const ModuleGraph::Unit* moduleUnit = module_unit(sourcePath);
+			const bool usePrecompiledHeader = m_activePrecompiledHeader && !moduleUnit;
+
+			std::vector<std::string> compileString{};
+			switch (compilationData.projectCompilers)
 			{
 				case Core::SupportedCompilers::MSVC:
-				for (const auto& filePath : diffSource) {
-					if (filePath.extension() != ".toml")
-						msvcCompileString.push_back(std::format("{}", filePath.string()));
+				compileString = {
+					std::format("/nologo"),
+					std::format("/c"),
+					std::format("/FS"),
+					std::format("/std:{}", compilationData.cppCompilerVersion),
+					std::format("/Fo:{}", objectPath.string()),
+					std::format("/Fd:{}", m_projectEnvironment->projectBinaryFolderPath.string().append("\\")),
+					std::format("/sourceDependencies"),
+					ProjectDependencies::dependency_file_path(objectPath).string(),
+				};
+				if (isDynamicLibrary) {
+					compileString.push_back(std::format("/D_WINDLL"));
+					compileString.push_back(std::format("/DMY_DLL_EXPORTS"));
+				}
+				for (const auto& flag : m_projectStatistics->msvc_compiler_flags())
+					compileString.push_back(flag);
+				if (moduleUnit) {
+					if (!moduleUnit->provides.empty()) {
+						if (!moduleUnit->isInterface)
+							compileString.push_back(std::format("/internalPartition"));
+						else if (sourcePath.extension() != ".ixx")
+							compileString.push_back(std::format("/interface"));
+						compileString.push_back(std::format("/ifcOutput"));
+						compileString.push_back(bmi_path(moduleUnit->provides).string());
+					}
+					for (const auto& moduleName : m_moduleGraph->imports_closure(*moduleUnit)) {
+						compileString.push_back(std::format("/reference"));
+						compileString.push_back(std::format("{}={}", moduleName, bmi_path(moduleName).string()));
+					}
+				}
+				if (usePrecompiledHeader) {
+					compileString.push_back(std::format("/Yu{}", m_activePrecompiledHeader->header.string()));
+					compileString.push_back(std::format("/FI{}", m_activePrecompiledHeader->header.string()));
+					compileString.push_back(std::format("/Fp:{}", m_activePrecompiledHeader->output.string()));
+				}
+				compileString.push_back(sourcePath.string());
+				break;
+				case Core::SupportedCompilers::Clang:
+				case Core::SupportedCompilers::GCC:
+				compileString = {
+					std::format("-c"),
+					std::format("-std={}", compilationData.cppCompilerVersion),
+					std::format("-MD"),
+					std::format("-MF"),
+					ProjectDependencies::dependency_file_path(objectPath).string(),
+				};
+				if (isDynamicLibrary) {
+					compileString.push_back(std::format("-fPIC"));
+					compileString.push_back(std::format("-DMY_DLL_EXPORTS"));
+				}
+				for (const auto& flag : m_projectStatistics->cpp_compiler_flags())
+					compileString.push_back(flag);
+				if (usePrecompiledHeader && compilationData.projectCompilers == Core::SupportedCompilers::Clang) {
+					compileString.push_back(std::format("-include-pch"));
+					compileString.push_back(m_activePrecompiledHeader->output.string());
+				}
+				else if (usePrecompiledHeader) {
+					compileString.push_back(std::format("-include"));
+					compileString.push_back(m_activePrecompiledHeader->header.string());
+					compileString.push_back(std::format("-Winvalid-pch"));
+				}
+				if (moduleUnit && compilationData.projectCompilers == Core::SupportedCompilers::Clang) {
+					if (!moduleUnit->provides.empty())
+						compileString.push_back(std::format("-fmodule-output={}", bmi_path(moduleUnit->provides).string()));
+					for (const auto& moduleName : m_moduleGraph->imports_closure(*moduleUnit))
+						compileString.push_back(std::format("-fmodule-file={}={}", moduleName, bmi_path(moduleName).string()));
+					if (!moduleUnit->provides.empty() && sourcePath.extension() != ".cppm") {
+						compileString.push_back(std::format("-x"));
+						compileString.push_back(std::format("c++-module"));
+					}
+				}
+				else if (moduleUnit) {
+					compileString.push_back(std::format("-fmodules-ts"));
+					compileString.push_back(std::format("-fmodule-mapper={}", module_mapper_path().string()));
+					if (is_module_interface_file(sourcePath)) {
+						compileString.push_back(std::format("-x"));
+						compileString.push_back(std::format("c++"));
+					}
+				}
+				compileString.push_back(sourcePath.string());
+				compileString.push_back(std::format("-o"));
+				compileString.push_back(objectPath.string());
+				break;
+				default:
+				break;
+			}
 
-					for (const auto& flag : m_projectStatistics->projectCompilationData.msvcCompilerFlags)
-						msvcCompileString.push_back(flag);
+			return compileString;
+		}
+
+		// P1689 scan of one translation unit, written to the given report path.
+		inline std::vector<std::string> scan_arguments(
+			const std::filesystem::path& sourcePath,
+			const std::filesystem::path& reportPath
+		) const {
+			const auto& compilationData = m_projectStatistics->projectCompilationData;
+			const bool isDynamicLibrary = compilationData.projectType == (*ProjectCompilationData::supportedProjectTypes)[ProjectCompilationData::supportedProjectTypes.DynamicLibrary];
+			const auto objectPath = object_path(sourcePath);
+
+			std::vector<std::string> scanString{};
+			switch (compilationData.projectCompilers)
+			{
+				case Core::SupportedCompilers::MSVC:
+				scanString = {
+					std::format("/nologo"),
+					std::format("/TP"),
+					std::format("/std:{}", compilationData.cppCompilerVersion),
+					std::format("/scanDependencies"),
+					reportPath.string(),
+					std::format("/Fo:{}", objectPath.string()),
+				};
+				if (isDynamicLibrary) {
+					scanString.push_back(std::format("/D_WINDLL"));
+					scanString.push_back(std::format("/DMY_DLL_EXPORTS"));
 				}
+				for (const auto& flag : m_projectStatistics->msvc_compiler_flags())
+					scanString.push_back(flag);
+				scanString.push_back(sourcePath.string());
 				break;
 				case Core::SupportedCompilers::Clang:
+				// clang-scan-deps runs the compile command that follows "--".
+				scanString = {
+					std::format("-format=p1689"),
+					std::format("-o"),
+					reportPath.string(),
+					std::format("--"),
+					compilationData.cppCompilerPath,
+					std::format("-c"),
+					std::format("-std={}", compilationData.cppCompilerVersion),
+				};
+				if (isDynamicLibrary) {
+					scanString.push_back(std::format("-fPIC"));
+					scanString.push_back(std::format("-DMY_DLL_EXPORTS"));
+				}
+				for (const auto& flag : m_projectStatistics->cpp_compiler_flags())
+					scanString.push_back(flag);
+				scanString.push_back(sourcePath.string());
+				scanString.push_back(std::format("-o"));
+				scanString.push_back(objectPath.string());
+				break;
 				case Core::SupportedCompilers::GCC:
+				scanString = {
+					std::format("-std={}", compilationData.cppCompilerVersion),
+					std::format("-fmodules-ts"),
+					std::format("-E"),
+					std::format("-fdeps-format=p1689r5"),
+					std::format("-fdeps-file={}", reportPath.string()),
+					std::format("-fdeps-target={}", objectPath.string()),
+				};
+				if (isDynamicLibrary) {
+					scanString.push_back(std::format("-fPIC"));
+					scanString.push_back(std::format("-DMY_DLL_EXPORTS"));
+				}
+				for (const auto& flag : m_projectStatistics->cpp_compiler_flags())
+					scanString.push_back(flag);
+				scanString.push_back(std::format("-x"));
+				scanString.push_back(std::format("c++"));
+				scanString.push_back(sourcePath.string());
+				scanString.push_back(std::format("-o"));
+				scanString.push_back(std::filesystem::path{ reportPath }.replace_extension(".i").string());
+				break;
+				default:
+				break;
+			}
 
+			return scanString;
+		}
+
+		// Rescans the translation units whose source or scan command changed since their
+		// last scan. Projects without .cppm or .ixx files are only scanned when
+		// `ProjectModules` is set.
+		inline void scan_modules(const std::vector<SourceFile>& sourceFiles)
+		{
+			std::vector<const SourceFile*> translationUnits{};
+			for (const auto& sourceFile : sourceFiles)
+				if (is_translation_unit(sourceFile.path))
+					translationUnits.push_back(&sourceFile);
+
+			m_modulesEnabled = m_projectStatistics->projectModules || std::ranges::any_of(translationUnits, [](const SourceFile* sourceFile) {
+				return is_module_interface_file(sourceFile->path);
+			});
+			if (!m_modulesEnabled)
+				return;
+			auto span = g_buildTrace.span("scan modules", "build");
+
+			std::vector<std::filesystem::path> translationUnitPaths{};
+			for (const SourceFile* sourceFile : translationUnits)
+				translationUnitPaths.push_back(sourceFile->path);
+			m_moduleGraph->retain(translationUnitPaths);
+
+			const auto& compilationData = m_projectStatistics->projectCompilationData;
+			std::filesystem::path scanner{ compilationData.cppCompilerPath };
+			if (compilationData.projectCompilers == Core::SupportedCompilers::Clang) {
+				scanner = scanner.parent_path() / std::filesystem::path{ "clang-scan-deps" }.replace_extension(scanner.extension());
+				if (!std::filesystem::exists(scanner))
+					scanner = Util::BoostProcess::search_path("clang-scan-deps").string();
+			}
+
+			const std::filesystem::path scanFolder = m_projectEnvironment->projectModulePath / "scan";
+			std::error_code errorCode{};
+			std::filesystem::create_directories(scanFolder, errorCode);
+
+			const std::string& compilerIdentity = compiler_identity();
+			std::vector<std::future<Core::Expected<ModuleGraph::Unit>>> jobs{};
+			for (const SourceFile* sourceFile : translationUnits) {
+				const auto objectName = object_path(sourceFile->path).lexically_relative(m_projectEnvironment->projectBinaryFolderPath);
+				const auto reportPath = std::filesystem::path{ scanFolder / objectName }.replace_extension(".ddi");
+				std::filesystem::create_directories(reportPath.parent_path(), errorCode);
+				auto arguments = scan_arguments(sourceFile->path, reportPath);
+				arguments.push_back(sourceFile->hash.to_string());
+				const auto key = command_signature(compilerIdentity, arguments);
+				arguments.pop_back();
+
+				if (const ModuleGraph::Unit* unit = m_moduleGraph->find(sourceFile->path); unit && unit->key == key)
+					continue;
+
+				jobs.push_back(m_jobPool->submit([&scanner, &projectRoot = m_projectEnvironment->projectRoot, source = sourceFile->path, reportPath, arguments = std::move(arguments), key]()
+					-> Core::Expected<ModuleGraph::Unit> {
+					std::error_code errorCode{};
+					std::filesystem::remove(reportPath, errorCode);
+
+					int32_t exitCode{};
+					const auto res = Util::run_command(scanner, arguments, exitCode, projectRoot);
+					std::filesystem::remove(std::filesystem::path{ reportPath }.replace_extension(".i"), errorCode);
+					if (!res || exitCode != 0)
+						return std::unexpected(
+							Core::make_error(
+								Core::ErrorCode::RunningCommandError,
+								std::format("Module scan of {} failed: {}", source.string(), res ? res.value() : res.error().message)
+							)
+						);
+
+					auto report = Util::read_all(reportPath);
+					if (!report) return std::unexpected(report.error());
+
+					auto unit = ModuleGraph::parse_p1689(report.value());
+					if (!unit) return unit;
+					unit->source = source;
+					unit->key = key;
+					return unit;
+				}));
+			}
+
+			if (!jobs.empty())
+				std::println("SCANNING {} translation unit(s) for modules", jobs.size());
+			for (auto& job : jobs) {
+				auto unit = job.get();
+				if (!unit) {
+					std::println("WARNING: {}({})", unit.error().message, static_cast<int32_t>(unit.error().code));
+					continue;
+				}
+				m_moduleGraph->update(std::move(*unit));
+			}
+
+			write_module_mapper();
+		}
+
+		// Everything a build needs to know about the source table before deciding what is
+		// stale: the precompiled header, the module graph and the unity batches.
+		inline void prepare_sources(
+			const std::vector<SourceFile>& sourceFiles,
+			const std::vector<std::filesystem::path>& editedSources = {}
+		) {
+			m_luaScriptStarter.set_source_files(&sourceFiles);
+			prepare_precompiled_header(sourceFiles);
+			scan_modules(sourceFiles);
+			plan_unity_build(sourceFiles, editedSources);
+		}
+
+		// Plans the unity batches and retires the objects they replace. With
+		// `ProjectUnityIsolateEdited`, edited members of a batch that was already built are
+		// moved out of it first.
+		inline void plan_unity_build(
+			const std::vector<SourceFile>& sourceFiles,
+			const std::vector<std::filesystem::path>& editedSources
+		) {
+			m_rewrittenUnitySources.clear();
+			if (!m_unityBuild.enabled()) {
+				std::vector<std::filesystem::path> unitySources{};
+				for (const auto& source : m_objectManifest->sources())
+					if (m_unityBuild.is_unity_source(source))
+						unitySources.push_back(source);
+				remove_objects(unitySources);
+				return;
+			}
+			auto span = g_buildTrace.span("plan unity batches", "build");
+			if (!m_unityIsolationLoaded) {
+				m_unityBuild.load_isolated();
+				m_unityIsolationLoaded = true;
+			}
+
+			std::vector<const SourceFile*> candidates{};
+			for (const auto& sourceFile : sourceFiles)
+				if (is_translation_unit(sourceFile.path) && !is_module_interface_file(sourceFile.path) && !module_unit(sourceFile.path))
+					candidates.push_back(&sourceFile);
+
+			auto res = m_unityBuild.plan(candidates);
+			if (res && m_projectStatistics->projectUnityIsolateEdited) {
+				std::vector<std::filesystem::path> builtMembers{};
+				for (const auto& source : editedSources) {
+					const std::filesystem::path& compileUnit = m_unityBuild.compile_unit(source);
+					if (compileUnit != source && m_objectManifest->find(compileUnit))
+						builtMembers.push_back(source);
+				}
+				if (m_unityBuild.isolate(builtMembers)) {
+					auto resIsolated = m_unityBuild.plan(candidates);
+					if (resIsolated)
+						res->insert(res->end(), resIsolated->begin(), resIsolated->end());
+					else
+						res = std::move(resIsolated);
+				}
+			}
+			if (!res) {
+				std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+				std::println("WARNING: Unity build is skipped for this build.");
+				(void)m_unityBuild.plan({});
+				return;
+			}
+
+			for (const auto& source : *res)
+				m_rewrittenUnitySources.insert(ProjectDependencies::key(source));
+
+			// Batch members no longer link their own object, and batches that are gone no
+			// longer link theirs.
+			std::unordered_set<std::string> plannedSources{};
+			for (const auto& batch : m_unityBuild.batches())
+				plannedSources.insert(ProjectDependencies::key(batch.source));
+
+			std::vector<std::filesystem::path> replacedSources{};
+			for (const auto& source : m_objectManifest->sources()) {
+				if (m_unityBuild.is_unity_source(source) ? !plannedSources.contains(ProjectDependencies::key(source))
+					: m_unityBuild.compile_unit(source) != source)
+					replacedSources.push_back(source);
+			}
+			remove_objects(replacedSources);
+		}
+
+		inline void set_time_trace(bool timeTrace) noexcept { m_timeTrace = timeTrace; }
+
+		inline bool uses_time_trace() const noexcept {
+			return m_timeTrace && m_projectStatistics->projectCompilationData.projectCompilers == Core::SupportedCompilers::Clang;
+		}
+
+		// Clang names the trace after the object it writes.
+		inline static std::filesystem::path time_trace_path(const std::filesystem::path& objectPath) {
+			return std::filesystem::path{ objectPath }.replace_extension(".json");
+		}
+
+		// Merges the traces of every object the manifest links. Objects built without
+		// tracing have none and are counted as missing.
+		inline TimeTraceReport time_trace_report(size_t& missingTraces) const
+		{
+			TimeTraceReport report{};
+			missingTraces = 0;
+			for (const auto& source : m_objectManifest->sources()) {
+				const ObjectManifest::Entry* entry = m_objectManifest->find(source);
+				const auto traceFile = time_trace_path(entry->object);
+				if (!std::filesystem::exists(traceFile)) {
+					++missingTraces;
+					continue;
+				}
+				if (const auto res = report.add(traceFile, source.lexically_relative(m_projectEnvironment->projectRoot).string()); !res) {
+					std::println("WARNING: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+					++missingTraces;
+				}
+			}
+			return report;
+		}
+
+		// A full build puts every isolated file back into its batch.
+		inline void reset_unity_isolation()
+		{
+			m_unityBuild.load_isolated();
+			m_unityIsolationLoaded = true;
+			m_unityBuild.reset_isolation();
+		}
+
+		inline const std::filesystem::path& compile_unit(const std::filesystem::path& sourcePath) const {
+			return m_unityBuild.enabled() ? m_unityBuild.compile_unit(sourcePath) : sourcePath;
+		}
+
+		// Same flags as a translation unit, so the compiler accepts the result for every
+		// one of them.
+		inline std::vector<std::string> precompiled_header_arguments(const PrecompiledHeaderArtifact& artifact) const
+		{
+			const auto& compilationData = m_projectStatistics->projectCompilationData;
+			const bool isDynamicLibrary = compilationData.projectType == (*ProjectCompilationData::supportedProjectTypes)[ProjectCompilationData::supportedProjectTypes.DynamicLibrary];
+
+			std::vector<std::string> compileString{};
+			switch (compilationData.projectCompilers)
+			{
+				case Core::SupportedCompilers::MSVC:
+				compileString = {
+					std::format("/nologo"),
+					std::format("/c"),
+					std::format("/FS"),
+					std::format("/std:{}", compilationData.cppCompilerVersion),
+					std::format("/Yc{}", artifact.header.string()),
+					std::format("/Fp:{}", artifact.output.string()),
+					std::format("/Fo:{}", artifact.object.string()),
+					std::format("/Fd:{}", m_projectEnvironment->projectBinaryFolderPath.string().append("\\")),
+					std::format("/sourceDependencies"),
+					artifact.dependencyFile.string(),
+				};
+				if (isDynamicLibrary) {
+					compileString.push_back(std::format("/D_WINDLL"));
+					compileString.push_back(std::format("/DMY_DLL_EXPORTS"));
+				}
+				for (const auto& flag : m_projectStatistics->msvc_compiler_flags())
+					compileString.push_back(flag);
+				compileString.push_back(artifact.source.string());
+				break;
+				case Core::SupportedCompilers::Clang:
+				case Core::SupportedCompilers::GCC:
+				compileString = {
+					std::format("-x"),
+					std::format("c++-header"),
+					std::format("-std={}", compilationData.cppCompilerVersion),
+					std::format("-MD"),
+					std::format("-MF"),
+					artifact.dependencyFile.string(),
+				};
+				if (isDynamicLibrary) {
+					compileString.push_back(std::format("-fPIC"));
+					compileString.push_back(std::format("-DMY_DLL_EXPORTS"));
+				}
+				for (const auto& flag : m_projectStatistics->cpp_compiler_flags())
+					compileString.push_back(flag);
+				compileString.push_back(artifact.header.string());
+				compileString.push_back(std::format("-o"));
+				compileString.push_back(artifact.output.string());
 				break;
 				default:
 				break;
 			}
 
-			if (m_projectStatistics->projectCompilationData.projectType == (*ProjectCompilationData::supportedProjectTypes)[ProjectCompilationData::supportedProjectTypes.DynamicLibrary]) {
-				switch (m_projectStatistics->projectCompilationData.projectCompilers)
-				{
-					case Core::SupportedCompilers::MSVC:
-					for (const auto& filePath : diffSource) {
-						msvcCompileString.push_back(std::format("/D_WINDLL"));
-						msvcCompileString.push_back(std::format("/DMY_DLL_EXPORTS"));
+			return compileString;
+		}
+
+		// Builds the precompiled header for the current compile flags unless the one from
+		// an earlier build is still valid. Translation units are compiled without it when
+		// it cannot be built.
+		inline void prepare_precompiled_header(const std::vector<SourceFile>& sourceFiles)
+		{
+			m_activePrecompiledHeader.reset();
+			if (!m_precompiledHeader.enabled())
+				return;
+			auto span = g_buildTrace.span("precompiled header", "build");
+
+			std::vector<SourceFile> translationUnits{};
+			for (const auto& sourceFile : sourceFiles)
+				if (is_translation_unit(sourceFile.path))
+					translationUnits.push_back(sourceFile);
+			if (translationUnits.empty())
+				return;
+
+			// One directory per compile signature, so switching flags back and forth reuses
+			// the header built for each of them.
+			const std::string signatureIdentity = std::format("{}\n{}", compiler_identity(), m_projectStatistics->projectPrecompiledHeader);
+			PrecompiledHeaderArtifact artifact = m_precompiledHeader.artifact(
+				command_signature(signatureIdentity, precompiled_header_arguments({}))
+			);
+
+			const auto resHeader = m_precompiledHeader.write_header(artifact, translationUnits);
+			if (!resHeader) {
+				std::println("WARNING: {}({})", resHeader.error().message, static_cast<int32_t>(resHeader.error().code));
+				return;
+			}
+			if (!*resHeader)
+				return;
+
+			if (const auto fingerprint = PrecompiledHeader::current_fingerprint(artifact)) {
+				artifact.fingerprint = *fingerprint;
+				m_activePrecompiledHeader = std::move(artifact);
+				return;
+			}
+
+			std::println("PRECOMPILING {}", artifact.header.string());
+			std::error_code errorCode{};
+			std::filesystem::remove(artifact.output, errorCode);
+
+			int32_t exitCode{};
+			const auto res = Util::run_command(
+				m_projectStatistics->projectCompilationData.cppCompilerPath,
+				precompiled_header_arguments(artifact),
+				exitCode,
+				m_projectEnvironment->projectRoot
+			);
+			if (!res || exitCode != 0) {
+				std::println("WARNING: Precompiled header failed to build, compiling without it.");
+				std::println("INFO: \n|=>\n{}\n<=|", res ? res.value() : res.error().message);
+				return;
+			}
+
+			const auto dependencies = m_projectDependencies->read_dependency_file(artifact.dependencyFile);
+			if (!dependencies) {
+				std::println("WARNING: {}({})", dependencies.error().message, static_cast<int32_t>(dependencies.error().code));
+				return;
+			}
+
+			const auto fingerprint = PrecompiledHeader::record_inputs(artifact, *dependencies);
+			if (!fingerprint) {
+				std::println("WARNING: {}({})", fingerprint.error().message, static_cast<int32_t>(fingerprint.error().code));
+				return;
+			}
+
+			artifact.fingerprint = *fingerprint;
+			m_activePrecompiledHeader = std::move(artifact);
+		}
+
+		// Translation units whose object is missing or whose compile command changed since
+		// the object was produced, e.g. after a flag, define or compiler update.
+		inline std::vector<std::filesystem::path> stale_translation_units(const std::vector<SourceFile>& sourceFiles)
+		{
+			const std::string compilerIdentity = build_identity();
+
+			std::vector<std::filesystem::path> staleSource{};
+			std::unordered_set<std::string> checkedUnits{};
+			for (const auto& sourceFile : sourceFiles) {
+				if (!is_translation_unit(sourceFile.path))
+					continue;
+				const std::filesystem::path& compileUnit = compile_unit(sourceFile.path);
+				if (!checkedUnits.insert(ProjectDependencies::key(compileUnit)).second)
+					continue;
+
+				const auto objectPath = object_path(compileUnit);
+				const auto signature = command_signature(compilerIdentity, compile_arguments(compileUnit, objectPath));
+				const ModuleGraph::Unit* moduleUnit = module_unit(compileUnit);
+				if (m_objectManifest->is_stale(compileUnit, objectPath, signature) ||
+					m_rewrittenUnitySources.contains(ProjectDependencies::key(compileUnit)) ||
+					(moduleUnit && !moduleUnit->provides.empty() && !std::filesystem::exists(bmi_path(moduleUnit->provides))))
+					staleSource.push_back(compileUnit);
+			}
+
+			return staleSource;
+		}
+
+		inline static ContentHash::Digest command_signature(
+			std::string_view compilerIdentity,
+			const std::vector<std::string>& arguments
+		) {
+			std::string command{ compilerIdentity };
+			for (const auto& argument : arguments)
+				command.append(1, '\0').append(argument);
+			return ContentHash::hash(command);
+		}
+
+		// Compiler path, binary stamp and, where the compiler reports one, its version
+		// banner. MSVC keeps the toolset version in the path of cl.exe.
+		inline const std::string& compiler_identity()
+		{
+			const auto& compilationData = m_projectStatistics->projectCompilationData;
+			if (!m_compilerIdentity.empty() && m_compilerIdentityPath == compilationData.cppCompilerPath)
+				return m_compilerIdentity;
+
+			m_compilerIdentityPath = compilationData.cppCompilerPath;
+			m_compilerIdentity = compilationData.cppCompilerPath;
+			if (const auto stamp = Util::stat(compilationData.cppCompilerPath); stamp)
+				m_compilerIdentity.append(std::format("\n{}:{}", stamp->modificationTime, stamp->size));
+
+			if (compilationData.projectCompilers != Core::SupportedCompilers::MSVC) {
+				int32_t exitCode{};
+				if (const auto res = Util::run_command(compilationData.cppCompilerPath, { "--version" }, exitCode); res && exitCode == 0)
+					m_compilerIdentity.append("\n").append(res.value());
+			}
+
+			return m_compilerIdentity;
+		}
+
+		// The precompiled header's content fingerprint is part of every compile signature,
+		// so objects are rebuilt, and looked up in the object cache, against the header
+		// they were actually compiled with.
+		inline std::string build_identity()
+		{
+			std::string identity{ compiler_identity() };
+			if (m_activePrecompiledHeader)
+				identity.append("\npch:").append(m_activePrecompiledHeader->fingerprint.to_string());
+			return identity;
+		}
+
+		// Objects mirror the source tree below bin/obj and keep the source extension, so
+		// src/a_b.cpp and src/a/b.cpp, or foo.cppm and foo.cpp, never share an output. A
+		// source outside the project root goes to obj/external, its name followed by a hash
+		// of its full path.
+		inline std::filesystem::path object_path(const std::filesystem::path& sourcePath) const
+		{
+			std::filesystem::path objectName = sourcePath.lexically_relative(m_projectEnvironment->projectRoot);
+			if (objectName.empty() || *objectName.begin() == "..") {
+				const std::string pathHash = ContentHash::hash(sourcePath.lexically_normal().generic_string()).to_string().substr(0, 8);
+				objectName = std::filesystem::path{ g_projectExternalObjectFolderName } / std::format("{}.{}", sourcePath.filename().string(), pathHash);
+			}
+			objectName += object_extension();
+
+			return m_projectEnvironment->projectBinaryFolderPath / g_projectObjectFolderName / objectName;
+		}
+
+		inline const ModuleGraph::Unit* module_unit(const std::filesystem::path& sourcePath) const
+		{
+			if (!m_modulesEnabled)
+				return nullptr;
+			const ModuleGraph::Unit* unit = m_moduleGraph->find(sourcePath);
+			return unit && m_moduleGraph->uses_modules(*unit) ? unit : nullptr;
+		}
+
+		// BMIs stay in .shafaCache/modules between builds, so an interface is only compiled
+		// again when it is stale itself.
+		inline std::filesystem::path bmi_path(std::string_view moduleName) const
+		{
+			std::string fileName{ moduleName };
+			std::ranges::replace(fileName, ':', '-');
+			switch (m_projectStatistics->projectCompilationData.projectCompilers)
+			{
+				case Core::SupportedCompilers::MSVC: fileName.append(".ifc"); break;
+				case Core::SupportedCompilers::Clang: fileName.append(".pcm"); break;
+				default: fileName.append(".gcm"); break;
+			}
+			return m_projectEnvironment->projectModulePath / fileName;
+		}
+
+		inline std::filesystem::path module_mapper_path() const {
+			return m_projectEnvironment->projectModulePath / "module.map";
+		}
+
+		// GCC finds BMIs through a module mapper file, one "name path" line per module.
+		inline void write_module_mapper() const
+		{
+			if (m_projectStatistics->projectCompilationData.projectCompilers != Core::SupportedCompilers::GCC)
+				return;
+
+			std::string content{};
+			for (const auto& moduleName : m_moduleGraph->module_names())
+				content.append(std::format("{} {}\n", moduleName, bmi_path(moduleName).string()));
+
+			if (auto res = Util::read_all(module_mapper_path()); res && res.value() == content)
+				return;
+			if (const auto res = Util::write_atomic(module_mapper_path(), content); !res)
+				std::println("WARNING: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+		}
+
+		// Adds the units importing a module that is about to be rebuilt, and the providers
+		// of imported modules whose BMI is missing, until nothing changes.
+		inline void add_module_dependents(std::vector<std::filesystem::path>& translationUnits) const
+		{
+			std::unordered_set<std::string> scheduledSource{};
+			for (const auto& path : translationUnits)
+				scheduledSource.insert(ProjectDependencies::key(path));
+
+			for (bool added = true; added;) {
+				added = false;
+
+				std::vector<std::string> rebuiltModules{};
+				for (const auto& path : translationUnits)
+					if (const ModuleGraph::Unit* unit = module_unit(path); unit && !unit->provides.empty())
+						rebuiltModules.push_back(unit->provides);
+				for (auto& path : m_moduleGraph->importers_of(std::move(rebuiltModules)))
+					if (scheduledSource.insert(ProjectDependencies::key(path)).second) {
+						translationUnits.push_back(std::move(path));
+						added = true;
 					}
 
-					for (const auto& flag : m_projectStatistics->projectCompilationData.msvcCompilerFlags)
-						msvcCompileString.push_back(flag);
-					break;
-					case Core::SupportedCompilers::Clang:
-					case Core::SupportedCompilers::GCC:
+				for (size_t index = 0; index < translationUnits.size(); ++index) {
+					const ModuleGraph::Unit* unit = module_unit(translationUnits[index]);
+					if (!unit)
+						continue;
+					for (const auto& moduleName : m_moduleGraph->imports_closure(*unit)) {
+						const ModuleGraph::Unit* provider = m_moduleGraph->provider_of(moduleName);
+						if (provider && !std::filesystem::exists(bmi_path(moduleName)) &&
+							scheduledSource.insert(ProjectDependencies::key(provider->source)).second) {
+							translationUnits.push_back(provider->source);
+							added = true;
+						}
+					}
+				}
+			}
+		}
 
-					break;
-					default:
-					break;
+		inline void module_edges(
+			const std::vector<std::filesystem::path>& translationUnits,
+			std::vector<std::vector<size_t>>& dependents,
+			std::vector<size_t>& pendingImports
+		) const {
+			std::unordered_map<std::string, size_t> providers{};
+			for (size_t index = 0; index < translationUnits.size(); ++index)
+				if (const ModuleGraph::Unit* unit = module_unit(translationUnits[index]); unit && !unit->provides.empty())
+					providers.insert_or_assign(unit->provides, index);
+
+			for (size_t index = 0; index < translationUnits.size(); ++index) {
+				const ModuleGraph::Unit* unit = module_unit(translationUnits[index]);
+				if (!unit)
+					continue;
+				for (const auto& moduleName : unit->imports) {
+					const auto provider = providers.find(moduleName);
+					if (provider == providers.end() || provider->second == index)
+						continue;
+					dependents[provider->second].push_back(index);
+					++pendingImports[index];
 				}
 			}
+		}
 
-			std::println("COMPILING");
-			for (const auto& str : msvcCompileString)
+		inline static bool is_module_interface_file(const std::filesystem::path& filePath)
+		{
+			const std::string extension = filePath.extension().string();
+			return std::ranges::find(g_moduleInterfaceExtensions, extension) != g_moduleInterfaceExtensions.end();
+		}
+
+		inline static std::string_view object_extension() noexcept {
+#ifdef _WIN32
+			return ".obj";
+#else
+			return ".o";
+#endif // _WIN32
+		}
+
+		inline static bool is_translation_unit(const std::filesystem::path& filePath)
+		{
+			const std::string extension = filePath.extension().string();
+			return std::ranges::find(g_translationUnitExtensions, extension) != g_translationUnitExtensions.end();
+		}
+
+		// Links exactly the objects recorded in the object manifest. Nothing runs when the
+		// output exists and neither the command nor any input object changed since the
+		// last successful link.
+		inline Core::ExpectedVoid linking()
+		{
+			auto span = g_buildTrace.span("link", "link");
+			const LinkCommand linkCommand = link_command();
+			const ContentHash::Digest linkSignature = link_signature(linkCommand);
+			if (is_link_current(linkCommand, linkSignature)) {
+				std::println("INFO: Link inputs unchanged, skipping linking.");
+				return {};
+			}
+
+			// ar only adds and replaces members, stale ones would survive in an existing archive.
+			std::error_code errorCode{};
+			if (m_projectStatistics->projectCompilationData.projectCompilers != Core::SupportedCompilers::MSVC)
+				std::filesystem::remove(linkCommand.output, errorCode);
+
+			std::println("\nLINKING");
+			for (const auto& str : linkCommand.arguments)
 				std::print(" {} ", str);
 
 			std::println();
 
 			int32_t exitCode{};
 			auto res = Util::run_command(
-				m_projectStatistics->projectCompilationData.cppCompilerPath,
-				msvcCompileString,
-				exitCode
+				linkCommand.process,
+				linkCommand.arguments,
+				exitCode,
+				m_projectEnvironment->projectRoot
 			);
-			if (!res)
+			if (!res) {
 				std::println(std::cerr, "ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+				return std::unexpected(res.error());
+			}
 
 			std::println("INFO: \n|=>\n{}\n<=|", res.value());
 
@@ -112,40 +1097,43 @@ namespace NeoShafa {
 				return std::unexpected(
 					Core::make_error(
 						Core::ErrorCode::RunningCommandError,
-						std::format("Compiler exited with code: {}.", exitCode)
+						std::format("Linker exited with code: {}.", exitCode)
 					)
 				);
 
+			m_objectManifest->set_link_signature(link_signature(linkCommand));
 			return {};
 		}
 
-		inline Core::ExpectedVoid linking()
+		inline bool is_link_current() const
 		{
-			std::vector<std::filesystem::path> objectFiles{};
+			const LinkCommand linkCommand = link_command();
+			return is_link_current(linkCommand, link_signature(linkCommand));
+		}
 
-			for (const auto& entry : std::filesystem::directory_iterator(m_projectEnvironment->projectBinaryFolderPath)) {
-				if (entry.is_regular_file()) {
-					std::string fileExtension = entry.path().extension().string();
-#ifdef _WIN32
-					if (fileExtension == ".obj") {
-#elif 	
-					if (fileExtension == ".o") {
-#endif // _WIN32
-						objectFiles.push_back(entry.path());
-					}
-				}
-			}
+		inline LinkCommand link_command() const
+		{
+			std::vector<std::filesystem::path> objectFiles = m_objectManifest->objects();
+			// MSVC keeps the precompiled header's debug information in the object built by /Yc.
+			if (m_activePrecompiledHeader && !m_activePrecompiledHeader->object.empty())
+				objectFiles.push_back(m_activePrecompiledHeader->object);
 
 			std::vector<std::string> msvcCompileString{
 				std::format("/nologo"), 
 			};
-			std::string otherCompileString{};
+			std::vector<std::string> otherCompileString{};
 
 			std::filesystem::path process{};
 
 			for (const auto& path : objectFiles)
 				msvcCompileString.push_back(path.string());
 
+			// An archive only collects this project's objects, its dependencies are linked by
+			// whatever links it.
+			const bool isStaticLibrary = m_projectStatistics->projectCompilationData.projectType == (*ProjectCompilationData::supportedProjectTypes)[ProjectCompilationData::supportedProjectTypes.StaticLibrary];
+			const std::vector<std::filesystem::path> libraries = isStaticLibrary ? std::vector<std::filesystem::path>{} : m_linkLibraries;
+			for (const auto& path : libraries)
+				msvcCompileString.push_back(path.string());
 
 			if (m_projectStatistics->projectCompilationData.projectType == (*ProjectCompilationData::supportedProjectTypes)[ProjectCompilationData::supportedProjectTypes.Executable]) {
 
@@ -157,7 +1145,15 @@ namespace NeoShafa {
 					break;
 					case Core::SupportedCompilers::Clang:
 					case Core::SupportedCompilers::GCC:
-
+					for (const auto& path : objectFiles)
+						otherCompileString.push_back(path.string());
+					for (const auto& path : libraries)
+						otherCompileString.push_back(path.string());
+					otherCompileString.push_back(std::format("-o"));
+					otherCompileString.push_back((m_projectEnvironment->projectBinaryFolderPath / m_projectStatistics->projectName).string());
+					for (const auto& flag : m_projectStatistics->linker_flags())
+						otherCompileString.push_back(flag);
+					process = m_projectStatistics->projectCompilationData.cppCompilerPath;
 					break;
 					default:
 					break;
@@ -174,7 +1170,13 @@ namespace NeoShafa {
 					break;
 					case Core::SupportedCompilers::Clang:
 					case Core::SupportedCompilers::GCC:
-
+					otherCompileString.push_back(std::format("rcs"));
+					for (const auto& flag : m_projectStatistics->projectCompilationData.projectLibFlags)
+						otherCompileString.push_back(flag);
+					otherCompileString.push_back(std::format("{}.a", (m_projectEnvironment->projectBinaryFolderPath / std::format("lib{}", m_projectStatistics->projectName)).string()));
+					for (const auto& path : objectFiles)
+						otherCompileString.push_back(path.string());
+					process = m_projectStatistics->projectCompilationData.projectLibPath;
 					break;
 					default:
 					break;
@@ -186,83 +1188,209 @@ namespace NeoShafa {
 					case Core::SupportedCompilers::MSVC:
 					msvcCompileString.push_back(std::format("/DLL"));
 					msvcCompileString.push_back(std::format("/OUT:{}.dll", (m_projectEnvironment->projectBinaryFolderPath / m_projectStatistics->projectName).string()));
-					for (const auto& flag : m_projectStatistics->projectCompilationData.projectLinkerFlags)
+					for (const auto& flag : m_projectStatistics->linker_flags())
 						msvcCompileString.push_back(flag);
 					process = m_projectStatistics->projectCompilationData.projectLinkerPath;
 					break;
 					case Core::SupportedCompilers::Clang:
 					case Core::SupportedCompilers::GCC:
-
+					otherCompileString.push_back(std::format("-shared"));
+					for (const auto& path : objectFiles)
+						otherCompileString.push_back(path.string());
+					for (const auto& path : libraries)
+						otherCompileString.push_back(path.string());
+					otherCompileString.push_back(std::format("-o"));
+					otherCompileString.push_back(std::format("{}.so", (m_projectEnvironment->projectBinaryFolderPath / std::format("lib{}", m_projectStatistics->projectName)).string()));
+					for (const auto& flag : m_projectStatistics->linker_flags())
+						otherCompileString.push_back(flag);
+					process = m_projectStatistics->projectCompilationData.cppCompilerPath;
 					break;
 					default:
 					break;
 				}
 			}
 
-			std::println("\nLINKING");
-			for (const auto& str : msvcCompileString)
-				std::print(" {} ", str);
-
-			std::println();
+			const bool isMsvc = m_projectStatistics->projectCompilationData.projectCompilers == Core::SupportedCompilers::MSVC;
+			return { process, isMsvc ? msvcCompileString : otherCompileString, objectFiles, libraries, link_output_path() };
+		}
 
-			int32_t exitCode{};
-			auto res = Util::run_command(
-				process,
-				msvcCompileString,
-				exitCode
-			);
-			if (!res)
-				std::println(std::cerr, "ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+		inline std::filesystem::path link_output_path() const
+		{
+			const auto& compilationData = m_projectStatistics->projectCompilationData;
+			const bool isMsvc = compilationData.projectCompilers == Core::SupportedCompilers::MSVC;
+			const auto& binaryFolder = m_projectEnvironment->projectBinaryFolderPath;
+			const auto& projectName = m_projectStatistics->projectName;
 
-			std::println("INFO: \n|=>\n{}\n<=|", res.value());
+			if (compilationData.projectType == (*ProjectCompilationData::supportedProjectTypes)[ProjectCompilationData::supportedProjectTypes.StaticLibrary])
+				return isMsvc ? binaryFolder / std::format("{}.lib", projectName) : binaryFolder / std::format("lib{}.a", projectName);
+			if (compilationData.projectType == (*ProjectCompilationData::supportedProjectTypes)[ProjectCompilationData::supportedProjectTypes.DynamicLibrary])
+				return isMsvc ? binaryFolder / std::format("{}.dll", projectName) : binaryFolder / std::format("lib{}.so", projectName);
+			return isMsvc ? binaryFolder / std::format("{}.exe", projectName) : binaryFolder / projectName;
+		}
 
-			if (exitCode != 0)
-				return std::unexpected(
-					Core::make_error(
-						Core::ErrorCode::RunningCommandError,
-						std::format("Compiler exited with code: {}.", exitCode)
-					)
-				);
+		// The link command and the stamp of every input, so a recompiled or restored
+		// object changes it even when the command line stays the same. Libraries of
+		// dependencies count by content, a dependency that relinked to the same bytes does
+		// not relink its dependents.
+		inline static ContentHash::Digest link_signature(const LinkCommand& linkCommand)
+		{
+			std::string signature{ linkCommand.process.string() };
+			for (const auto& argument : linkCommand.arguments)
+				signature.append(1, '\0').append(argument);
+			for (const auto& input : linkCommand.inputs)
+				if (const auto stamp = Util::stat(input); stamp)
+					signature.append(std::format("\n{}:{}:{}", stamp->modificationTime, stamp->size, stamp->inode));
+			for (const auto& library : linkCommand.libraries)
+				if (const auto digest = Util::hash(library); digest)
+					signature.append(1, '\n').append(digest->to_string());
+			return ContentHash::hash(signature);
+		}
 
-			return {};
+		// What a dependent links against, the import library for an MSVC DLL.
+		inline std::filesystem::path link_library() const
+		{
+			std::filesystem::path library = link_output_path();
+			if (m_projectStatistics->projectCompilationData.projectCompilers == Core::SupportedCompilers::MSVC && library.extension() == ".dll")
+				library.replace_extension(".lib");
+			return library;
 		}
 
-		inline void prebuild() {
-			auto res = ProjectLuaScriptStarter::run(
-				m_projectStatistics->projectPrebuild
-			);
-			if (!res)
-			{
-				std::println(
-					std::cerr,
-					"ERROR: Lua error code: {}({})",
-					res.error().message,
-					static_cast<int32_t>(res.error().code)
-				);
+		inline void set_link_libraries(std::vector<std::filesystem::path> linkLibraries) { m_linkLibraries = std::move(linkLibraries); }
+		inline const std::vector<std::filesystem::path>& link_libraries() const noexcept { return m_linkLibraries; }
 
-				return;
+		inline bool is_link_current(const LinkCommand& linkCommand, const ContentHash::Digest& linkSignature) const
+		{
+			const auto& recordedSignature = m_objectManifest->link_signature();
+			return recordedSignature && *recordedSignature == linkSignature && std::filesystem::exists(linkCommand.output);
+		}
+
+		// Drops deleted translation units from the manifest together with their outputs,
+		// so they can no longer reach the linker.
+		inline void remove_objects(const std::vector<std::filesystem::path>& removedSource)
+		{
+			std::error_code errorCode{};
+			for (const auto& sourcePath : removedSource) {
+				if (const ObjectManifest::Entry* entry = m_objectManifest->find(sourcePath); entry) {
+					std::filesystem::remove(entry->object, errorCode);
+					std::filesystem::remove(ProjectDependencies::dependency_file_path(entry->object), errorCode);
+					std::filesystem::remove(time_trace_path(entry->object), errorCode);
+				}
+				m_objectManifest->remove(sourcePath);
 			}
 		}
-		
-		inline void postbuild() {
-			auto res = ProjectLuaScriptStarter::run(
-				m_projectStatistics->projectPostbuild.c_str()
-			);
+
+		// Drops the objects of units the scanned sources no longer compile to, e.g. a source
+		// deleted before --configure reset the source cache, so the link only sees objects
+		// this project owns.
+		inline void prune_objects(const std::vector<SourceFile>& sourceFiles)
+		{
+			std::unordered_set<std::string> ownedUnits{};
+			for (const auto& sourceFile : sourceFiles)
+				if (is_translation_unit(sourceFile.path))
+					ownedUnits.insert(ProjectDependencies::key(compile_unit(sourceFile.path)));
+
+			std::vector<std::filesystem::path> orphanedSource{};
+			for (const auto& source : m_objectManifest->sources())
+				if (!ownedUnits.contains(ProjectDependencies::key(source)))
+					orphanedSource.push_back(source);
+			remove_objects(orphanedSource);
+		}
+
+		// Starts the build's Lua VM and, when the prebuild script declares its files, runs it
+		// unless they are unchanged. Returns the declared outputs when it ran, so the caller
+		// can merge generated sources into the source table without scanning the tree again.
+		// A script without declared files runs in full_build, only when something compiles.
+		inline std::vector<std::filesystem::path> prebuild(const std::vector<SourceFile>& sourceFiles)
+		{
+			m_luaScriptStarter.close();
+			m_luaScriptStarter.set_source_files(&sourceFiles);
+			if (m_projectStatistics->projectPrebuild.empty() || !prebuild_step().is_declared())
+				return {};
+
+			auto span = g_buildTrace.span("prebuild", "lua");
+			return run_script_step(prebuild_step(), sourceFiles, span);
+		}
+
+		inline void postbuild(const std::vector<SourceFile>& sourceFiles)
+		{
+			auto span = g_buildTrace.span("postbuild", "lua");
+			run_script_step(postbuild_step(), sourceFiles, span);
+		}
+
+		inline ScriptStep prebuild_step() const {
+			return { "prebuild", script_path(m_projectStatistics->projectPrebuild), &m_projectStatistics->projectPrebuildInputs, &m_projectStatistics->projectPrebuildOutputs };
+		}
+
+		inline ScriptStep postbuild_step() const {
+			return { "postbuild", script_path(m_projectStatistics->projectPostbuild), &m_projectStatistics->projectPostbuildInputs, &m_projectStatistics->projectPostbuildOutputs };
+		}
+
+		// Scripts are named relative to the project root, not to where NeoShafa was started.
+		inline std::filesystem::path script_path(const std::string& script) const {
+			return script.empty() ? std::filesystem::path{} : (m_projectEnvironment->projectRoot / script).lexically_normal();
+		}
+
+		inline std::vector<std::filesystem::path> run_script_step(
+			const ScriptStep& step,
+			const std::vector<SourceFile>& sourceFiles,
+			BuildTrace::Span& span
+		) {
+			std::optional<ContentHash::Digest> inputDigest{};
+			if (step.is_declared()) {
+				auto res = m_scriptStepCache.input_digest(step, sourceFiles);
+				if (!res)
+					std::println("WARNING: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+				else if (m_scriptStepCache.is_current(step, *res, sourceFiles)) {
+					std::println("INFO: {} is up to date, skipping {}.", step.name, step.script.string());
+					span.argument("result", "skipped");
+					return {};
+				}
+				else
+					inputDigest = *res;
+			}
+
+			auto res = m_luaScriptStarter.run(step.script);
 			if (!res)
 			{
 				std::println(
 					std::cerr,
 					"ERROR: Lua error code: {}({})",
-					res.error(). message,
+					res.error().message,
 					static_cast<int32_t>(res.error().code)
 				);
-
-				return;
+				m_scriptStepCache.forget(step);
+				span.argument("result", "failed");
+				return step.outputs ? m_scriptStepCache.expand(*step.outputs) : std::vector<std::filesystem::path>{};
 			}
+
+			span.argument("result", "ran");
+			if (inputDigest)
+				return m_scriptStepCache.record(step, *inputDigest);
+			return step.outputs ? m_scriptStepCache.expand(*step.outputs) : std::vector<std::filesystem::path>{};
 		}
 
 	private:
 		const ProjectEnvironment* m_projectEnvironment{};
 		ProjectStatistics* m_projectStatistics{};
+		ProjectDependencies* m_projectDependencies{};
+		ObjectManifest* m_objectManifest{};
+		ObjectCache* m_objectCache{};
+		ModuleGraph* m_moduleGraph{};
+		JobPool* m_jobPool{};
+
+		PrecompiledHeader m_precompiledHeader{};
+		std::optional<PrecompiledHeaderArtifact> m_activePrecompiledHeader{};
+		bool m_modulesEnabled{ false };
+		bool m_timeTrace{ false };
+		UnityBuild m_unityBuild{};
+		ProjectLuaScriptStarter m_luaScriptStarter{};
+		ScriptStepCache m_scriptStepCache{};
+		bool m_unityIsolationLoaded{ false };
+		std::unordered_set<std::string> m_rewrittenUnitySources{};
+
+		std::vector<std::filesystem::path> m_linkLibraries{};
+
+		std::string m_compilerIdentityPath{};
+		std::string m_compilerIdentity{};
 	};
 }
\ No newline at end of file
@@ -4,8 +4,15 @@
 #include <windows.h>
 #endif
 
+#include <algorithm>
+#include <future>
+#include <optional>
+
 #include "Util.hpp"
+#include "JobPool.hpp"
 #include "ProjectData.hpp"
+#include "SourceCache.hpp"
+#include "BuildTrace.hpp"
 
 namespace NeoShafa {
 	class ProjectConfigure {
@@ -15,8 +22,9 @@ namespace NeoShafa {
 
 		inline ProjectConfigure(
 			const ProjectEnvironment* projectEnvironment,
-			ProjectStatistics* projectStatistics
-		) noexcept : m_projectEnvironment(projectEnvironment), m_projectStatistics(projectStatistics) {}
+			ProjectStatistics* projectStatistics,
+			JobPool* jobPool = nullptr
+		) noexcept : m_projectEnvironment(projectEnvironment), m_projectStatistics(projectStatistics), m_jobPool(jobPool) {}
 
 		inline Core::ExpectedVoid setup_project_folders()
 		{
@@ -66,7 +74,7 @@ namespace NeoShafa {
 					"LOG: {} folder already exists.",
 					m_projectEnvironment->projectBinaryFolderPath.filename().string()
 				);
-			else std::filesystem::create_directory(m_projectEnvironment->projectBinaryFolderPath);
+			else std::filesystem::create_directories(m_projectEnvironment->projectBinaryFolderPath);
 		
 			return {};
 		}
@@ -80,28 +88,35 @@ namespace NeoShafa {
 				);
 			}
 
-			const std::array<std::string, 4> sourceExtensions { ".cpp", ".cxx", ".inl", ".toml" };
-
+			const std::vector<std::string_view> sourceExtensions = source_extensions();
+
+			m_sourceFiles.clear();
+
+			release_source_cache();
+			auto loadSpan = g_buildTrace.span("load source cache", "cache");
+			const SourceCache* sourceCache = cached_sources();
+			loadSpan.finish();
+			Util::FileStamp cacheStamp{};
+			if (sourceCache)
+				if (auto res = Util::stat(m_projectEnvironment->projectSourceCacheFilePath); res)
+					cacheStamp = res.value();
+
+			// Every top-level directory is walked as its own job, then the candidates are
+			// sorted so hashing and the resulting m_sourceFiles order do not depend on
+			// which walk finished first.
+			auto scanSpan = g_buildTrace.span("scan directories", "configure");
+			std::vector<std::filesystem::path> candidates{};
+			std::vector<std::filesystem::path> directories{};
 			try
 			{
-				for (const auto& entry : std::filesystem::recursive_directory_iterator(m_projectEnvironment->projectRoot))
+				for (const auto& entry : std::filesystem::directory_iterator(m_projectEnvironment->projectRoot))
 				{
-					if (entry.is_regular_file())
-					{
-						const std::string extension = entry.path().extension().string();
-						if (std::find(sourceExtensions.begin(), sourceExtensions.end(), extension) != sourceExtensions.end())
-						{
-							 auto res = Util::hash(entry.path());
-							 if (!res.has_value())
-								 return std::unexpected(
-									 Core::make_error(
-										 Core::ErrorCode::GeneratinFileHashError,
-										 "Cannot generate hash.")
-								 );
-							 size_t fileHash = res.value();
-							m_sourceFiles.push_back(std::make_pair(fileHash, entry.path()));
-						}
+					if (entry.is_directory()) {
+						if (entry.path() != m_projectEnvironment->projectCachePath)
+							directories.push_back(entry.path());
 					}
+					else if (entry.is_regular_file() && is_source_file(entry.path(), sourceExtensions))
+						candidates.push_back(entry.path());
 				}
 			}
 			catch (const std::filesystem::filesystem_error& e)
@@ -114,66 +129,147 @@ namespace NeoShafa {
 				);
 			}
 
-			return {};
+			std::vector<std::future<Core::Expected<std::vector<std::filesystem::path>>>> walks{};
+			walks.reserve(directories.size());
+			for (const auto& directory : directories)
+				walks.push_back(dispatch([&directory, &sourceExtensions] {
+					auto span = g_buildTrace.span(directory.filename().string(), "scan");
+					return collect_source_files(directory, sourceExtensions);
+				}));
+
+			Core::ExpectedVoid walkResult{};
+			for (auto& walk : walks) {
+				auto res = walk.get();
+				if (!res) {
+					if (walkResult) walkResult = std::unexpected(res.error());
+					continue;
+				}
+				candidates.insert(candidates.end(), std::make_move_iterator(res->begin()), std::make_move_iterator(res->end()));
+			}
+			if (!walkResult)
+				return walkResult;
+
+			std::ranges::sort(candidates);
+			scanSpan.argument("files", std::to_string(candidates.size())).finish();
+
+			// Each chunk fills its own slice of the pre-sized result, so no locking is needed.
+			m_sourceFiles.resize(candidates.size());
+			const size_t workerCount = m_jobPool ? std::max<size_t>(m_jobPool->size(), 1) : 1;
+			const size_t chunkSize = std::max(m_minimumHashChunkSize, candidates.size() / (workerCount * 4) + 1);
+
+			auto hashSpan = g_buildTrace.span("hash sources", "configure");
+			std::vector<std::future<Core::ExpectedVoid>> chunks{};
+			for (size_t first = 0; first < candidates.size(); first += chunkSize) {
+				const size_t last = std::min(first + chunkSize, candidates.size());
+				chunks.push_back(dispatch([&, first, last]() -> Core::ExpectedVoid {
+					auto span = g_buildTrace.span(std::format("hash {} files", last - first), "hash");
+					for (size_t i = first; i < last; ++i) {
+						auto res = stat_and_hash(candidates[i], sourceCache, cacheStamp);
+						if (!res) return std::unexpected(res.error());
+						m_sourceFiles[i] = std::move(res.value());
+					}
+					return {};
+				}));
+			}
+
+			Core::ExpectedVoid result{};
+			for (auto& chunk : chunks)
+				if (auto res = chunk.get(); !res && result)
+					result = std::unexpected(res.error());
 
+			if (!result)
+				m_sourceFiles.clear();
+
+			return result;
+		}
+
+		struct SourceRefresh {
+			std::vector<SourceFile> changed{};
+			std::vector<std::filesystem::path> removed{};
+		};
+
+		// Applies a batch of file system notifications to the in-memory source table
+		// without rescanning the tree. A path that no longer exists also drops every
+		// tracked file below it, which covers deleted or renamed directories.
+		inline SourceRefresh refresh_source_files(const std::vector<std::filesystem::path>& paths)
+		{
+			const std::vector<std::string_view> sourceExtensions = source_extensions();
+			const auto lower_bound = [&](const std::filesystem::path& path) {
+				return std::ranges::lower_bound(m_sourceFiles, path, {}, &SourceFile::path);
+			};
+
+			SourceRefresh refresh{};
+			for (const auto& path : paths) {
+				std::error_code errorCode{};
+				if (!std::filesystem::exists(path, errorCode)) {
+					auto first = lower_bound(path);
+					auto last = first;
+					while (last != m_sourceFiles.end() && (last->path == path || is_below(last->path, path))) {
+						refresh.removed.push_back(last->path);
+						++last;
+					}
+					m_sourceFiles.erase(first, last);
+					continue;
+				}
+
+				if (!std::filesystem::is_regular_file(path, errorCode) || !is_source_file(path, sourceExtensions))
+					continue;
+
+				auto res = stat_and_hash(path, nullptr, {});
+				if (!res) {
+					std::println("WARNING: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+					continue;
+				}
+
+				const auto it = lower_bound(path);
+				if (it != m_sourceFiles.end() && it->path == path) {
+					const bool contentChanged = it->hash != res->hash;
+					*it = std::move(res.value());
+					if (contentChanged)
+						refresh.changed.push_back(*it);
+				}
+				else
+					refresh.changed.push_back(*m_sourceFiles.insert(it, std::move(res.value())));
+			}
+
+			return refresh;
 		}
 
 		inline Core::ExpectedVoid clean_source_cache()
 		{
+			release_source_cache();
 			if (std::filesystem::exists(m_projectEnvironment->projectSourceCacheFilePath))
-				Util::write(m_projectEnvironment->projectSourceCacheFilePath, "");
+				return Util::write_binary(m_projectEnvironment->projectSourceCacheFilePath, "");
 			return {};
 		}
 
 		inline Core::ExpectedVoid save_source_cache()
 		{
-			bool firstTime{ true };
-			for (const auto& [hash, path] : m_sourceFiles)
-			{
-				std::string content{ std::to_string(hash) + m_sourceCacheDelimiter + path.string() + "\n"};
-				if (firstTime) {
-					Util::write(m_projectEnvironment->projectSourceCacheFilePath, content);
-					firstTime = false;
-				}
-				else
-					Util::write(m_projectEnvironment->projectSourceCacheFilePath, content, true);
-			}
-
-			return {};
+			// The previous cache is still mapped and must not be rewritten underneath it.
+			auto span = g_buildTrace.span("save source cache", "cache");
+			release_source_cache();
+			return SourceCache::save(m_projectEnvironment->projectSourceCacheFilePath, m_sourceFiles);
 		}
+
 		inline Core::ExpectedVoid create_source_cache() {
-			Util::write(m_projectEnvironment->projectSourceCacheFilePath, "");
-			return {};
+			release_source_cache();
+			return Util::write_binary(m_projectEnvironment->projectSourceCacheFilePath, "");
 		}
 
-		inline Core::Expected<std::vector<std::pair<size_t, std::filesystem::path>>> get_source_cache() {
-			std::vector<std::pair<size_t, std::filesystem::path>> sourceFiles{};
-			auto res = Util::read(m_projectEnvironment->projectSourceCacheFilePath);
-			if (!res) {
-				return std::unexpected(
-					Core::make_error(
-						Core::ErrorCode::ReadingProjectCahedSourceError,
-						std::format("Reading project cahed source error: {}({})", res.error().message, static_cast<int32_t>(res.error().code))
-					)
-				);
-			}
-			std::vector<std::string> filesContext = res.value();
-			for (auto& string : filesContext)
-			{
-				std::vector<std::string_view> filteredString = split(string);
-				sourceFiles.push_back(
-					std::make_pair(
-						std::stoull(filteredString.at(0).data()),
-						filteredString.at(1)
-					)
-				);
+		inline Core::Expected<std::vector<SourceFile>> get_source_cache() {
+			std::vector<SourceFile> sourceFiles{};
+			const SourceCache* sourceCache = cached_sources();
+			if (!sourceCache)
+				return sourceFiles;
 
-			}
+			sourceFiles.reserve(sourceCache->size());
+			for (size_t i = 0; i < sourceCache->size(); ++i)
+				sourceFiles.push_back(sourceCache->source_file(i));
 
 			return sourceFiles;
 		}
 
-		inline Core::Expected<std::vector<std::pair<size_t, std::filesystem::path>>> get_difference_source_cache() {
+		inline Core::Expected<std::vector<SourceFile>> get_difference_source_cache() {
 			if (!m_projectStatistics) {
 				return std::unexpected(
 					Core::make_error(
@@ -181,33 +277,38 @@ namespace NeoShafa {
 					)
 				);
 			}
-			auto res = get_source_cache();
-			if (!res.has_value()) {
-				return std::unexpected(
-					Core::make_error(
-						Core::ErrorCode::ReadingProjectCahedSourceError, "Reading project cahed source error."
-					)
-				);
-			}
-			std::vector<std::pair<size_t, std::filesystem::path>> sourceFiles{ res.value() };
-			std::vector<std::pair<size_t, std::filesystem::path>> differenceFiles{};
-			for (const auto& [hash, path] : m_sourceFiles)
+
+			const SourceCache* sourceCache = cached_sources();
+			if (!sourceCache)
+				return m_sourceFiles;
+
+			std::vector<SourceFile> differenceFiles{};
+			for (const auto& sourceFile : m_sourceFiles)
 			{
-				if (std::find_if(
-					sourceFiles.begin(),
-					sourceFiles.end(),
-					[&](const auto& pair) {
-						return pair.first == hash && pair.second == path;
-					}
-				) == sourceFiles.end())
-				{
-					differenceFiles.push_back(std::make_pair(hash, path));
-				}
+				const auto index = sourceCache->find(sourceFile.path.string());
+				if (!index || sourceCache->digest_of(*index) != sourceFile.hash)
+					differenceFiles.push_back(sourceFile);
 			}
 			return differenceFiles;
 		}
 
+		inline std::vector<std::filesystem::path> get_removed_source_files()
+		{
+			std::vector<std::filesystem::path> removedFiles{};
+			const SourceCache* sourceCache = cached_sources();
+			if (!sourceCache) return removedFiles;
+
+			std::vector<bool> stillPresent(sourceCache->size(), false);
+			for (const auto& sourceFile : m_sourceFiles)
+				if (const auto index = sourceCache->find(sourceFile.path.string()); index)
+					stillPresent[*index] = true;
 
+			for (size_t i = 0; i < stillPresent.size(); ++i)
+				if (!stillPresent[i])
+					removedFiles.emplace_back(sourceCache->path_of(i));
+
+			return removedFiles;
+		}
 
 		inline Core::ExpectedVoid where_is_cl()
 		{
@@ -335,36 +436,185 @@ namespace NeoShafa {
 			return {};
 		}
 
-	public:
-		std::vector<std::string_view> split(const std::string& string) const {
-			std::vector<std::string_view> tokens{};
-			size_t start = 0;
-			size_t end = 0;
-
-			while ((end = string.find(m_sourceCacheDelimiter, start)) != std::string::npos) {
-				tokens.emplace_back(string.data() + start, end - start);
-				start = end + 1;
+		inline Core::ExpectedVoid where_is_compiler()
+		{
+			auto& compilationData = m_projectStatistics->projectCompilationData;
+
+			std::string_view cCompilerName{};
+			std::string_view cppCompilerName{};
+			switch (compilationData.projectCompilers)
+			{
+				case Core::SupportedCompilers::Clang:
+				cCompilerName = "clang";
+				cppCompilerName = "clang++";
+				break;
+				case Core::SupportedCompilers::GCC:
+				cCompilerName = "gcc";
+				cppCompilerName = "g++";
+				break;
+				default:
+				return std::unexpected(
+					Core::make_error(
+						Core::ErrorCode::InvalidClPathError,
+						std::format("Cannot search for {} compiler on this host.", Core::to_string(compilationData.projectCompilers))
+					)
+				);
 			}
 
-			if (start < string.length()) {
-				tokens.emplace_back(string.data() + start, string.length() - start);
+			const auto cCompilerPath = Util::BoostProcess::search_path(std::string{ cCompilerName });
+			const auto cppCompilerPath = Util::BoostProcess::search_path(std::string{ cppCompilerName });
+			const auto archiverPath = Util::BoostProcess::search_path("ar");
+
+			if (cppCompilerPath.empty()) {
+				return std::unexpected(
+					Core::make_error(
+						Core::ErrorCode::InvalidClPathError, std::format("Could not find {} in PATH.", cppCompilerName)
+					)
+				);
+			}
+			else if (archiverPath.empty()) {
+				return std::unexpected(
+					Core::make_error(
+						Core::ErrorCode::InvalidLibPathError, "Could not find ar in PATH."
+					)
+				);
 			}
 
-			return tokens;
+			compilationData.cCompilerPath = cCompilerPath.string();
+			compilationData.cppCompilerPath = cppCompilerPath.string();
+			compilationData.projectLibPath = archiverPath.string();
+			compilationData.projectLinkerPath = cppCompilerPath.string();
+
+			return {};
 		}
 
 	public:
-		inline const std::vector<std::pair<size_t, std::filesystem::path>>& get_source_files() const {
+		// Replaces the scanned table, e.g. with a synthetic one in the microbenchmarks.
+		inline void set_source_files(std::vector<SourceFile> sourceFiles) {
+			std::ranges::sort(sourceFiles, {}, &SourceFile::path);
+			m_sourceFiles = std::move(sourceFiles);
+		}
+
+		inline const std::vector<SourceFile>& get_source_files() const {
 			return m_sourceFiles;
 		}
 
+	private:
+		inline static std::vector<std::string_view> source_extensions()
+		{
+			std::vector<std::string_view> sourceExtensions{ ".toml" };
+			sourceExtensions.insert(sourceExtensions.end(), g_translationUnitExtensions.begin(), g_translationUnitExtensions.end());
+			sourceExtensions.insert(sourceExtensions.end(), g_headerExtensions.begin(), g_headerExtensions.end());
+			return sourceExtensions;
+		}
+
+		inline static bool is_below(const std::filesystem::path& path, const std::filesystem::path& directory)
+		{
+			const auto relative = path.lexically_relative(directory);
+			return !relative.empty() && *relative.begin() != "..";
+		}
+
+		inline static bool is_source_file(
+			const std::filesystem::path& path,
+			const std::vector<std::string_view>& sourceExtensions
+		) {
+			const std::string extension = path.extension().string();
+			return std::find(sourceExtensions.begin(), sourceExtensions.end(), extension) != sourceExtensions.end();
+		}
+
+		inline static Core::Expected<std::vector<std::filesystem::path>> collect_source_files(
+			const std::filesystem::path& directory,
+			const std::vector<std::string_view>& sourceExtensions
+		) {
+			std::vector<std::filesystem::path> sourceFiles{};
+			try
+			{
+				for (const auto& entry : std::filesystem::recursive_directory_iterator(directory))
+					if (entry.is_regular_file() && is_source_file(entry.path(), sourceExtensions))
+						sourceFiles.push_back(entry.path());
+			}
+			catch (const std::filesystem::filesystem_error& e)
+			{
+				return std::unexpected(
+					Core::make_error(
+						Core::ErrorCode::DirectoryIterationError,
+						std::format("Failed to iterate through source files: {}", e.what())
+					)
+				);
+			}
+			return sourceFiles;
+		}
+
+		// Hashes from the previous run are reused when the file metadata still matches.
+		// Files stamped at or after the cache was written may have changed within the
+		// same timestamp tick, so those are always rehashed.
+		inline static Core::Expected<SourceFile> stat_and_hash(
+			const std::filesystem::path& path,
+			const SourceCache* sourceCache,
+			const Util::FileStamp& cacheStamp
+		) {
+			auto stamp = Util::stat(path);
+			if (!stamp.has_value())
+				return std::unexpected(
+					Core::make_error(
+						Core::ErrorCode::GeneratinFileHashError,
+						std::format("Cannot stat file: {}", path.string()))
+				);
+
+			if (sourceCache && stamp->modificationTime < cacheStamp.modificationTime)
+				if (const auto index = sourceCache->find(path.string()); index && sourceCache->stamp_of(*index) == stamp.value())
+					return SourceFile{ sourceCache->digest_of(*index), stamp.value(), path };
+
+			auto res = Util::hash(path);
+			if (!res.has_value())
+				return std::unexpected(
+					Core::make_error(
+						Core::ErrorCode::GeneratinFileHashError,
+						std::format("Cannot generate hash for {}.", path.string()))
+				);
+
+			return SourceFile{ res.value(), stamp.value(), path };
+		}
+
+		// The previous run's cache, mapped on first use. Unusable or missing caches read as
+		// absent, which makes every file count as changed.
+		inline const SourceCache* cached_sources()
+		{
+			if (!m_sourceCacheLoaded) {
+				m_sourceCacheLoaded = true;
+				if (std::filesystem::exists(m_projectEnvironment->projectSourceCacheFilePath))
+					if (auto res = SourceCache::open(m_projectEnvironment->projectSourceCacheFilePath); res)
+						m_sourceCache = std::move(res.value());
+			}
+			return m_sourceCache ? &m_sourceCache.value() : nullptr;
+		}
+
+		inline void release_source_cache() noexcept
+		{
+			m_sourceCache.reset();
+			m_sourceCacheLoaded = false;
+		}
+
+		// Runs on the job pool when there is one, otherwise lazily on the caller's thread.
+		template <typename Function>
+		inline auto dispatch(Function&& function) -> std::future<std::invoke_result_t<Function>>
+		{
+			if (m_jobPool)
+				return m_jobPool->submit(std::forward<Function>(function));
+			return std::async(std::launch::deferred, std::forward<Function>(function));
+		}
+
 	private:
 		const ProjectEnvironment* m_projectEnvironment{};
 		ProjectStatistics* m_projectStatistics{};
+		JobPool* m_jobPool{};
+
+		constexpr static const size_t m_minimumHashChunkSize{ 32 };
 
-		constexpr static const char m_sourceCacheDelimiter{ '@' };
+		std::vector<SourceFile> m_sourceFiles{};
 
-		std::vector<std::pair<size_t, std::filesystem::path>> m_sourceFiles{};
+		std::optional<SourceCache> m_sourceCache{};
+		bool m_sourceCacheLoaded{ false };
 	};
 
 }
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include <unordered_map>
 #include <array>
 #include <algorithm>
+#include <optional>
 
 #include "Util.hpp"
 
@@ -16,15 +17,28 @@ namespace NeoShafa {
 		std::string*,
 		std::vector<std::string>*,
 		Core::SupportedCompilers*,
-		Core::SupportedTargets*
+		Core::SupportedTargets*,
+		uint64_t*,
+		bool*
 	>;
 
 	static constexpr std::string_view g_projectConfigureFileName{ "config.toml" };
 
 	static constexpr std::string_view g_projectCacheFolderName{ ".shafaCache" };
 	static constexpr std::string_view g_projectSourceCacheFileName{ "source.cache" };
+	static constexpr std::string_view g_projectDependencyCacheFileName{ "depend.cache" };
+	static constexpr std::string_view g_projectObjectManifestFileName{ "object.cache" };
+	static constexpr std::string_view g_projectServerSocketFileName{ "neoshafa.sock" };
+	static constexpr std::string_view g_projectModuleCacheFileName{ "module.cache" };
+	static constexpr std::string_view g_projectScriptStepCacheFileName{ "steps.cache" };
 
 	static constexpr std::string_view g_projectCacheBinaryFolderName{ "bin" };
+	static constexpr std::string_view g_projectObjectCacheFolderName{ "objects" };
+	static constexpr std::string_view g_projectPrecompiledHeaderFolderName{ "pch" };
+	static constexpr std::string_view g_projectModuleFolderName{ "modules" };
+	static constexpr std::string_view g_projectUnityFolderName{ "unity" };
+	static constexpr std::string_view g_projectConfigurationFolderName{ "configurations" };
+	static constexpr std::string_view g_projectProfileFolderName{ "profile" };
 	static constexpr std::string_view g_projectMsvcFinderUrl{ 
 		"https://github.com/microsoft/vswhere/releases/download/3.1.7/vswhere.exe" 
 	};
@@ -32,19 +46,36 @@ namespace NeoShafa {
 
 
 	static constexpr std::string_view g_projectBinaryFolderName{ "bin" };
+	static constexpr std::string_view g_projectObjectFolderName{ "obj" };
+	static constexpr std::string_view g_projectExternalObjectFolderName{ "external" };
+
+	static constexpr std::array<std::string_view, 4> g_translationUnitExtensions{ ".cpp", ".cxx", ".cppm", ".ixx" };
+	static constexpr std::array<std::string_view, 2> g_moduleInterfaceExtensions{ ".cppm", ".ixx" };
+	static constexpr std::array<std::string_view, 5> g_headerExtensions{ ".h", ".hh", ".hpp", ".hxx", ".inl" };
+
+	struct SourceFile {
+		ContentHash::Digest hash{};
+		Util::FileStamp stamp{};
+		std::filesystem::path path{};
+	};
 
 	struct ProjectEnvironment
 	{
-		inline ProjectEnvironment(void)
+		inline ProjectEnvironment(void) : ProjectEnvironment(std::filesystem::path{}) {}
+
+		// An empty root is the directory NeoShafa was started in, a workspace member is not.
+		inline explicit ProjectEnvironment(const std::filesystem::path& root)
 		{
 			try
 			{
-				projectRoot = std::filesystem::current_path();
+				projectRoot = root.empty() ? std::filesystem::current_path() : std::filesystem::absolute(root).lexically_normal();
+				if (!projectRoot.has_filename())
+					projectRoot = projectRoot.parent_path();
 				projectCachePath = projectRoot / g_projectCacheFolderName;
 				projectCacheBinaryFolderPath = projectCachePath / g_projectCacheBinaryFolderName;
 				projectMsvcFinderFilePath = projectCacheBinaryFolderPath / g_projectMsvcFinderFileName;
-				projectBinaryFolderPath = projectRoot / g_projectBinaryFolderName;
-				projectSourceCacheFilePath = projectCachePath / g_projectSourceCacheFileName;
+				projectObjectCachePath = projectCachePath / g_projectObjectCacheFolderName;
+				(void)set_configuration({});
 			}
 			catch (const std::exception& exception)
 			{
@@ -52,13 +83,67 @@ namespace NeoShafa {
 			}
 		}
 
+		// A configuration name becomes a single directory below .shafaCache and bin, so it
+		// must not be empty, contain a separator or name the current or parent directory.
+		inline static Core::ExpectedVoid check_configuration_name(std::string_view configuration)
+		{
+			if (configuration.empty() || configuration == "." || configuration == ".." ||
+				configuration.find_first_of("/\\:") != std::string_view::npos)
+				return std::unexpected(
+					Core::make_error(
+						Core::ErrorCode::InvalidEnvironmentError,
+						std::format("Configuration name \"{}\" must be a plain directory name.", configuration)
+					)
+				);
+			return {};
+		}
+
+		// Every named configuration keeps its caches in .shafaCache/configurations/<name> and its
+		// objects and outputs in bin/<name>, so switching between them rebuilds nothing. The
+		// object cache is shared, its entries are keyed by the compile command. Without a
+		// configuration both live directly in .shafaCache and bin.
+		inline Core::ExpectedVoid set_configuration(std::string_view configuration)
+		{
+			if (!configuration.empty())
+				if (auto res = check_configuration_name(configuration); !res)
+					return res;
+
+			projectConfiguration = configuration;
+			projectConfigurationCachePath = projectCachePath;
+			projectBinaryFolderPath = projectRoot / g_projectBinaryFolderName;
+			if (!configuration.empty()) {
+				projectConfigurationCachePath /= std::filesystem::path{ g_projectConfigurationFolderName } / configuration;
+				projectBinaryFolderPath /= configuration;
+			}
+
+			projectSourceCacheFilePath = projectConfigurationCachePath / g_projectSourceCacheFileName;
+			projectDependencyCacheFilePath = projectConfigurationCachePath / g_projectDependencyCacheFileName;
+			projectObjectManifestFilePath = projectConfigurationCachePath / g_projectObjectManifestFileName;
+			projectServerSocketFilePath = projectConfigurationCachePath / g_projectServerSocketFileName;
+			projectPrecompiledHeaderPath = projectConfigurationCachePath / g_projectPrecompiledHeaderFolderName;
+			projectModuleCacheFilePath = projectConfigurationCachePath / g_projectModuleCacheFileName;
+			projectModulePath = projectConfigurationCachePath / g_projectModuleFolderName;
+			projectUnityPath = projectConfigurationCachePath / g_projectUnityFolderName;
+			return {};
+		}
+
 		std::filesystem::path neoShafaPath{};
+		std::string projectConfiguration{};
 
 		std::filesystem::path projectRoot{};
 		std::filesystem::path projectCachePath{};
+		std::filesystem::path projectConfigurationCachePath{};
 		std::filesystem::path projectCacheBinaryFolderPath{};
 		std::filesystem::path projectMsvcFinderFilePath{};
 		std::filesystem::path projectSourceCacheFilePath{};
+		std::filesystem::path projectDependencyCacheFilePath{};
+		std::filesystem::path projectObjectManifestFilePath{};
+		std::filesystem::path projectObjectCachePath{};
+		std::filesystem::path projectServerSocketFilePath{};
+		std::filesystem::path projectPrecompiledHeaderPath{};
+		std::filesystem::path projectModuleCacheFilePath{};
+		std::filesystem::path projectModulePath{};
+		std::filesystem::path projectUnityPath{};
 		std::filesystem::path projectBinaryFolderPath{};
 	};
 
@@ -80,7 +165,7 @@ namespace NeoShafa {
 				return supportedProjectTypes;
 			}
 		};
-		static constexpr SupportedProjectTypes supportedProjectTypes;
+		static constexpr SupportedProjectTypes supportedProjectTypes{};
 
 #ifdef _WIN32
 		Core::SupportedCompilers projectCompilers{ Core::SupportedCompilers::MSVC };
@@ -88,7 +173,7 @@ namespace NeoShafa {
 #elifdef linux
 		Core::SupportedCompilers projectCompilers{ Core::SupportedCompilers::GCC };
 		Core::SupportedTargets projectTargets{ Core::SupportedTargets::Linux };
-#elif
+#else
 		Core::SupportedCompilers projectCompilers{ Core::SupportedCompilers::Clang };
 		Core::SupportedTargets projectTargets{ Core::SupportedTargets::Unknown };
 #endif
@@ -112,6 +197,27 @@ namespace NeoShafa {
 		std::vector<std::string> MSVCProjectLinkerFlags{};
 	};
 
+	// Flags a named configuration adds after the project's own. Debug, Release and
+	// RelWithDebInfo exist without being declared, a [Configuration.<name>] table in
+	// config.toml replaces them or adds another one.
+	struct BuildConfiguration {
+		std::string name{};
+		std::vector<std::string> cppCompilerFlags{};
+		std::vector<std::string> msvcCompilerFlags{};
+		std::vector<std::string> projectLinkerFlags{};
+
+		inline static std::optional<BuildConfiguration> builtin(std::string_view name)
+		{
+			if (name == "Debug")
+				return BuildConfiguration{ std::string{ name }, { "-O0", "-g" }, { "/Od", "/Zi" }, {} };
+			if (name == "Release")
+				return BuildConfiguration{ std::string{ name }, { "-O2", "-DNDEBUG" }, { "/O2", "/DNDEBUG" }, {} };
+			if (name == "RelWithDebInfo")
+				return BuildConfiguration{ std::string{ name }, { "-O2", "-g", "-DNDEBUG" }, { "/O2", "/Zi", "/DNDEBUG" }, {} };
+			return std::nullopt;
+		}
+	};
+
 	struct ProjectStatistics {
 		inline ProjectStatistics() {
 			std::string_view nameToHash{ "ProjectName" };
@@ -171,6 +277,12 @@ namespace NeoShafa {
 			);
 
 
+			nameToHash = "ProjectConfiguration";
+			variablesSignatures.emplace(
+				Util::hash(nameToHash),
+				&projectConfiguration
+			);
+
 			nameToHash = "ProjectPrebuild";
 			variablesSignatures.emplace(
 				Util::hash(nameToHash),
@@ -181,6 +293,31 @@ namespace NeoShafa {
 				Util::hash(nameToHash),
 				&projectPostbuild
 			);
+			nameToHash = "ProjectPrebuildInputs";
+			variablesSignatures.emplace(
+				Util::hash(nameToHash),
+				&projectPrebuildInputs
+			);
+			nameToHash = "ProjectPrebuildOutputs";
+			variablesSignatures.emplace(
+				Util::hash(nameToHash),
+				&projectPrebuildOutputs
+			);
+			nameToHash = "ProjectPostbuildInputs";
+			variablesSignatures.emplace(
+				Util::hash(nameToHash),
+				&projectPostbuildInputs
+			);
+			nameToHash = "ProjectPostbuildOutputs";
+			variablesSignatures.emplace(
+				Util::hash(nameToHash),
+				&projectPostbuildOutputs
+			);
+			nameToHash = "ProjectPgoTraining";
+			variablesSignatures.emplace(
+				Util::hash(nameToHash),
+				&projectPgoTraining
+			);
 
 			nameToHash = "projectLibFlags";
 			variablesSignatures.emplace(
@@ -204,6 +341,71 @@ namespace NeoShafa {
 				&projectCompilationData.MSVCProjectLinkerFlags
 			);
 
+			nameToHash = "ProjectObjectCache";
+			variablesSignatures.emplace(
+				Util::hash(nameToHash),
+				&projectObjectCache
+			);
+			nameToHash = "ProjectObjectCacheSize";
+			variablesSignatures.emplace(
+				Util::hash(nameToHash),
+				&projectObjectCacheSize
+			);
+			nameToHash = "ProjectPrecompiledHeader";
+			variablesSignatures.emplace(
+				Util::hash(nameToHash),
+				&projectPrecompiledHeader
+			);
+			nameToHash = "ProjectModules";
+			variablesSignatures.emplace(
+				Util::hash(nameToHash),
+				&projectModules
+			);
+			nameToHash = "ProjectUnityBuild";
+			variablesSignatures.emplace(
+				Util::hash(nameToHash),
+				&projectUnityBuild
+			);
+			nameToHash = "ProjectUnityBatchSize";
+			variablesSignatures.emplace(
+				Util::hash(nameToHash),
+				&projectUnityBatchSize
+			);
+			nameToHash = "ProjectUnityBatchBytes";
+			variablesSignatures.emplace(
+				Util::hash(nameToHash),
+				&projectUnityBatchBytes
+			);
+			nameToHash = "ProjectUnityExclude";
+			variablesSignatures.emplace(
+				Util::hash(nameToHash),
+				&projectUnityExclude
+			);
+			nameToHash = "ProjectUnityIsolateEdited";
+			variablesSignatures.emplace(
+				Util::hash(nameToHash),
+				&projectUnityIsolateEdited
+			);
+
+		}
+
+		inline std::optional<BuildConfiguration> find_configuration(std::string_view name) const
+		{
+			const auto it = std::ranges::find(projectConfigurations, name, &BuildConfiguration::name);
+			if (it != projectConfigurations.end())
+				return *it;
+			return BuildConfiguration::builtin(name);
+		}
+
+		// The project's flags followed by the ones of the active configuration.
+		inline std::vector<std::string> cpp_compiler_flags() const {
+			return concatenate(projectCompilationData.cppCompilerFlags, activeConfiguration.cppCompilerFlags);
+		}
+		inline std::vector<std::string> msvc_compiler_flags() const {
+			return concatenate(projectCompilationData.msvcCompilerFlags, activeConfiguration.msvcCompilerFlags);
+		}
+		inline std::vector<std::string> linker_flags() const {
+			return concatenate(projectCompilationData.projectLinkerFlags, activeConfiguration.projectLinkerFlags);
 		}
 
 		constexpr static inline bool is_project_type_supported(std::string_view projectType) {
@@ -217,12 +419,50 @@ namespace NeoShafa {
 		std::string projectLanguage{};
 
 		// ----------------Optional Project Information----------------
+		// Configuration built when --config does not name one, none by default.
+		std::string projectConfiguration{};
+		std::vector<BuildConfiguration> projectConfigurations{};
+		BuildConfiguration activeConfiguration{};
+
 		std::string projectPrebuild{};
 		std::string projectPostbuild{};
+		// Files a script reads and writes, relative to the project root. A script with either
+		// list is skipped while both are unchanged, without them it runs on every build.
+		std::vector<std::string> projectPrebuildInputs{};
+		std::vector<std::string> projectPrebuildOutputs{};
+		std::vector<std::string> projectPostbuildInputs{};
+		std::vector<std::string> projectPostbuildOutputs{};
+		// Command --pgo trains the instrumented build with, run in the project root. A
+		// "{output}" in it names the instrumented executable or library.
+		std::vector<std::string> projectPgoTraining{};
+
+		bool projectObjectCache{ true };
+		// Size limit of .shafaCache/objects in MiB, 0 disables the cache.
+		uint64_t projectObjectCacheSize{ 5120 };
+		// Header relative to the project root, or "auto" to pick the common system headers.
+		std::string projectPrecompiledHeader{};
+		// Scan for named modules even without .cppm or .ixx files, e.g. for interfaces in .cpp files.
+		bool projectModules{ false };
+		// Compile translation units in generated unity batches of about this many files.
+		bool projectUnityBuild{ false };
+		uint64_t projectUnityBatchSize{ 8 };
+		// Closes a batch once its sources reach this many bytes, 0 for no limit.
+		uint64_t projectUnityBatchBytes{ 0 };
+		// Sources relative to the project root that always compile on their own.
+		std::vector<std::string> projectUnityExclude{};
+		bool projectUnityIsolateEdited{ true };
 
 		std::unordered_map<size_t, basicUnified> variablesSignatures{};
 
 		ProjectCompilationData projectCompilationData{};
+
+	private:
+		inline static std::vector<std::string> concatenate(const std::vector<std::string>& first, const std::vector<std::string>& second)
+		{
+			std::vector<std::string> flags{ first };
+			flags.insert(flags.end(), second.begin(), second.end());
+			return flags;
+		}
 	};
 	
 }
\ No newline at end of file
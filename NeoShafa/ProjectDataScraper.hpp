@@ -129,6 +129,19 @@ namespace NeoShafa {
 								*std::get<std::string*>(it->second) = dataStr;
 							}
 						}
+						else if (data.contains(key.data())) {
+							const auto mapKey = Util::hash(key);
+							if (const auto it = m_projectStatistics->variablesSignatures.find(mapKey);
+								it != m_projectStatistics->variablesSignatures.end()) {
+								const auto& value = data.at(key.data());
+								if (auto* integerPtr = std::get_if<uint64_t*>(&it->second); integerPtr && value.is_integer() && value.as_integer() >= 0)
+									**integerPtr = static_cast<uint64_t>(value.as_integer());
+								else if (auto* boolPtr = std::get_if<bool*>(&it->second); boolPtr && value.is_boolean())
+									**boolPtr = value.as_boolean();
+								else
+									std::println("WARNING: field of {} has an unexpected type.", key.data());
+							}
+						}
 					}
 				};
 
@@ -160,8 +173,16 @@ namespace NeoShafa {
 				)
 				return std::unexpected(Core::make_error(Core::ErrorCode::UnexpectedProjectTypeError, std::format("Unexpected project type: {}", m_projectStatistics->projectCompilationData.projectType)));
 			
+			check_for_key("ProjectConfiguration", false);
+			read_configurations(data);
+
 			check_for_key("ProjectPrebuild", false);
 			check_for_key("ProjectPostbuild", false);
+			check_for_key("ProjectPrebuildInputs", true);
+			check_for_key("ProjectPrebuildOutputs", true);
+			check_for_key("ProjectPostbuildInputs", true);
+			check_for_key("ProjectPostbuildOutputs", true);
+			check_for_key("ProjectPgoTraining", true);
 
 			check_for_key("cCompilerVersion", false);
 			check_for_key("cppCompilerVersion", false);
@@ -176,9 +197,49 @@ namespace NeoShafa {
 			check_for_key("projectLinkerFlags", true);
 			check_for_key("MSVCProjectLinkerFlags", true);
 
+			check_for_key("ProjectObjectCache", false);
+			check_for_key("ProjectObjectCacheSize", false);
+			check_for_key("ProjectPrecompiledHeader", false);
+			check_for_key("ProjectModules", false);
+			check_for_key("ProjectUnityBuild", false);
+			check_for_key("ProjectUnityBatchSize", false);
+			check_for_key("ProjectUnityBatchBytes", false);
+			check_for_key("ProjectUnityExclude", true);
+			check_for_key("ProjectUnityIsolateEdited", false);
+
 			return {};
 		}
 
+	private:
+		// [Configuration.<name>] tables, each with any of cppCompilerFlags, msvcCompilerFlags
+		// and projectLinkerFlags.
+		template <typename Table>
+		inline void read_configurations(const Table& data)
+		{
+			m_projectStatistics->projectConfigurations.clear();
+			if (!data.contains("Configuration"))
+				return;
+			if (!data.at("Configuration").is_table()) {
+				std::println("WARNING: field of Configuration has an unexpected type.");
+				return;
+			}
+
+			for (const auto& [name, table] : data.at("Configuration").as_table()) {
+				BuildConfiguration configuration{ name };
+				const auto read_flags = [&table](const char* key, std::vector<std::string>& flags) {
+					if (!table.is_table() || !table.contains(key) || !table.at(key).is_array())
+						return;
+					for (const auto& element : table.at(key).as_array())
+						if (element.is_string())
+							flags.push_back(element.as_string());
+				};
+				read_flags("cppCompilerFlags", configuration.cppCompilerFlags);
+				read_flags("msvcCompilerFlags", configuration.msvcCompilerFlags);
+				read_flags("projectLinkerFlags", configuration.projectLinkerFlags);
+				m_projectStatistics->projectConfigurations.push_back(std::move(configuration));
+			}
+		}
+
 	private:
 		const ProjectEnvironment* m_projectEnvironment{};
 		ProjectStatistics* m_projectStatistics{};
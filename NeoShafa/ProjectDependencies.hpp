@@ -0,0 +1,292 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Util.hpp"
+#include "Json.hpp"
+#include "ProjectData.hpp"
+
+namespace NeoShafa {
+	// Include graph of every translation unit, collected from the depfiles the compiler
+	// writes next to each object and persisted in .shafaCache between builds.
+	class ProjectDependencies {
+	public:
+		ProjectDependencies() = default;
+		~ProjectDependencies() = default;
+
+		inline explicit ProjectDependencies(
+			const ProjectEnvironment* projectEnvironment
+		) noexcept : m_projectEnvironment(projectEnvironment) {}
+
+		inline Core::ExpectedVoid load()
+		{
+			m_graph.clear();
+			if (!std::filesystem::exists(m_projectEnvironment->projectDependencyCacheFilePath))
+				return {};
+
+			auto res = Util::read(m_projectEnvironment->projectDependencyCacheFilePath);
+			if (!res)
+				return std::unexpected(
+					Core::make_error(
+						Core::ErrorCode::ReadingDependencyFileError,
+						std::format("Reading dependency cache error: {}({})", res.error().message, static_cast<int32_t>(res.error().code))
+					)
+				);
+
+			const std::vector<std::string>& lines = res.value();
+			if (lines.empty() || lines.front() != m_cacheHeader) {
+				std::println("WARNING: Dependency cache has an unknown format, header changes will be tracked after the next build.");
+				return {};
+			}
+
+			Entry* current{};
+			for (size_t i = 1; i < lines.size(); ++i) {
+				const std::string& line = lines[i];
+				if (line.empty()) continue;
+
+				if (line.front() == '\t') {
+					if (current)
+						current->dependencies.emplace_back(line.substr(1));
+				}
+				else {
+					const std::filesystem::path source{ line };
+					current = &m_graph[key(source)];
+					current->source = source;
+					current->dependencies.clear();
+				}
+			}
+
+			for (auto& [_, entry] : m_graph)
+				entry.rebuild_keys();
+
+			return {};
+		}
+
+		inline Core::ExpectedVoid save() const
+		{
+			std::vector<const Entry*> entries{};
+			entries.reserve(m_graph.size());
+			for (const auto& [_, entry] : m_graph)
+				if (std::filesystem::exists(entry.source))
+					entries.push_back(&entry);
+
+			std::ranges::sort(entries, {}, [](const Entry* entry) { return entry->source; });
+
+			std::string content{ m_cacheHeader };
+			content.push_back('\n');
+			for (const Entry* entry : entries) {
+				content.append(entry->source.string()).push_back('\n');
+				for (const auto& dependency : entry->dependencies)
+					content.append("\t").append(dependency.string()).push_back('\n');
+			}
+
+			return Util::write_atomic(m_projectEnvironment->projectDependencyCacheFilePath, content);
+		}
+
+		inline void update(const std::filesystem::path& source, std::vector<std::filesystem::path> dependencies)
+		{
+			Entry& entry = m_graph[key(source)];
+			entry.source = source;
+			entry.dependencies = std::move(dependencies);
+			entry.rebuild_keys();
+		}
+
+		inline void remove(const std::filesystem::path& source) {
+			m_graph.erase(key(source));
+		}
+
+		inline const std::vector<std::filesystem::path>* dependencies_of(const std::filesystem::path& source) const
+		{
+			const auto it = m_graph.find(key(source));
+			return it == m_graph.end() ? nullptr : &it->second.dependencies;
+		}
+
+		// Every translation unit that includes at least one of the changed files.
+		inline std::vector<std::filesystem::path> dependents_of(const std::vector<std::filesystem::path>& changedFiles) const
+		{
+			std::unordered_set<std::string> changedKeys{};
+			changedKeys.reserve(changedFiles.size());
+			for (const auto& path : changedFiles)
+				changedKeys.insert(key(path));
+
+			std::vector<std::filesystem::path> dependents{};
+			for (const auto& [_, entry] : m_graph) {
+				if (std::ranges::any_of(entry.keys, [&](const std::string& dependency) { return changedKeys.contains(dependency); }))
+					dependents.push_back(entry.source);
+			}
+			std::ranges::sort(dependents);
+
+			return dependents;
+		}
+
+		inline size_t size() const noexcept { return m_graph.size(); }
+
+	public:
+		inline static std::filesystem::path dependency_file_path(const std::filesystem::path& objectPath)
+		{
+			std::filesystem::path dependencyFilePath{ objectPath };
+#ifdef _WIN32
+			return dependencyFilePath.replace_extension(".json");
+#else
+			return dependencyFilePath.replace_extension(".d");
+#endif // _WIN32
+		}
+
+		inline Core::Expected<std::vector<std::filesystem::path>> read_dependency_file(
+			const std::filesystem::path& dependencyFilePath
+		) const {
+			auto res = Util::read_all(dependencyFilePath);
+			if (!res)
+				return std::unexpected(
+					Core::make_error(
+						Core::ErrorCode::ReadingDependencyFileError,
+						std::format("Cannot read dependency file: {}", dependencyFilePath.string())
+					)
+				);
+
+			auto dependencies = dependencyFilePath.extension() == ".json"
+				? parse_source_dependencies(res.value())
+				: parse_depfile(res.value());
+			if (!dependencies) return dependencies;
+
+			for (auto& dependency : *dependencies)
+				dependency = normalize(dependency);
+
+			return dependencies;
+		}
+
+		// Make-style rule written by -MD -MF, "object: source header ..." continued over
+		// escaped newlines. Spaces inside paths are escaped with a backslash.
+		inline static Core::Expected<std::vector<std::filesystem::path>> parse_depfile(std::string_view content)
+		{
+			size_t position{};
+			while (true) {
+				position = content.find(':', position);
+				if (position == std::string_view::npos)
+					return std::unexpected(
+						Core::make_error(Core::ErrorCode::ReadingDependencyFileError, "Depfile has no rule.")
+					);
+				++position;
+				if (position >= content.size() || content[position] == ' ' || content[position] == '\t'
+					|| content[position] == '\n' || content[position] == '\r')
+					break;
+			}
+
+			std::vector<std::filesystem::path> dependencies{};
+			std::string token{};
+			const auto flush = [&] {
+				if (!token.empty()) {
+					dependencies.emplace_back(token);
+					token.clear();
+				}
+			};
+
+			for (; position < content.size(); ++position) {
+				const char character = content[position];
+				if (character == '\\' && position + 1 < content.size()) {
+					const char next = content[position + 1];
+					if (next == '\n' || next == '\r') {
+						flush();
+						++position;
+						if (next == '\r' && position + 1 < content.size() && content[position + 1] == '\n')
+							++position;
+						continue;
+					}
+					if (next == ' ' || next == '#') {
+						token.push_back(next);
+						++position;
+						continue;
+					}
+				}
+				if (character == '$' && position + 1 < content.size() && content[position + 1] == '$') {
+					token.push_back('$');
+					++position;
+					continue;
+				}
+				if (character == '\n' || character == '\r') {
+					flush();
+					break;
+				}
+				if (character == ' ' || character == '\t') {
+					flush();
+					continue;
+				}
+				token.push_back(character);
+			}
+			flush();
+
+			return dependencies;
+		}
+
+		// MSVC /sourceDependencies report: { "Data": { "Source": "...", "Includes": [ ... ] } }.
+		inline static Core::Expected<std::vector<std::filesystem::path>> parse_source_dependencies(std::string_view content)
+		{
+			auto document = Json::parse(content);
+			if (!document) return std::unexpected(document.error());
+
+			const Json::Value* data = document->find("Data");
+			if (!data)
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::ReadingDependencyFileError, "Source dependencies have no Data object.")
+				);
+
+			std::vector<std::filesystem::path> dependencies{};
+			if (const std::string_view source = data->string_or("Source"); !source.empty())
+				dependencies.emplace_back(source);
+
+			if (const Json::Value* includes = data->find("Includes"); includes && includes->is_array())
+				for (const auto& include : includes->as_array())
+					if (include.is_string())
+						dependencies.emplace_back(include.as_string());
+
+			return dependencies;
+		}
+
+		// MSVC reports lower-cased paths, so lookups on Windows ignore case.
+		inline static std::string key(const std::filesystem::path& path)
+		{
+			std::string pathKey{ path.lexically_normal().string() };
+#ifdef _WIN32
+			std::ranges::transform(pathKey, pathKey.begin(), [](unsigned char character) {
+				return static_cast<char>(std::tolower(character));
+			});
+#endif // _WIN32
+			return pathKey;
+		}
+
+	private:
+		inline std::filesystem::path normalize(const std::filesystem::path& path) const
+		{
+			if (path.is_relative())
+				return (m_projectEnvironment->projectRoot / path).lexically_normal();
+			return path.lexically_normal();
+		}
+
+	private:
+		struct Entry {
+			std::filesystem::path source{};
+			std::vector<std::filesystem::path> dependencies{};
+			std::vector<std::string> keys{};
+
+			inline void rebuild_keys()
+			{
+				keys.clear();
+				keys.reserve(dependencies.size());
+				for (const auto& dependency : dependencies)
+					keys.push_back(key(dependency));
+			}
+		};
+
+		const ProjectEnvironment* m_projectEnvironment{};
+
+		constexpr static std::string_view m_cacheHeader{ "NeoShafaDependencies 1" };
+
+		std::unordered_map<std::string, Entry> m_graph{};
+	};
+}
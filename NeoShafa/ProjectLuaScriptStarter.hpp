@@ -2,6 +2,10 @@
 
 #include <print>
 #include <iostream>
+#include <future>
+#include <memory>
+#include <new>
+#include <optional>
 
 extern "C"
 {
@@ -11,30 +15,264 @@ extern "C"
 }
 
 #include "Util.hpp"
+#include "ProjectData.hpp"
+#include "ProcessEngine.hpp"
 
 namespace NeoShafa {
+	// One Lua VM for the whole build, shared by the prebuild and postbuild scripts and
+	// closed by close(). Scripts get the stock libraries and a `neoshafa` module:
+	//   neoshafa.root                   project root
+	//   neoshafa.configuration          configuration being built, empty without one
+	//   neoshafa.glob(pattern)          scanned sources matching a root-relative pattern,
+	//                                   `*` and `?` stay in one directory, `**` does not
+	//   neoshafa.hash(path)             content hash of a file, relative to the root
+	//   neoshafa.hash_string(text)      content hash of a string
+	//   neoshafa.spawn(exe, { args })   starts a command in the project root, returns a
+	//                                   command object whose wait() returns exit code,
+	//                                   stdout and stderr and whose ready() does not block
+	// Commands run on g_processEngine, so they are limited by --jobs like the compilers.
 	class ProjectLuaScriptStarter {
 	public:
-		ProjectLuaScriptStarter() = delete;
-		~ProjectLuaScriptStarter() = delete;
+		ProjectLuaScriptStarter() = default;
+		inline ~ProjectLuaScriptStarter() { close(); }
 
-		inline static Core::ExpectedVoid run(const std::filesystem::path& scriptPath) {
-			int32_t status{};
-			lua_State* m_luaState = luaL_newstate();
-			luaL_openlibs(m_luaState);
+		ProjectLuaScriptStarter(const ProjectLuaScriptStarter&) = delete;
+		ProjectLuaScriptStarter& operator=(const ProjectLuaScriptStarter&) = delete;
+
+		inline explicit ProjectLuaScriptStarter(const ProjectEnvironment* projectEnvironment) noexcept :
+			m_projectEnvironment(projectEnvironment) {}
+
+		// The list is read by neoshafa.glob and has to outlive the build.
+		inline void set_source_files(const std::vector<SourceFile>* sourceFiles) noexcept { m_sourceFiles = sourceFiles; }
 
+		inline Core::ExpectedVoid run(const std::filesystem::path& scriptPath) {
 			if (scriptPath.empty())
 				return std::unexpected(Core::make_error(Core::ErrorCode::CannotReadFileError, "No script path provided!"));
 
 			if (!std::filesystem::exists(scriptPath))
 				return std::unexpected(Core::make_error(Core::ErrorCode::FileNotFoundError, std::format("Script file does not exist: {}", scriptPath.string())));
 
-			status = luaL_dofile(m_luaState, scriptPath.string().c_str());
-			if (status)
-				return std::unexpected(Core::make_error(Core::ErrorCode::ExecutionError, std::format("Lua error: {}", lua_tostring(m_luaState, -1))));
+			if (!m_luaState)
+				open();
 
+			// The stack is emptied after every script, since the VM outlives it.
+			const int32_t status = luaL_dofile(m_luaState, scriptPath.string().c_str());
+			if (status) {
+				std::string message{ lua_tostring(m_luaState, -1) ? lua_tostring(m_luaState, -1) : "unknown error" };
+				lua_settop(m_luaState, 0);
+				return std::unexpected(Core::make_error(Core::ErrorCode::ExecutionError, std::format("Lua error: {}", message)));
+			}
+
+			lua_settop(m_luaState, 0);
 			return {};
 		}
 
+		// Collecting the VM waits for every command the scripts spawned and did not wait for.
+		inline void close()
+		{
+			if (m_luaState)
+				lua_close(std::exchange(m_luaState, nullptr));
+		}
+
+	private:
+		struct SpawnedCommand {
+			std::future<Core::Expected<ProcessResult>> future{};
+			std::optional<Core::Expected<ProcessResult>> result{};
+
+			inline const Core::Expected<ProcessResult>& get()
+			{
+				if (!result)
+					result = future.get();
+				return *result;
+			}
+		};
+
+		inline static constexpr const char* m_commandMetatable{ "NeoShafa.Command" };
+
+	private:
+		inline void open()
+		{
+			m_luaState = luaL_newstate();
+			luaL_openlibs(m_luaState);
+
+			luaL_newmetatable(m_luaState, m_commandMetatable);
+			const luaL_Reg commandMethods[] = {
+				{ "wait", &command_wait },
+				{ "ready", &command_ready },
+				{ nullptr, nullptr }
+			};
+			luaL_newlib(m_luaState, commandMethods);
+			lua_setfield(m_luaState, -2, "__index");
+			lua_pushcfunction(m_luaState, &command_gc);
+			lua_setfield(m_luaState, -2, "__gc");
+			lua_pop(m_luaState, 1);
+
+			// Every function gets this object as its only upvalue.
+			const luaL_Reg functions[] = {
+				{ "glob", &protect<&ProjectLuaScriptStarter::glob> },
+				{ "hash", &protect<&ProjectLuaScriptStarter::hash> },
+				{ "hash_string", &protect<&ProjectLuaScriptStarter::hash_string> },
+				{ "spawn", &protect<&ProjectLuaScriptStarter::spawn> },
+				{ nullptr, nullptr }
+			};
+			luaL_newlibtable(m_luaState, functions);
+			lua_pushlightuserdata(m_luaState, this);
+			luaL_setfuncs(m_luaState, functions, 1);
+			lua_pushstring(m_luaState, m_projectEnvironment ? m_projectEnvironment->projectRoot.string().c_str() : "");
+			lua_setfield(m_luaState, -2, "root");
+			lua_pushstring(m_luaState, m_projectEnvironment ? m_projectEnvironment->projectConfiguration.c_str() : "");
+			lua_setfield(m_luaState, -2, "configuration");
+
+			// Both `require("neoshafa")` and the global work.
+			lua_getglobal(m_luaState, "package");
+			lua_getfield(m_luaState, -1, "loaded");
+			lua_pushvalue(m_luaState, -3);
+			lua_setfield(m_luaState, -2, "neoshafa");
+			lua_pop(m_luaState, 2);
+			lua_setglobal(m_luaState, "neoshafa");
+		}
+
+		// lua_error unwinds with longjmp, which would skip C++ destructors, so functions
+		// return their error and it is raised once nothing is left to destroy.
+		template <Core::Expected<int32_t> (ProjectLuaScriptStarter::*Function)(lua_State*) const>
+		inline static int protect(lua_State* luaState)
+		{
+			{
+				const auto* self = static_cast<const ProjectLuaScriptStarter*>(lua_touserdata(luaState, lua_upvalueindex(1)));
+				const auto res = (self->*Function)(luaState);
+				if (res)
+					return *res;
+				lua_pushstring(luaState, res.error().message.c_str());
+			}
+			return lua_error(luaState);
+		}
+
+		inline static Core::Expected<std::string_view> string_argument(lua_State* luaState, int32_t index, std::string_view description)
+		{
+			if (lua_type(luaState, index) != LUA_TSTRING)
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::ExecutionError, std::format("{} must be a string.", description))
+				);
+			size_t size{};
+			const char* string = lua_tolstring(luaState, index, &size);
+			return std::string_view{ string, size };
+		}
+
+		inline Core::Expected<int32_t> glob(lua_State* luaState) const
+		{
+			const auto pattern = string_argument(luaState, 1, "neoshafa.glob: argument 1");
+			if (!pattern) return std::unexpected(pattern.error());
+
+			lua_newtable(luaState);
+			if (!m_sourceFiles || !m_projectEnvironment)
+				return 1;
+
+			lua_Integer index{};
+			for (const auto& sourceFile : *m_sourceFiles)
+				if (Util::glob_match(*pattern, sourceFile.path.lexically_relative(m_projectEnvironment->projectRoot).generic_string())) {
+					lua_pushstring(luaState, sourceFile.path.string().c_str());
+					lua_rawseti(luaState, -2, ++index);
+				}
+			return 1;
+		}
+
+		inline Core::Expected<int32_t> hash(lua_State* luaState) const
+		{
+			const auto path = string_argument(luaState, 1, "neoshafa.hash: argument 1");
+			if (!path) return std::unexpected(path.error());
+
+			std::filesystem::path filePath{ *path };
+			if (filePath.is_relative() && m_projectEnvironment)
+				filePath = m_projectEnvironment->projectRoot / filePath;
+			const auto digest = Util::hash(filePath);
+			if (!digest) return std::unexpected(digest.error());
+			lua_pushstring(luaState, digest->to_string().c_str());
+			return 1;
+		}
+
+		inline Core::Expected<int32_t> hash_string(lua_State* luaState) const
+		{
+			const auto text = string_argument(luaState, 1, "neoshafa.hash_string: argument 1");
+			if (!text) return std::unexpected(text.error());
+
+			lua_pushstring(luaState, ContentHash::hash(*text).to_string().c_str());
+			return 1;
+		}
+
+		inline Core::Expected<int32_t> spawn(lua_State* luaState) const
+		{
+			const auto executable = string_argument(luaState, 1, "neoshafa.spawn: argument 1");
+			if (!executable) return std::unexpected(executable.error());
+
+			std::vector<std::string> arguments{};
+			if (lua_istable(luaState, 2)) {
+				const size_t argumentCount = lua_rawlen(luaState, 2);
+				for (size_t i = 1; i <= argumentCount; ++i) {
+					lua_rawgeti(luaState, 2, static_cast<lua_Integer>(i));
+					const auto argument = string_argument(luaState, -1, "neoshafa.spawn: every command argument");
+					if (argument)
+						arguments.emplace_back(*argument);
+					lua_pop(luaState, 1);
+					if (!argument) return std::unexpected(argument.error());
+				}
+			}
+			else if (!lua_isnoneornil(luaState, 2))
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::ExecutionError, "neoshafa.spawn: argument 2 must be a table of strings.")
+				);
+
+			// A bare name is looked up on PATH, like a shell would.
+			std::filesystem::path executablePath{ *executable };
+			if (!executablePath.has_parent_path())
+				if (const auto found = Util::BoostProcess::search_path(executablePath.string()); !found.empty())
+					executablePath = found.string();
+
+			auto promise = std::make_shared<std::promise<Core::Expected<ProcessResult>>>();
+			new (lua_newuserdata(luaState, sizeof(SpawnedCommand))) SpawnedCommand{ promise->get_future() };
+			luaL_getmetatable(luaState, m_commandMetatable);
+			lua_setmetatable(luaState, -2);
+
+			g_processEngine.launch(std::move(executablePath), std::move(arguments), [promise](Core::Expected<ProcessResult> result) {
+				promise->set_value(std::move(result));
+			}, m_projectEnvironment ? m_projectEnvironment->projectRoot : std::filesystem::path{});
+			return 1;
+		}
+
+		// Exit code, stdout and stderr, or nil and the reason the command did not start.
+		inline static int command_wait(lua_State* luaState)
+		{
+			auto* command = static_cast<SpawnedCommand*>(luaL_checkudata(luaState, 1, m_commandMetatable));
+			const auto& result = command->get();
+			if (!result) {
+				lua_pushnil(luaState);
+				lua_pushstring(luaState, result.error().message.c_str());
+				return 2;
+			}
+			lua_pushinteger(luaState, result->exitCode);
+			lua_pushlstring(luaState, result->standardOutput.data(), result->standardOutput.size());
+			lua_pushlstring(luaState, result->standardError.data(), result->standardError.size());
+			return 3;
+		}
+
+		inline static int command_ready(lua_State* luaState)
+		{
+			auto* command = static_cast<SpawnedCommand*>(luaL_checkudata(luaState, 1, m_commandMetatable));
+			lua_pushboolean(luaState, command->result || command->future.wait_for(std::chrono::seconds{ 0 }) == std::future_status::ready);
+			return 1;
+		}
+
+		inline static int command_gc(lua_State* luaState)
+		{
+			auto* command = static_cast<SpawnedCommand*>(lua_touserdata(luaState, 1));
+			if (command->future.valid())
+				command->future.wait();
+			command->~SpawnedCommand();
+			return 0;
+		}
+
+	private:
+		const ProjectEnvironment* m_projectEnvironment{};
+		const std::vector<SourceFile>* m_sourceFiles{};
+		lua_State* m_luaState{};
 	};
-}
\ No newline at end of file
+}
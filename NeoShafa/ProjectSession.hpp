@@ -0,0 +1,394 @@
+#pragma once
+
+#include <print>
+#include <iostream>
+#include <optional>
+#include <unordered_set>
+#include <vector>
+
+#include "Util.hpp"
+#include "JobPool.hpp"
+#include "ProjectData.hpp"
+#include "ProjectDataScraper.hpp"
+#include "ProjectConfigure.hpp"
+#include "ProjectDependencies.hpp"
+#include "ObjectManifest.hpp"
+#include "ObjectCache.hpp"
+#include "ModuleGraph.hpp"
+#include "ProjectBuild.hpp"
+#include "FileWatcher.hpp"
+#include "BuildTrace.hpp"
+
+namespace NeoShafa {
+	// Everything one project keeps between builds: its configuration, source table,
+	// dependency graph, object manifest and caches, all below its own root. The Router
+	// holds one for the current directory, a Workspace one per member, all sharing the
+	// caller's job pool and g_processEngine.
+	class ProjectSession {
+	public:
+		inline ProjectSession(const std::filesystem::path& projectRoot, JobPool* jobPool) :
+			m_projectEnvironment(projectRoot),
+			m_projectConfigure(&m_projectEnvironment, &m_projectStatistics, jobPool),
+			m_projectBuild(&m_projectEnvironment, &m_projectStatistics, &m_projectDependencies, &m_objectManifest, &m_objectCache, &m_moduleGraph, jobPool) {}
+		~ProjectSession() = default;
+
+		ProjectSession(const ProjectSession&) = delete;
+		ProjectSession& operator=(const ProjectSession&) = delete;
+
+		inline ProjectEnvironment& environment() noexcept { return m_projectEnvironment; }
+		inline const ProjectStatistics& statistics() const noexcept { return m_projectStatistics; }
+		inline ProjectBuild& build() noexcept { return m_projectBuild; }
+		inline const ObjectManifest& object_manifest() const noexcept { return m_objectManifest; }
+
+		// The files the last successful build saw change, including the ones it was told
+		// about by its dependencies, so they reach the projects depending on this one.
+		inline const std::vector<std::filesystem::path>& changed_files() const noexcept { return m_changedFiles; }
+
+		// Named by --config, it wins over the ProjectConfiguration of config.toml.
+		inline Core::ExpectedVoid set_configuration(std::string configuration)
+		{
+			if (auto res = ProjectEnvironment::check_configuration_name(configuration); !res)
+				return res;
+			if (auto res = m_projectEnvironment.set_configuration(configuration); !res)
+				return res;
+			m_configuration = std::move(configuration);
+			return {};
+		}
+
+		// Builds the selected configuration with the flags of this one added, in the
+		// partition named after it, e.g. the stages of --pgo.
+		inline Core::ExpectedVoid set_derived_configuration(BuildConfiguration configuration)
+		{
+			if (auto res = m_projectEnvironment.set_configuration(configuration.name); !res)
+				return res;
+			m_derivedConfiguration = std::move(configuration);
+			return {};
+		}
+
+		inline const std::vector<SourceFile>& source_files() const noexcept { return m_projectConfigure.get_source_files(); }
+
+		// The steps below report their errors and go on, so a later step still runs; they
+		// return whether every step succeeded.
+		bool scrape_data()
+		{
+			bool succeeded{ true };
+			auto span = g_buildTrace.span("project_setup", "configure");
+			if (const auto res = m_projectDataScraper.project_setup(); !res) {
+				std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+				succeeded = false;
+			}
+			return select_configuration() && succeeded;
+		}
+
+		bool configure()
+		{
+			bool succeeded = scrape_data();
+			if (const auto res = m_projectConfigure.setup_project_folders(); !res) {
+				std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+				succeeded = false;
+			}
+
+			if (const auto res = m_projectConfigure.get_all_source_files(); !res) {
+				std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+				succeeded = false;
+			}
+			m_projectConfigure.create_source_cache();
+			return find_compiler() && succeeded;
+		}
+
+		bool prepare_build()
+		{
+			bool succeeded = scrape_data();
+			if (const auto res = m_projectConfigure.get_all_source_files(); !res) {
+				std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+				succeeded = false;
+			}
+			succeeded = find_compiler() && succeeded;
+
+			load_dependencies();
+			load_object_manifest();
+			load_module_graph();
+			return succeeded;
+		}
+
+		// Diffs the scanned tree against the source cache of the last successful build.
+		bool build_changes(const std::vector<std::filesystem::path>& dependencyChanges = {})
+		{
+			auto diffSpan = g_buildTrace.span("diff source cache", "cache");
+			auto res = m_projectConfigure.get_difference_source_cache();
+			diffSpan.finish();
+			if (!res) {
+				std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+				return false;
+			}
+
+			std::vector<std::filesystem::path> changedSource{};
+			for (const auto& [_, stamp, path] : *res)
+				changedSource.push_back(path);
+			return incremental_build(std::move(changedSource), m_projectConfigure.get_removed_source_files(), dependencyChanges);
+		}
+
+		// The parsed configuration, source table, dependency graph and object manifest stay
+		// in memory; only the files named by the watcher are rehashed. After a failed build
+		// the whole table is diffed again so the failing translation units are retried.
+		bool rebuild(const FileWatcher::Changes& changes, bool fullDiff)
+		{
+			const auto configFilePath = m_projectEnvironment.projectRoot / g_projectConfigureFileName;
+			if (std::ranges::find(changes.paths, configFilePath) != changes.paths.end()) {
+				// The loaded caches belong to the configuration this process started with.
+				const std::string configuration = m_projectEnvironment.projectConfiguration;
+				scrape_data();
+				if (m_projectEnvironment.projectConfiguration != configuration) {
+					std::println("WARNING: ProjectConfiguration changed, restart to build {}; still building {}.", m_projectEnvironment.projectConfiguration, configuration);
+					m_configuration = configuration;
+					select_configuration();
+				}
+			}
+
+			if (changes.rescan) {
+				if (const auto res = m_projectConfigure.get_all_source_files(); !res)
+					std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+				return build_changes();
+			}
+
+			auto refresh = m_projectConfigure.refresh_source_files(changes.paths);
+			if (fullDiff)
+				return build_changes();
+
+			std::vector<std::filesystem::path> changedSource{};
+			for (const auto& sourceFile : refresh.changed)
+				changedSource.push_back(sourceFile.path);
+			return incremental_build(std::move(changedSource), refresh.removed);
+		}
+
+		// Compiles the changed translation units, the ones including a changed or removed
+		// file and the ones whose compile command changed, then links if needed. Files that
+		// changed in a dependency only recompile the units of this project including them.
+		bool incremental_build(
+			std::vector<std::filesystem::path> diffSource,
+			const std::vector<std::filesystem::path>& removedSource,
+			const std::vector<std::filesystem::path>& dependencyChanges = {}
+		) {
+			for (auto& path : run_prebuild())
+				if (std::ranges::find(diffSource, path) == diffSource.end())
+					diffSource.push_back(std::move(path));
+
+			std::vector<std::filesystem::path> changedFiles{ diffSource };
+			changedFiles.insert(changedFiles.end(), removedSource.begin(), removedSource.end());
+			changedFiles.insert(changedFiles.end(), dependencyChanges.begin(), dependencyChanges.end());
+			m_changedFiles.clear();
+
+			// A config.toml edit only recompiles the objects whose compile command it changed.
+			auto prepareSpan = g_buildTrace.span("prepare sources", "build");
+			m_projectBuild.prepare_sources(m_projectConfigure.get_source_files(), diffSource);
+			m_projectBuild.prune_objects(m_projectConfigure.get_source_files());
+			const std::vector<std::filesystem::path> staleSource = m_projectBuild.stale_translation_units(m_projectConfigure.get_source_files());
+			prepareSpan.finish();
+			const bool dependencyChanged = !dependencyChanges.empty() && !m_projectDependencies.dependents_of(dependencyChanges).empty();
+			if (diffSource.empty() && removedSource.empty() && staleSource.empty() && !dependencyChanged && m_projectBuild.is_link_current()) {
+				std::println("INFO: No source files to compile, skipping compilation step.");
+				m_changedFiles = std::move(changedFiles);
+				return true;
+			}
+			m_projectBuild.remove_objects(removedSource);
+
+			std::unordered_set<std::string> scheduledSource{};
+			for (const auto& path : diffSource)
+				scheduledSource.insert(ProjectDependencies::key(path));
+			for (auto& path : m_projectDependencies.dependents_of(changedFiles))
+				if (scheduledSource.insert(ProjectDependencies::key(path)).second)
+					diffSource.push_back(std::move(path));
+			for (const auto& path : staleSource)
+				if (scheduledSource.insert(ProjectDependencies::key(path)).second)
+					diffSource.push_back(path);
+
+			m_objectCache.begin_build(m_projectConfigure.get_source_files());
+			const auto resScope = m_projectBuild.full_build(m_projectConfigure.get_source_files(), diffSource);
+			evict_object_cache();
+			if (!resScope) {
+				std::println("ERROR: {}({})", resScope.error().message, static_cast<int32_t>(resScope.error().code));
+				return false;
+			}
+
+			m_projectConfigure.save_source_cache();
+			save_dependencies();
+			save_object_manifest();
+			save_module_graph();
+			m_changedFiles = std::move(changedFiles);
+			return true;
+		}
+
+		// Configures the project, then builds every source that differs from the source cache.
+		bool full_build(const std::vector<std::filesystem::path>& dependencyChanges = {})
+		{
+			if (!configure())
+				return false;
+			load_dependencies();
+			load_object_manifest();
+			load_module_graph();
+			run_prebuild();
+
+			std::vector<std::filesystem::path> diffSource{};
+			auto diffSpan = g_buildTrace.span("diff source cache", "cache");
+			auto res = m_projectConfigure.get_difference_source_cache();
+			diffSpan.finish();
+			if (!res) {
+				std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+				return false;
+			}
+
+			for (const auto& sourceFile : *res)
+				diffSource.push_back(sourceFile.path);
+			std::vector<std::filesystem::path> changedFiles{ diffSource };
+			changedFiles.insert(changedFiles.end(), dependencyChanges.begin(), dependencyChanges.end());
+			m_changedFiles.clear();
+
+			// A project linking workspace dependencies goes on, so a changed library relinks it.
+			if (diffSource.empty() && dependencyChanges.empty() && m_projectBuild.link_libraries().empty())
+				return true;
+			for (auto& path : m_projectDependencies.dependents_of(dependencyChanges))
+				if (std::ranges::find(diffSource, path) == diffSource.end())
+					diffSource.push_back(std::move(path));
+
+			auto prepareSpan = g_buildTrace.span("prepare sources", "build");
+			m_projectBuild.reset_unity_isolation();
+			m_projectBuild.prepare_sources(m_projectConfigure.get_source_files());
+			prepareSpan.finish();
+			m_objectCache.begin_build(m_projectConfigure.get_source_files());
+			const auto resScope = m_projectBuild.full_build(m_projectConfigure.get_source_files(), diffSource);
+			if (!resScope)
+				std::println("ERROR: {}({})", resScope.error().message, static_cast<int32_t>(resScope.error().code));
+			evict_object_cache();
+			m_projectConfigure.save_source_cache();
+			save_dependencies();
+			save_object_manifest();
+			save_module_graph();
+			if (resScope)
+				m_changedFiles = std::move(changedFiles);
+			return resScope.has_value();
+		}
+
+	private:
+		bool select_configuration()
+		{
+			const std::string name = m_configuration.value_or(m_projectStatistics.projectConfiguration);
+			m_projectStatistics.activeConfiguration = {};
+			if (!name.empty()) {
+				if (auto configuration = m_projectStatistics.find_configuration(name))
+					m_projectStatistics.activeConfiguration = std::move(*configuration);
+				else {
+					std::println("WARNING: Configuration {} is not declared, building it without extra flags.", name);
+					m_projectStatistics.activeConfiguration.name = name;
+				}
+			}
+
+			auto& active = m_projectStatistics.activeConfiguration;
+			if (m_derivedConfiguration) {
+				const auto append = [](std::vector<std::string>& flags, const std::vector<std::string>& extraFlags) {
+					flags.insert(flags.end(), extraFlags.begin(), extraFlags.end());
+				};
+				active.name = m_derivedConfiguration->name;
+				append(active.cppCompilerFlags, m_derivedConfiguration->cppCompilerFlags);
+				append(active.msvcCompilerFlags, m_derivedConfiguration->msvcCompilerFlags);
+				append(active.projectLinkerFlags, m_derivedConfiguration->projectLinkerFlags);
+			}
+			if (const auto res = m_projectEnvironment.set_configuration(active.name); !res) {
+				std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+				return false;
+			}
+			if (active.name.empty())
+				return true;
+
+			// A configuration can be built before --configure ever saw it.
+			std::error_code errorCode{};
+			std::filesystem::create_directories(m_projectEnvironment.projectConfigurationCachePath, errorCode);
+			std::filesystem::create_directories(m_projectEnvironment.projectBinaryFolderPath, errorCode);
+			return true;
+		}
+
+		bool find_compiler()
+		{
+#ifdef _WIN32
+			const auto res = m_projectConfigure.where_is_cl();
+#else
+			const auto res = m_projectConfigure.where_is_compiler();
+#endif
+			if (!res)
+				std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+			return res.has_value();
+		}
+
+		// Sources the prebuild script generated or rewrote are rehashed into the source
+		// table, so they are compiled and cached like scanned ones.
+		std::vector<std::filesystem::path> run_prebuild()
+		{
+			std::vector<std::filesystem::path> changedSource{};
+			const auto outputs = m_projectBuild.prebuild(m_projectConfigure.get_source_files());
+			if (outputs.empty())
+				return changedSource;
+
+			for (const auto& sourceFile : m_projectConfigure.refresh_source_files(outputs).changed)
+				changedSource.push_back(sourceFile.path);
+			return changedSource;
+		}
+
+		void load_dependencies() {
+			auto span = g_buildTrace.span("load dependency graph", "cache");
+			if (const auto res = m_projectDependencies.load(); !res)
+				std::println("WARNING: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+		}
+
+		void save_dependencies() {
+			auto span = g_buildTrace.span("save dependency graph", "cache");
+			if (const auto res = m_projectDependencies.save(); !res)
+				std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+		}
+
+		void load_object_manifest() {
+			auto span = g_buildTrace.span("load object manifest", "cache");
+			if (const auto res = m_objectManifest.load(); !res)
+				std::println("WARNING: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+		}
+
+		void save_object_manifest() {
+			auto span = g_buildTrace.span("save object manifest", "cache");
+			if (const auto res = m_objectManifest.save(); !res)
+				std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+		}
+
+		void load_module_graph() {
+			auto span = g_buildTrace.span("load module graph", "cache");
+			if (const auto res = m_moduleGraph.load(); !res)
+				std::println("WARNING: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+		}
+
+		void save_module_graph() {
+			auto span = g_buildTrace.span("save module graph", "cache");
+			if (const auto res = m_moduleGraph.save(); !res)
+				std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+		}
+
+		void evict_object_cache() {
+			auto span = g_buildTrace.span("evict object cache", "cache");
+			if (const auto res = m_objectCache.evict(); !res)
+				std::println("WARNING: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+		}
+
+	private:
+		ProjectEnvironment m_projectEnvironment{};
+		ProjectStatistics m_projectStatistics{};
+
+		ProjectDependencies m_projectDependencies{ &m_projectEnvironment };
+		ObjectManifest m_objectManifest{ &m_projectEnvironment };
+		ObjectCache m_objectCache{ &m_projectEnvironment, &m_projectStatistics };
+		ModuleGraph m_moduleGraph{ &m_projectEnvironment };
+
+		ProjectDataScraper m_projectDataScraper{ &m_projectEnvironment, &m_projectStatistics };
+		ProjectConfigure m_projectConfigure;
+		ProjectBuild m_projectBuild;
+
+		std::optional<std::string> m_configuration{};
+		std::optional<BuildConfiguration> m_derivedConfiguration{};
+		std::vector<std::filesystem::path> m_changedFiles{};
+	};
+}
@@ -6,16 +6,29 @@
 #include <string_view>  
 #include <vector>  
 #include <iostream>
+#include <unordered_set>
+#include <chrono>
 
 #include <gsl/gsl>
 
 #include <boost/program_options.hpp>
 
 #include "Util.hpp"
+#include "JobPool.hpp"
 #include "ProjectData.hpp"
 #include "ProjectDataScraper.hpp"
 #include "ProjectConfigure.hpp"
+#include "ProjectDependencies.hpp"
+#include "ObjectManifest.hpp"
+#include "ObjectCache.hpp"
+#include "ModuleGraph.hpp"
 #include "ProjectBuild.hpp"
+#include "ProjectSession.hpp"
+#include "Workspace.hpp"
+#include "ProfileGuidedBuild.hpp"
+#include "FileWatcher.hpp"
+#include "BuildDaemon.hpp"
+#include "BuildTrace.hpp"
 
 namespace NeoShafa {
     using namespace boost;
@@ -36,12 +49,11 @@ namespace NeoShafa {
                 m_cmdArgs.emplace_back(gsl::at(spanArgs, i));
             }
 
-            m_projectEnvironment.neoShafaPath = m_cmdArgs.at(0);
-			m_projectStatistics.projectCompilationData = m_projectCompilationData;
-            m_projectDataScraper = { &m_projectEnvironment, &m_projectStatistics };
+            m_projectSession.environment().neoShafaPath = m_cmdArgs.at(0);
         }
 
         Core::ExpectedVoid run() {
+            const auto parseBegin = BuildTrace::Clock::now();
             try {
                 auto addOptions = m_description.add_options();
                 addOptions("help,h", "Produce help message.");
@@ -49,8 +61,42 @@ namespace NeoShafa {
                 addOptions("configure,c", "Configure the application.");
 				addOptions("build,b", "Build the project.");
 				addOptions("full_build,B", "Build the project.");
+				addOptions("watch,w", "Build the project, then rebuild it whenever project files change.");
+				addOptions("server", "Keep the project loaded and serve --build requests from a background process.");
+				addOptions("local", "Build in this process even if a build server is running.");
+				addOptions("pgo", "Build instrumented, run ProjectPgoTraining, then build with the profile and LTO.");
 				addOptions("compilers", "List available compilers.");
 				addOptions("targets", "List available targets.");
+				addOptions(
+                    "config",
+                    program_options::value<std::string>(),
+                    "Named configuration to build, like Debug or Release, instead of the ProjectConfiguration of config.toml."
+                );
+				addOptions(
+                    "jobs,j",
+                    program_options::value<uint32_t>()->default_value(JobPool::default_worker_count()),
+                    "Number of translation units compiled in parallel."
+                );
+				addOptions(
+                    "debounce",
+                    program_options::value<uint32_t>()->default_value(100),
+                    "Milliseconds of quiet after a change before --watch rebuilds."
+                );
+				addOptions(
+                    "idle_timeout",
+                    program_options::value<uint32_t>()->default_value(600),
+                    "Seconds without requests before --server shuts down."
+                );
+				addOptions(
+                    "trace",
+                    program_options::value<std::string>(),
+                    "Write a Chrome trace-event timeline of the build to this file, builds locally."
+                );
+				addOptions(
+                    "time_report",
+                    program_options::value<uint32_t>()->implicit_value(10),
+                    "Compile with Clang's -ftime-trace and list the N most expensive headers, template instantiations and translation units, builds locally."
+                );
 
                 program_options::store(
                     program_options::command_line_parser(m_cmdArgs)
@@ -58,16 +104,32 @@ namespace NeoShafa {
                     .run(),
                     m_variableMap
                 );
+                check_trace(parseBegin);
 
                 check_help();
                 check_version();
-                check_configure();
+                check_jobs();
+                check_config();
+                check_time_report();
+                if (Workspace::is_workspace(m_projectSession.environment().projectRoot))
+                    check_workspace();
+                else {
+                    check_configure();
 
-                // TODO: without config there is no sourcecache, so there is memory error.
-                check_build();
-                check_full_build();
+                    // TODO: without config there is no sourcecache, so there is memory error.
+                    check_build();
+                    check_full_build();
+                    check_pgo();
+                    check_watch();
+                    check_server();
+                }
+                write_trace();
 
                 program_options::notify(m_variableMap);
+                if (!m_succeeded)
+                    return std::unexpected(
+                        Core::make_error(Core::ErrorCode::GenericBuildError, "Not every requested step succeeded.")
+                    );
             }
             catch (const program_options::error& exception) {
                 // TODO: Add more errors to the enum, for now just print error.
@@ -99,6 +161,55 @@ namespace NeoShafa {
             }
 		}
 
+        void check_trace(BuildTrace::Clock::time_point parseBegin) {
+            if (!m_variableMap.count("trace"))
+                return;
+            g_buildTrace.start(std::filesystem::absolute(m_variableMap.at("trace").as<std::string>()));
+            g_buildTrace.record({ "parse command line", "cli" }, parseBegin, BuildTrace::Clock::now());
+        }
+
+        void write_trace() {
+            if (const auto res = g_buildTrace.write(); !res)
+                std::println("WARNING: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+        }
+
+        void check_time_report() {
+            if (m_variableMap.count("time_report"))
+                m_projectSession.build().set_time_trace(true);
+        }
+
+        void print_time_report() {
+            if (!m_variableMap.count("time_report"))
+                return;
+            if (!m_projectSession.build().uses_time_trace()) {
+                std::println("WARNING: --time_report needs Clang, no time trace was recorded.");
+                return;
+            }
+
+            size_t missingTraces{};
+            const TimeTraceReport report = m_projectSession.build().time_trace_report(missingTraces);
+            std::println("TIME REPORT: {} translation unit(s) traced.", report.size());
+            if (missingTraces != 0)
+                std::println("INFO: {} translation unit(s) were not compiled with -ftime-trace, rebuild them to include them.", missingTraces);
+            std::print("{}", report.format(m_variableMap.at("time_report").as<uint32_t>()));
+        }
+
+        void check_jobs() {
+            if (m_variableMap.count("jobs")) {
+                m_jobPool.start(m_variableMap.at("jobs").as<uint32_t>());
+                g_processEngine.set_max_running(m_variableMap.at("jobs").as<uint32_t>());
+            }
+        }
+
+        void check_config() {
+            if (!m_variableMap.count("config"))
+                return;
+            if (const auto res = m_projectSession.set_configuration(m_variableMap.at("config").as<std::string>()); !res) {
+                std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+                exit(static_cast<int32_t>(res.error().code));
+            }
+        }
+
         void check_compilers() {
             if (m_variableMap.count("compilers")) {
                 //m_projectDataScraper.print_available_compilers();
@@ -106,91 +217,161 @@ namespace NeoShafa {
             }
 		}
 
-        void scrape_data()
+        void check_configure() {
+            if (m_variableMap.count("configure") && !m_projectSession.configure())
+                m_succeeded = false;
+        }
+
+        void check_build()
         {
-            if (const auto res = m_projectDataScraper.project_setup(); !res)
-                std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+            if (m_variableMap.count("build"))
+            {
+                // Tracing happens in this process, a forwarded build would not be traced.
+                if (!m_variableMap.count("local") && !m_variableMap.count("trace") && !m_variableMap.count("time_report"))
+                    if (const auto exitCode = Daemon::request(Daemon::socket_path(m_projectSession.environment()), Daemon::g_buildRequest))
+                        exit(*exitCode);
+
+                if (!m_projectSession.prepare_build() || !build_changes())
+                    m_succeeded = false;
+            }
         }
-        void configure()
+
+        void check_watch()
         {
-            scrape_data();
-            if (const auto res = m_projectConfigure.setup_project_folders(); !res)
+            if (!m_variableMap.count("watch"))
+                return;
+
+            const ProjectEnvironment& projectEnvironment = m_projectSession.environment();
+            m_projectSession.prepare_build();
+            bool succeeded = build_changes();
+
+            FileWatcher fileWatcher{};
+            if (const auto res = fileWatcher.start(
+                projectEnvironment.projectRoot,
+                { projectEnvironment.projectCachePath, projectEnvironment.projectRoot / g_projectBinaryFolderName }
+            ); !res) {
                 std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+                return;
+            }
 
-            if (const auto res = m_projectConfigure.get_all_source_files(); !res)
+            const auto debounce = std::chrono::milliseconds{ m_variableMap.at("debounce").as<uint32_t>() };
+            std::println("INFO: Watching {} for changes.", projectEnvironment.projectRoot.string());
+
+            write_trace();
+            while (true) {
+                succeeded = rebuild(fileWatcher.wait(debounce), !succeeded);
+                write_trace();
+            }
+        }
+
+        void check_server()
+        {
+            if (!m_variableMap.count("server"))
+                return;
+
+            const ProjectEnvironment& projectEnvironment = m_projectSession.environment();
+            const std::filesystem::path socketPath = Daemon::socket_path(projectEnvironment);
+            Daemon::Server server{};
+            if (const auto res = server.listen(socketPath); !res) {
                 std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
-            m_projectConfigure.create_source_cache();
-#ifdef _WIN32
-            if (const auto res = m_projectConfigure.where_is_cl(); !res)
+                exit(static_cast<int32_t>(res.error().code));
+            }
+
+            m_projectSession.prepare_build();
+
+            FileWatcher fileWatcher{};
+            if (const auto res = fileWatcher.start(
+                projectEnvironment.projectRoot,
+                { projectEnvironment.projectCachePath, projectEnvironment.projectRoot / g_projectBinaryFolderName }
+            ); !res) {
                 std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
-#endif
+                return;
+            }
+
+            std::println("INFO: Build server listening on {}.", socketPath.string());
+            std::fflush(stdout);
+
+            // Nothing has been built by this process yet, so the first request diffs against
+            // the source cache on disk; later ones only rehash what the watcher reported.
+            bool succeeded{ false };
+            server.serve(
+                std::chrono::seconds{ m_variableMap.at("idle_timeout").as<uint32_t>() },
+                [&](std::string_view request) -> int32_t {
+                    if (request != Daemon::g_buildRequest) {
+                        std::println("ERROR: Unknown build server request: {}", request);
+                        return static_cast<int32_t>(Core::ErrorCode::BuildServerError);
+                    }
+                    succeeded = rebuild(fileWatcher.drain(), !succeeded);
+                    write_trace();
+                    return succeeded ? 0 : static_cast<int32_t>(Core::ErrorCode::GenericBuildError);
+                }
+            );
         }
 
-        void check_configure() {
-            if (m_variableMap.count("configure"))
-                configure();
+        bool build_changes() {
+            const bool succeeded = m_projectSession.build_changes();
+            if (succeeded)
+                print_time_report();
+            return succeeded;
         }
 
-        void check_build()
+        bool rebuild(const FileWatcher::Changes& changes, bool fullDiff) {
+            const bool succeeded = m_projectSession.rebuild(changes, fullDiff);
+            if (succeeded)
+                print_time_report();
+            return succeeded;
+        }
+
+        // Workspace members are built in this process, one thread per member, so
+        // --configure, --build and --full_build apply to all of them.
+        void check_workspace()
         {
-            if (m_variableMap.count("build"))
-            {
-                scrape_data();
-                if (const auto res = m_projectConfigure.get_all_source_files(); !res)
-                    std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
-#ifdef _WIN32
-                if (const auto res = m_projectConfigure.where_is_cl(); !res)
+            Workspace workspace{ m_projectSession.environment().projectRoot, &m_jobPool };
+            if (const auto res = workspace.load(); !res) {
+                std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+                exit(static_cast<int32_t>(res.error().code));
+            }
+            if (m_variableMap.count("config"))
+                if (const auto res = workspace.set_configuration(m_variableMap.at("config").as<std::string>()); !res) {
                     std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
-#endif
-
-                std::vector<std::filesystem::path> diffSource{};
-                auto res = m_projectConfigure.get_difference_source_cache();
-                if (!res) std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
-                
-                if (res->empty()) {
-                    std::println("INFO: No source files to compile, skipping compilation step.");
-                    return; 
-                };
-                const auto tomlConfigPath = std::filesystem::current_path() / "config.toml";
-                for (const auto& [_, path] : *res) {
-                    if (path == tomlConfigPath)
-                    {
-                        std::println("INFO: config.toml changed, doing full rebuild.");
-
-                        m_projectConfigure.clean_source_cache();
-                        diffSource.clear();
-
-                        auto source = m_projectConfigure.get_source_files();
-                        for (const auto& [_, path] : source)
-                            diffSource.push_back(path);
-
-                        std::erase(diffSource, tomlConfigPath);
-                        break;
-                    }
-                    else
-                        diffSource.push_back(path);
+                    exit(static_cast<int32_t>(res.error().code));
                 }
-                if (const auto resScope = m_projectBuild.full_build(diffSource); !resScope)
-                    std::println("ERROR: {}({})", resScope.error().message, static_cast<int32_t>(resScope.error().code));
-                else
-                    m_projectConfigure.save_source_cache();
+            if (m_variableMap.count("watch") || m_variableMap.count("server") || m_variableMap.count("time_report") || m_variableMap.count("pgo"))
+                std::println("WARNING: --watch, --server, --time_report and --pgo work on single projects, not on workspaces.");
+
+            bool succeeded{ true };
+            if (m_variableMap.count("configure"))
+                succeeded = workspace.run(Workspace::Mode::Configure) && succeeded;
+            if (m_variableMap.count("build"))
+                succeeded = workspace.run(Workspace::Mode::Build) && succeeded;
+            if (m_variableMap.count("full_build"))
+                succeeded = workspace.run(Workspace::Mode::FullBuild) && succeeded;
+            if (!succeeded) {
+                std::println("ERROR: Not every member of the workspace was built.");
+                m_succeeded = false;
             }
         }
 
         void check_full_build() {
-            if (m_variableMap.count("full_build"))
-            {
-                configure();
-                std::vector<std::filesystem::path> diffSource{};
-                auto res = m_projectConfigure.get_difference_source_cache();
-                if (!res) std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+            if (!m_variableMap.count("full_build"))
+                return;
+            if (m_projectSession.full_build())
+                print_time_report();
+            else
+                m_succeeded = false;
+        }
 
-                if (res->empty()) return;
-                for (const auto& [_, path] : *res)
-                    diffSource.push_back(path);
-                if (const auto resScope = m_projectBuild.full_build(diffSource); !resScope)
-                    std::println("ERROR: {}({})", resScope.error().message, static_cast<int32_t>(resScope.error().code));
-                m_projectConfigure.save_source_cache();
+        void check_pgo()
+        {
+            if (!m_variableMap.count("pgo"))
+                return;
+
+            ProfileGuidedBuild profileGuidedBuild{ m_projectSession.environment().projectRoot, &m_jobPool };
+            if (m_variableMap.count("config"))
+                profileGuidedBuild.set_configuration(m_variableMap.at("config").as<std::string>());
+            if (const auto res = profileGuidedBuild.run(); !res) {
+                std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+                exit(static_cast<int32_t>(res.error().code));
             }
         }
 
@@ -200,12 +381,11 @@ namespace NeoShafa {
         program_options::options_description m_description{ "Allowed options" };
         program_options::variables_map m_variableMap{};
 
-		ProjectCompilationData m_projectCompilationData{};
-        ProjectEnvironment m_projectEnvironment{};
-        ProjectStatistics m_projectStatistics{};
+        JobPool m_jobPool{};
+
+        // Cleared by a failed step, turned into the exit status by run().
+        bool m_succeeded{ true };
 
-        ProjectDataScraper m_projectDataScraper{ &m_projectEnvironment, &m_projectStatistics };
-        ProjectConfigure m_projectConfigure{ &m_projectEnvironment, &m_projectStatistics };
-        ProjectBuild m_projectBuild{ &m_projectEnvironment, &m_projectStatistics };
+        ProjectSession m_projectSession{ std::filesystem::path{}, &m_jobPool };
     };
 }
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Util.hpp"
+#include "ProjectData.hpp"
+
+namespace NeoShafa {
+	// A Lua build step with the files it declares in config.toml. Entries are paths relative
+	// to the project root, directories standing for every file below them, or patterns as
+	// Util::glob_match reads them.
+	struct ScriptStep {
+		std::string_view name{};
+		std::filesystem::path script{};
+		const std::vector<std::string>* inputs{};
+		const std::vector<std::string>* outputs{};
+
+		inline bool is_declared() const noexcept {
+			return (inputs && !inputs->empty()) || (outputs && !outputs->empty());
+		}
+	};
+
+	// What every declared step last read and wrote. A step is current when its script, its
+	// declarations and the content of every input hash the same as on its last successful
+	// run and every output it wrote is still there, unchanged.
+	class ScriptStepCache {
+	public:
+		struct Record {
+			ContentHash::Digest inputDigest{};
+			std::vector<std::pair<std::filesystem::path, ContentHash::Digest>> outputs{};
+		};
+
+	public:
+		ScriptStepCache() = default;
+		~ScriptStepCache() = default;
+
+		inline explicit ScriptStepCache(const ProjectEnvironment* projectEnvironment) noexcept :
+			m_projectEnvironment(projectEnvironment) {}
+
+		// Inputs that are scanned sources reuse the hash of the source table.
+		inline Core::Expected<ContentHash::Digest> input_digest(
+			const ScriptStep& step,
+			const std::vector<SourceFile>& sourceFiles
+		) const {
+			std::string signature{ step.name };
+			const auto scriptDigest = file_digest(step.script, sourceFiles);
+			if (!scriptDigest) return std::unexpected(scriptDigest.error());
+			signature.append(1, '\0').append(step.script.generic_string()).append(1, '\0').append(scriptDigest->to_string());
+
+			for (const auto* declarations : { step.inputs, step.outputs }) {
+				signature.append(1, '\n');
+				if (declarations)
+					for (const auto& declaration : *declarations)
+						signature.append(1, '\0').append(declaration);
+			}
+
+			if (step.inputs)
+				for (const auto& input : expand(*step.inputs)) {
+					const auto digest = file_digest(input, sourceFiles);
+					if (!digest) return std::unexpected(digest.error());
+					signature.append(1, '\0').append(input.generic_string()).append(1, '\0').append(digest->to_string());
+				}
+
+			return ContentHash::hash(signature);
+		}
+
+		inline bool is_current(
+			const ScriptStep& step,
+			const ContentHash::Digest& inputDigest,
+			const std::vector<SourceFile>& sourceFiles
+		) {
+			load();
+			const auto it = m_records.find(std::string{ step.name });
+			if (it == m_records.end() || it->second.inputDigest != inputDigest)
+				return false;
+
+			const auto outputs = step.outputs ? expand(*step.outputs) : std::vector<std::filesystem::path>{};
+			if (outputs.size() != it->second.outputs.size())
+				return false;
+			for (size_t i = 0; i < outputs.size(); ++i) {
+				if (outputs[i] != it->second.outputs[i].first)
+					return false;
+				const auto digest = file_digest(outputs[i], sourceFiles);
+				if (!digest || *digest != it->second.outputs[i].second)
+					return false;
+			}
+			return true;
+		}
+
+		// Hashes what the step wrote. Returns the outputs whether or not they could be
+		// recorded, since the step ran either way.
+		inline std::vector<std::filesystem::path> record(const ScriptStep& step, const ContentHash::Digest& inputDigest)
+		{
+			load();
+			const auto outputs = step.outputs ? expand(*step.outputs) : std::vector<std::filesystem::path>{};
+
+			Record record{ inputDigest };
+			for (const auto& output : outputs) {
+				const auto digest = Util::hash(output);
+				if (!digest) {
+					std::println("WARNING: {}({})", digest.error().message, static_cast<int32_t>(digest.error().code));
+					forget(step);
+					return outputs;
+				}
+				record.outputs.emplace_back(output, *digest);
+			}
+
+			m_records.insert_or_assign(std::string{ step.name }, std::move(record));
+			save();
+			return outputs;
+		}
+
+		// A failed run leaves its outputs in an unknown state, so the step runs next time.
+		inline void forget(const ScriptStep& step)
+		{
+			load();
+			if (m_records.erase(std::string{ step.name }) != 0)
+				save();
+		}
+
+		inline std::vector<std::filesystem::path> expand(const std::vector<std::string>& declarations) const
+		{
+			std::vector<std::filesystem::path> files{};
+			const std::filesystem::path& projectRoot = m_projectEnvironment->projectRoot;
+			for (const auto& declaration : declarations) {
+				const size_t wildcard = declaration.find_first_of("*?");
+				if (wildcard == std::string::npos) {
+					const std::filesystem::path path = (projectRoot / declaration).lexically_normal();
+					std::error_code errorCode{};
+					if (std::filesystem::is_directory(path, errorCode))
+						walk(path, [&](const std::filesystem::path& file) { files.push_back(file); });
+					else
+						files.push_back(path);
+					continue;
+				}
+
+				// Only the directory before the first wildcard is walked.
+				const size_t slash = declaration.rfind('/', wildcard);
+				const std::filesystem::path base = slash == std::string::npos ? projectRoot : projectRoot / declaration.substr(0, slash);
+				walk(base.lexically_normal(), [&](const std::filesystem::path& file) {
+					if (Util::glob_match(declaration, file.lexically_relative(projectRoot).generic_string()))
+						files.push_back(file);
+				});
+			}
+
+			std::ranges::sort(files);
+			files.erase(std::unique(files.begin(), files.end()), files.end());
+			return files;
+		}
+
+	private:
+		inline static Core::Expected<ContentHash::Digest> file_digest(
+			const std::filesystem::path& path,
+			const std::vector<SourceFile>& sourceFiles
+		) {
+			const auto it = std::ranges::lower_bound(sourceFiles, path, {}, &SourceFile::path);
+			if (it != sourceFiles.end() && it->path == path)
+				return it->hash;
+			return Util::hash(path);
+		}
+
+		// The cache folder is never an input or an output.
+		template <typename Function>
+		inline void walk(const std::filesystem::path& directory, Function&& function) const
+		{
+			std::error_code errorCode{};
+			std::filesystem::recursive_directory_iterator it{ directory, std::filesystem::directory_options::skip_permission_denied, errorCode };
+			for (; !errorCode && it != std::filesystem::recursive_directory_iterator{}; it.increment(errorCode)) {
+				if (it->is_directory(errorCode) && it->path() == m_projectEnvironment->projectCachePath) {
+					it.disable_recursion_pending();
+					continue;
+				}
+				if (it->is_regular_file(errorCode))
+					function(it->path());
+			}
+		}
+
+		inline std::filesystem::path cache_file_path() const {
+			return m_projectEnvironment->projectConfigurationCachePath / g_projectScriptStepCacheFileName;
+		}
+
+		// "step <input digest> <output count> <name>", then "<digest> <path>" per output.
+		inline void load()
+		{
+			if (m_loaded)
+				return;
+			m_loaded = true;
+
+			auto res = Util::read(cache_file_path());
+			if (!res || res->empty() || res->front() != m_header)
+				return;
+
+			for (size_t i = 1; i < res->size(); ++i) {
+				const std::string_view line{ (*res)[i] };
+				if (!line.starts_with("step "))
+					continue;
+
+				const size_t countBegin = line.find(' ', 5);
+				const size_t nameBegin = countBegin == std::string_view::npos ? countBegin : line.find(' ', countBegin + 1);
+				if (nameBegin == std::string_view::npos)
+					return;
+				const auto inputDigest = ContentHash::Digest::from_string(line.substr(5, countBegin - 5));
+				size_t outputCount{};
+				const std::string_view count = line.substr(countBegin + 1, nameBegin - countBegin - 1);
+				if (!inputDigest || std::from_chars(count.data(), count.data() + count.size(), outputCount).ec != std::errc{} || i + outputCount >= res->size())
+					return;
+
+				Record record{ *inputDigest };
+				for (size_t j = 0; j < outputCount; ++j) {
+					const std::string_view output{ (*res)[++i] };
+					const auto digest = ContentHash::Digest::from_string(output.substr(0, std::min<size_t>(output.size(), 32)));
+					if (!digest || output.size() < 34)
+						return;
+					record.outputs.emplace_back(std::filesystem::path{ output.substr(33) }, *digest);
+				}
+				m_records.insert_or_assign(std::string{ line.substr(nameBegin + 1) }, std::move(record));
+			}
+		}
+
+		inline void save() const
+		{
+			std::string content{ m_header };
+			content.push_back('\n');
+			for (const auto& [name, record] : m_records) {
+				content.append(std::format("step {} {} {}\n", record.inputDigest.to_string(), record.outputs.size(), name));
+				for (const auto& [output, digest] : record.outputs)
+					content.append(std::format("{} {}\n", digest.to_string(), output.string()));
+			}
+
+			if (const auto res = Util::write_atomic(cache_file_path(), content); !res)
+				std::println("WARNING: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+		}
+
+	private:
+		const ProjectEnvironment* m_projectEnvironment{};
+
+		constexpr static std::string_view m_header{ "NeoShafaScriptSteps 1" };
+
+		bool m_loaded{ false };
+		std::unordered_map<std::string, Record> m_records{};
+	};
+}
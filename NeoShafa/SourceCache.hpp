@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Util.hpp"
+#include "ContentHash.hpp"
+#include "ProjectData.hpp"
+
+namespace NeoShafa {
+	// Binary source.cache. Layout, in host byte order:
+	//   Header | Entry[entryCount] | uint32_t index[indexSize] | path string table
+	// The index is an open-addressing table over the path hashes holding entry + 1,
+	// zero marks an empty slot. The file is mapped and queried in place.
+	class SourceCache {
+	public:
+		struct Header {
+			uint32_t magic{};
+			uint32_t version{};
+			uint64_t entryCount{};
+			uint64_t indexSize{};
+			uint64_t stringTableSize{};
+		};
+
+		struct Entry {
+			uint64_t digestLow{};
+			uint64_t digestHigh{};
+			int64_t modificationTime{};
+			uint64_t size{};
+			uint64_t inode{};
+			uint64_t pathHash{};
+			uint64_t pathOffset{};
+			uint64_t pathLength{};
+		};
+
+		static_assert(sizeof(Header) == 32 && sizeof(Entry) == 64, "SourceCache records must stay packed.");
+
+	public:
+		SourceCache() = default;
+
+		inline static Core::Expected<SourceCache> open(const std::filesystem::path& path)
+		{
+			auto mappedFile = Util::MappedFile::open(path);
+			if (!mappedFile)
+				return std::unexpected(mappedFile.error());
+
+			SourceCache sourceCache{};
+			sourceCache.m_file = std::move(mappedFile.value());
+
+			const auto bytes = sourceCache.m_file.bytes();
+			if (bytes.size() < sizeof(Header))
+				return std::unexpected(format_error(path, "file is truncated"));
+
+			std::memcpy(&sourceCache.m_header, bytes.data(), sizeof(Header));
+			const Header& header = sourceCache.m_header;
+			if (header.magic != m_magic || header.version != m_version)
+				return std::unexpected(format_error(path, "unknown format"));
+
+			if (header.entryCount >= std::numeric_limits<uint32_t>::max() ||
+				!std::has_single_bit(header.indexSize) || header.indexSize <= header.entryCount ||
+				header.indexSize > bytes.size() / sizeof(uint32_t))
+				return std::unexpected(format_error(path, "corrupted header"));
+
+			const uint64_t entriesOffset = sizeof(Header);
+			const uint64_t indexOffset = entriesOffset + header.entryCount * sizeof(Entry);
+			const uint64_t stringTableOffset = indexOffset + header.indexSize * sizeof(uint32_t);
+			if (header.entryCount > bytes.size() / sizeof(Entry) ||
+				stringTableOffset + header.stringTableSize != bytes.size())
+				return std::unexpected(format_error(path, "size mismatch"));
+
+			sourceCache.m_entries = bytes.data() + entriesOffset;
+			sourceCache.m_index = bytes.data() + indexOffset;
+			sourceCache.m_strings = reinterpret_cast<const char*>(bytes.data() + stringTableOffset);
+
+			for (size_t i = 0; i < sourceCache.size(); ++i) {
+				const Entry entry = sourceCache.entry(i);
+				if (entry.pathOffset > header.stringTableSize || entry.pathLength > header.stringTableSize - entry.pathOffset)
+					return std::unexpected(format_error(path, "path out of range"));
+			}
+
+			return sourceCache;
+		}
+
+		inline static std::string serialize(const std::vector<SourceFile>& sourceFiles)
+		{
+			Header header{ m_magic, m_version, sourceFiles.size(), index_size_for(sourceFiles.size()), 0 };
+
+			std::vector<Entry> entries{};
+			entries.reserve(sourceFiles.size());
+			std::vector<uint32_t> index(header.indexSize, 0);
+			std::string strings{};
+
+			for (const auto& [hash, stamp, path] : sourceFiles) {
+				const std::string pathString = path.string();
+				const Entry entry{
+					hash.low, hash.high,
+					stamp.modificationTime, stamp.size, stamp.inode,
+					path_hash(pathString), strings.size(), pathString.size()
+				};
+				strings.append(pathString);
+
+				for (uint64_t slot = entry.pathHash & (header.indexSize - 1);; slot = (slot + 1) & (header.indexSize - 1))
+					if (index[slot] == 0) {
+						index[slot] = static_cast<uint32_t>(entries.size() + 1);
+						break;
+					}
+				entries.push_back(entry);
+			}
+			header.stringTableSize = strings.size();
+
+			std::string buffer{};
+			buffer.reserve(sizeof(Header) + entries.size() * sizeof(Entry) + index.size() * sizeof(uint32_t) + strings.size());
+			buffer.append(reinterpret_cast<const char*>(&header), sizeof(Header));
+			buffer.append(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(Entry));
+			buffer.append(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(uint32_t));
+			buffer.append(strings);
+
+			return buffer;
+		}
+
+		inline static Core::ExpectedVoid save(const std::filesystem::path& path, const std::vector<SourceFile>& sourceFiles) {
+			return Util::write_atomic(path, serialize(sourceFiles));
+		}
+
+	public:
+		inline size_t size() const noexcept { return static_cast<size_t>(m_header.entryCount); }
+
+		inline std::optional<size_t> find(std::string_view path) const
+		{
+			if (size() == 0) return std::nullopt;
+
+			const uint64_t pathHash = path_hash(path);
+			const uint64_t mask = m_header.indexSize - 1;
+			for (uint64_t slot = pathHash & mask, probes = 0; probes < m_header.indexSize; slot = (slot + 1) & mask, ++probes) {
+				uint32_t value{};
+				std::memcpy(&value, m_index + slot * sizeof(uint32_t), sizeof(uint32_t));
+				if (value == 0 || value > size())
+					return std::nullopt;
+
+				const Entry candidate = entry(value - 1);
+				if (candidate.pathHash == pathHash && path_of(candidate) == path)
+					return value - 1;
+			}
+			return std::nullopt;
+		}
+
+		inline ContentHash::Digest digest_of(size_t index) const {
+			const Entry record = entry(index);
+			return { record.digestLow, record.digestHigh };
+		}
+
+		inline Util::FileStamp stamp_of(size_t index) const {
+			const Entry record = entry(index);
+			return { record.modificationTime, record.size, record.inode };
+		}
+
+		inline std::string_view path_of(size_t index) const { return path_of(entry(index)); }
+
+		inline SourceFile source_file(size_t index) const {
+			return { digest_of(index), stamp_of(index), std::filesystem::path{ path_of(index) } };
+		}
+
+	private:
+		inline Entry entry(size_t index) const noexcept
+		{
+			Entry record{};
+			std::memcpy(&record, m_entries + index * sizeof(Entry), sizeof(Entry));
+			return record;
+		}
+
+		inline std::string_view path_of(const Entry& record) const noexcept {
+			return { m_strings + record.pathOffset, static_cast<size_t>(record.pathLength) };
+		}
+
+		inline static uint64_t path_hash(std::string_view path) noexcept {
+			return ContentHash::hash(path).low;
+		}
+
+		// At most half full, so probe chains stay short and always reach an empty slot.
+		inline static uint64_t index_size_for(size_t entryCount) noexcept {
+			return std::bit_ceil(std::max<uint64_t>(entryCount * 2, 16));
+		}
+
+		inline static Core::Error format_error(const std::filesystem::path& path, std::string_view reason) {
+			return Core::make_error(
+				Core::ErrorCode::ReadingProjectCahedSourceError,
+				std::format("Source cache {} is not usable: {}.", path.string(), reason)
+			);
+		}
+
+	private:
+		Util::MappedFile m_file{};
+		Header m_header{};
+
+		const std::byte* m_entries{};
+		const std::byte* m_index{};
+		const char* m_strings{};
+
+		constexpr static uint32_t m_magic{ 0x4353534E }; // "NSSC"
+		constexpr static uint32_t m_version{ 1 };
+	};
+}
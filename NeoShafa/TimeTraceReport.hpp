@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Util.hpp"
+#include "Json.hpp"
+
+namespace NeoShafa {
+	// Merges the -ftime-trace files Clang writes next to every object into one summary:
+	// headers by total parse time across translation units, template instantiations by
+	// total time, and the slowest translation units. Header and instantiation times are
+	// inclusive, so a header's time also counts the headers it includes.
+	class TimeTraceReport {
+	public:
+		struct Entry {
+			std::string name{};
+			double milliseconds{};
+			uint64_t count{};
+		};
+
+	public:
+		TimeTraceReport() = default;
+		~TimeTraceReport() = default;
+
+		inline Core::ExpectedVoid add(const std::filesystem::path& traceFile, std::string unitName)
+		{
+			auto content = Util::read_all(traceFile);
+			if (!content) return std::unexpected(content.error());
+			auto document = Json::parse(content.value());
+			if (!document) return std::unexpected(document.error());
+
+			const Json::Value* events = document->find("traceEvents");
+			if (!events || !events->is_array())
+				return std::unexpected(
+					Core::make_error(
+						Core::ErrorCode::UnexpectedJsonParsingError,
+						std::format("{} has no traceEvents array.", traceFile.string())
+					)
+				);
+
+			Entry unit{ std::move(unitName), 0.0, 1 };
+			for (const auto& event : events->as_array()) {
+				const std::string_view name = event.string_or("name");
+				const double milliseconds = event.number_or("dur") / 1000.0;
+				const Json::Value* arguments = event.find("args");
+				const std::string_view detail = arguments ? arguments->string_or("detail") : std::string_view{};
+
+				if (name == "Source" && !detail.empty())
+					accumulate(m_headers, detail, milliseconds);
+				else if ((name == "InstantiateClass" || name == "InstantiateFunction") && !detail.empty())
+					accumulate(m_templates, detail, milliseconds);
+				else if (name == "ExecuteCompiler" || name == "Total ExecuteCompiler")
+					unit.milliseconds = std::max(unit.milliseconds, milliseconds);
+			}
+
+			m_units.push_back(std::move(unit));
+			return {};
+		}
+
+		inline size_t size() const noexcept { return m_units.size(); }
+
+		inline std::string format(size_t limit) const
+		{
+			std::string report{};
+			append_section(report, "Headers by total parse time", sorted(m_headers), limit);
+			append_section(report, "Template instantiations by total time", sorted(m_templates), limit);
+
+			std::vector<Entry> units{ m_units };
+			std::ranges::sort(units, std::ranges::greater{}, &Entry::milliseconds);
+			append_section(report, "Translation units by compile time", units, limit);
+			return report;
+		}
+
+	private:
+		inline static void accumulate(std::unordered_map<std::string, Entry>& entries, std::string_view name, double milliseconds)
+		{
+			auto [it, inserted] = entries.try_emplace(std::string{ name });
+			if (inserted)
+				it->second.name = name;
+			it->second.milliseconds += milliseconds;
+			++it->second.count;
+		}
+
+		inline static std::vector<Entry> sorted(const std::unordered_map<std::string, Entry>& entries)
+		{
+			std::vector<Entry> result{};
+			result.reserve(entries.size());
+			for (const auto& [_, entry] : entries)
+				result.push_back(entry);
+			std::ranges::sort(result, [](const Entry& left, const Entry& right) {
+				return left.milliseconds != right.milliseconds ? left.milliseconds > right.milliseconds : left.name < right.name;
+			});
+			return result;
+		}
+
+		inline static void append_section(std::string& report, std::string_view title, const std::vector<Entry>& entries, size_t limit)
+		{
+			report.append(std::format("{}:\n", title));
+			if (entries.empty())
+				report.append("  (none)\n");
+			for (size_t i = 0; i < entries.size() && i < limit; ++i)
+				report.append(std::format("  {:>10.1f} ms  {:>5}x  {}\n", entries[i].milliseconds, entries[i].count, entries[i].name));
+		}
+
+	private:
+		std::unordered_map<std::string, Entry> m_headers{};
+		std::unordered_map<std::string, Entry> m_templates{};
+		std::vector<Entry> m_units{};
+	};
+}
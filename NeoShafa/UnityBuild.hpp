@@ -0,0 +1,205 @@
+#pragma once
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Util.hpp"
+#include "ContentHash.hpp"
+#include "ProjectData.hpp"
+#include "ProjectDependencies.hpp"
+
+namespace NeoShafa {
+	// Groups translation units into generated unity sources under .shafaCache/unity. A batch
+	// ends after a file whose path hash falls on a boundary, so adding or removing a file
+	// only changes the batch it lands in, or when the batch reaches twice the configured
+	// size or the byte budget. Recently edited files can be isolated into their own
+	// translation unit so the edit loop does not recompile a whole batch each time.
+	class UnityBuild {
+	public:
+		struct Batch {
+			std::filesystem::path source{};
+			std::vector<std::filesystem::path> members{};
+		};
+
+	public:
+		UnityBuild() = default;
+		~UnityBuild() = default;
+
+		inline UnityBuild(
+			const ProjectEnvironment* projectEnvironment,
+			const ProjectStatistics* projectStatistics
+		) noexcept : m_projectEnvironment(projectEnvironment), m_projectStatistics(projectStatistics) {}
+
+		inline bool enabled() const noexcept {
+			return m_projectStatistics->projectUnityBuild;
+		}
+
+		inline bool is_unity_source(const std::filesystem::path& source) const {
+			return source.parent_path() == m_projectEnvironment->projectUnityPath;
+		}
+
+		// Splits the candidates, sorted by path, into batches and writes the unity sources
+		// whose member list changed. Files listed in `ProjectUnityExclude` and isolated
+		// files stay on their own. Returns the sources that were written.
+		inline Core::Expected<std::vector<std::filesystem::path>> plan(const std::vector<const SourceFile*>& candidates)
+		{
+			const uint64_t batchSize = std::max<uint64_t>(1, m_projectStatistics->projectUnityBatchSize);
+			const uint64_t batchBytes = m_projectStatistics->projectUnityBatchBytes;
+
+			std::unordered_set<std::string> excluded{ m_isolated };
+			for (const auto& path : m_projectStatistics->projectUnityExclude)
+				excluded.insert(ProjectDependencies::key(m_projectEnvironment->projectRoot / path));
+
+			m_batches.clear();
+			m_compileUnits.clear();
+
+			Batch batch{};
+			uint64_t bytes{};
+			const auto close_batch = [&] {
+				// A single file compiles on its own.
+				if (batch.members.size() > 1) {
+					batch.source = m_projectEnvironment->projectUnityPath / std::format(
+						"unity_{}.cpp", ContentHash::hash(relative_key(batch.members.front())).to_string().substr(0, 16)
+					);
+					m_batches.push_back(std::move(batch));
+				}
+				batch = {};
+				bytes = 0;
+			};
+
+			for (const SourceFile* sourceFile : candidates) {
+				if (excluded.contains(ProjectDependencies::key(sourceFile->path)))
+					continue;
+				batch.members.push_back(sourceFile->path);
+				bytes += sourceFile->stamp.size;
+
+				const bool isBoundary = ContentHash::hash(relative_key(sourceFile->path)).low % batchSize == 0;
+				if (isBoundary || batch.members.size() >= batchSize * 2 || (batchBytes != 0 && bytes >= batchBytes))
+					close_batch();
+			}
+			close_batch();
+
+			std::error_code errorCode{};
+			std::filesystem::create_directories(m_projectEnvironment->projectUnityPath, errorCode);
+
+			std::vector<std::filesystem::path> writtenSources{};
+			for (const auto& plannedBatch : m_batches) {
+				std::string content{ "// Generated by NeoShafa, do not edit.\n" };
+				for (const auto& member : plannedBatch.members) {
+					content.append(std::format("#include \"{}\"\n", member.generic_string()));
+					m_compileUnits.insert_or_assign(ProjectDependencies::key(member), plannedBatch.source);
+				}
+
+				if (auto res = Util::read_all(plannedBatch.source); res && res.value() == content)
+					continue;
+				if (auto res = Util::write_atomic(plannedBatch.source, content); !res)
+					return std::unexpected(res.error());
+				writtenSources.push_back(plannedBatch.source);
+			}
+
+			return writtenSources;
+		}
+
+		// The unity source a translation unit is compiled through, or the unit itself.
+		inline const std::filesystem::path& compile_unit(const std::filesystem::path& source) const
+		{
+			const auto it = m_compileUnits.find(ProjectDependencies::key(source));
+			return it == m_compileUnits.end() ? source : it->second;
+		}
+
+		inline const std::vector<Batch>& batches() const noexcept { return m_batches; }
+
+		// Takes edited batch members out of their batch. The batch is compiled once without
+		// them, and later edits only recompile the isolated file. The oldest isolated files
+		// return to their batch once more than the limit are isolated, and a change touching
+		// more files than that, like a branch switch, is left to the batches.
+		inline bool isolate(const std::vector<std::filesystem::path>& editedSources)
+		{
+			if (editedSources.empty() || editedSources.size() > m_maxIsolatedSources)
+				return false;
+
+			bool changed{};
+			for (const auto& source : editedSources) {
+				const std::string sourceKey = ProjectDependencies::key(source);
+				if (!m_compileUnits.contains(sourceKey) || m_isolated.contains(sourceKey))
+					continue;
+				m_isolated.insert(sourceKey);
+				m_isolatedOrder.push_back(source);
+				changed = true;
+			}
+
+			while (m_isolatedOrder.size() > m_maxIsolatedSources) {
+				m_isolated.erase(ProjectDependencies::key(m_isolatedOrder.front()));
+				m_isolatedOrder.erase(m_isolatedOrder.begin());
+				changed = true;
+			}
+
+			if (changed)
+				save_isolated();
+			return changed;
+		}
+
+		inline void reset_isolation()
+		{
+			if (m_isolatedOrder.empty())
+				return;
+			m_isolated.clear();
+			m_isolatedOrder.clear();
+			save_isolated();
+		}
+
+		inline void load_isolated()
+		{
+			m_isolated.clear();
+			m_isolatedOrder.clear();
+
+			auto res = Util::read(isolated_file_path());
+			if (!res || res->empty() || res->front() != m_isolatedHeader)
+				return;
+
+			for (size_t i = 1; i < res->size(); ++i)
+				if (!(*res)[i].empty() && m_isolated.insert(ProjectDependencies::key((*res)[i])).second)
+					m_isolatedOrder.emplace_back((*res)[i]);
+		}
+
+	private:
+		inline std::string relative_key(const std::filesystem::path& source) const {
+			return source.lexically_relative(m_projectEnvironment->projectRoot).generic_string();
+		}
+
+		inline std::filesystem::path isolated_file_path() const {
+			return m_projectEnvironment->projectUnityPath / "isolated.cache";
+		}
+
+		inline void save_isolated() const
+		{
+			std::string content{ m_isolatedHeader };
+			content.push_back('\n');
+			for (const auto& source : m_isolatedOrder)
+				content.append(source.string()).push_back('\n');
+
+			std::error_code errorCode{};
+			std::filesystem::create_directories(m_projectEnvironment->projectUnityPath, errorCode);
+			if (const auto res = Util::write_atomic(isolated_file_path(), content); !res)
+				std::println("WARNING: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+		}
+
+	private:
+		const ProjectEnvironment* m_projectEnvironment{};
+		const ProjectStatistics* m_projectStatistics{};
+
+		constexpr static std::string_view m_isolatedHeader{ "NeoShafaUnityIsolated 1" };
+		constexpr static size_t m_maxIsolatedSources{ 16 };
+
+		std::vector<Batch> m_batches{};
+		std::unordered_map<std::string, std::filesystem::path> m_compileUnits{};
+
+		std::unordered_set<std::string> m_isolated{};
+		std::vector<std::filesystem::path> m_isolatedOrder{};
+	};
+}
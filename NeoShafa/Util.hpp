@@ -8,12 +8,27 @@
 #include <print>  
 #include <format>  
 #include <fstream>  
+#include <cerrno>
+#include <memory>
+#include <atomic>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include <curl/curl.h>
 
 #include <boost/process.hpp>
 
 #include "Core.hpp"
+#include "ContentHash.hpp"
+#include "ProcessEngine.hpp"
 #include <cstdio>
 #include <iostream>
 
@@ -41,18 +56,216 @@ namespace NeoShafa::Util {
         return std::hash<std::string>{}(string.data());
     }
 
-    static inline Expected<size_t> hash(const std::filesystem::path& path) {
+    // Read-only view of a whole file. Empty files map to an empty span. Only for files that
+    // are replaced rather than rewritten in place, since truncating a mapped file raises SIGBUS.
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        inline ~MappedFile() { unmap(); }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        inline MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+        inline MappedFile& operator=(MappedFile&& other) noexcept
+        {
+            if (this != &other) {
+                unmap();
+                m_data = std::exchange(other.m_data, nullptr);
+                m_size = std::exchange(other.m_size, 0);
+            }
+            return *this;
+        }
+
+        inline static Expected<MappedFile> open(const std::filesystem::path& path)
+        {
+            MappedFile mappedFile{};
+#ifdef _WIN32
+            const HANDLE file = ::CreateFileW(
+                path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr
+            );
+            if (file == INVALID_HANDLE_VALUE)
+                return std::unexpected(make_error(ErrorCode::CannotOpenFileError, std::format("Cannot open file {}.", path.string())));
+
+            LARGE_INTEGER size{};
+            if (!::GetFileSizeEx(file, &size)) {
+                ::CloseHandle(file);
+                return std::unexpected(make_error(ErrorCode::CannotReadFileError, std::format("Cannot get size of {}.", path.string())));
+            }
+            mappedFile.m_size = static_cast<size_t>(size.QuadPart);
+            if (mappedFile.m_size == 0) {
+                ::CloseHandle(file);
+                return mappedFile;
+            }
+
+            const HANDLE mapping = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            ::CloseHandle(file);
+            if (!mapping)
+                return std::unexpected(make_error(ErrorCode::CannotReadFileError, std::format("Cannot map file {}.", path.string())));
+
+            mappedFile.m_data = static_cast<const std::byte*>(::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            ::CloseHandle(mapping);
+            if (!mappedFile.m_data) {
+                mappedFile.m_size = 0;
+                return std::unexpected(make_error(ErrorCode::CannotReadFileError, std::format("Cannot map view of {}.", path.string())));
+            }
+#else
+            const int descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (descriptor < 0)
+                return std::unexpected(make_error(ErrorCode::CannotOpenFileError, std::format("Cannot open file {}.", path.string())));
+
+            struct ::stat status{};
+            if (::fstat(descriptor, &status) != 0 || !S_ISREG(status.st_mode)) {
+                ::close(descriptor);
+                return std::unexpected(make_error(ErrorCode::CannotReadFileError, std::format("Cannot map non-regular file {}.", path.string())));
+            }
+            mappedFile.m_size = static_cast<size_t>(status.st_size);
+            if (mappedFile.m_size == 0) {
+                ::close(descriptor);
+                return mappedFile;
+            }
+
+            void* data = ::mmap(nullptr, mappedFile.m_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            ::close(descriptor);
+            if (data == MAP_FAILED) {
+                mappedFile.m_size = 0;
+                return std::unexpected(make_error(ErrorCode::CannotReadFileError, std::format("Cannot map file {}.", path.string())));
+            }
+            ::madvise(data, mappedFile.m_size, MADV_SEQUENTIAL);
+            mappedFile.m_data = static_cast<const std::byte*>(data);
+#endif
+            return mappedFile;
+        }
+
+        inline std::span<const std::byte> bytes() const noexcept { return { m_data, m_size }; }
+        inline size_t size() const noexcept { return m_size; }
+
+    private:
+        inline void unmap() noexcept
+        {
+            if (!m_data) return;
+#ifdef _WIN32
+            ::UnmapViewOfFile(m_data);
+#else
+            ::munmap(const_cast<std::byte*>(m_data), m_size);
+#endif
+            m_data = nullptr;
+            m_size = 0;
+        }
+
+    private:
+        const std::byte* m_data{};
+        size_t m_size{};
+    };
+
+    // Matches a '/'-separated path. `*` and `?` do not cross '/', `**` does, and `**/` also
+    // matches no directory at all.
+    static inline bool glob_match(std::string_view pattern, std::string_view path)
+    {
+        if (pattern.empty())
+            return path.empty();
+
+        if (pattern.starts_with("**")) {
+            std::string_view rest = pattern.substr(2);
+            if (rest.starts_with('/') && glob_match(rest.substr(1), path))
+                return true;
+            for (size_t i = 0; i <= path.size(); ++i)
+                if (glob_match(rest, path.substr(i)))
+                    return true;
+            return false;
+        }
+
+        if (pattern.front() == '*') {
+            for (size_t i = 0; i <= path.size(); ++i) {
+                if (glob_match(pattern.substr(1), path.substr(i)))
+                    return true;
+                if (i < path.size() && path[i] == '/')
+                    break;
+            }
+            return false;
+        }
+
+        if (path.empty() || (pattern.front() == '?' ? path.front() == '/' : pattern.front() != path.front()))
+            return false;
+        return glob_match(pattern.substr(1), path.substr(1));
+    }
+
+    // Content digest of a file, streamed through one 64 KiB buffer per thread, so hashing a
+    // large library does not allocate its size. The file is read rather than mapped: sources
+    // are hashed while editors rewrite them, and a mapped file truncated during the hash
+    // raises SIGBUS where a read just ends early.
+    static inline Expected<ContentHash::Digest> hash(const std::filesystem::path& path) {
+        constexpr size_t chunkSize{ 64 << 10 };
+        thread_local std::unique_ptr<char[]> buffer{ std::make_unique_for_overwrite<char[]>(chunkSize) };
+
+        ContentHash::Hasher hasher{};
+#ifdef _WIN32
         std::ifstream file{ path, std::ios::binary };
         if (!file)
             return std::unexpected(make_error(ErrorCode::CannotReadFileError, std::format("Cannot open file {} to create hash.", path.string())));
 
-        std::string contents{
-            std::istreambuf_iterator<char>(file),
-            std::istreambuf_iterator<char>()
+        while (file) {
+            file.read(buffer.get(), chunkSize);
+            hasher.update(std::as_bytes(std::span{ buffer.get(), static_cast<size_t>(file.gcount()) }));
+        }
+        if (file.bad())
+            return std::unexpected(make_error(ErrorCode::CannotReadFileError, std::format("Cannot read file {} to create hash.", path.string())));
+#else
+        const int descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (descriptor < 0)
+            return std::unexpected(make_error(ErrorCode::CannotReadFileError, std::format("Cannot open file {} to create hash.", path.string())));
+
+        while (true) {
+            const ssize_t count = ::read(descriptor, buffer.get(), chunkSize);
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count < 0) {
+                ::close(descriptor);
+                return std::unexpected(make_error(ErrorCode::CannotReadFileError, std::format("Cannot read file {} to create hash.", path.string())));
+            }
+            if (count == 0)
+                break;
+            hasher.update(std::as_bytes(std::span{ buffer.get(), static_cast<size_t>(count) }));
+        }
+        ::close(descriptor);
+#endif
+        return hasher.digest();
+    }
+
+    struct FileStamp {
+        int64_t modificationTime{};
+        uint64_t size{};
+        uint64_t inode{};
+
+        constexpr bool operator==(const FileStamp&) const = default;
+    };
+
+    // Cheap metadata probe used to skip hashing files that did not change. Windows has
+    // no inode in its attribute query, so only time and size are compared there.
+    static inline Expected<FileStamp> stat(const std::filesystem::path& path)
+    {
+#ifdef _WIN32
+        WIN32_FILE_ATTRIBUTE_DATA attributes{};
+        if (!::GetFileAttributesExW(path.wstring().c_str(), GetFileExInfoStandard, &attributes))
+            return std::unexpected(make_error(ErrorCode::CannotReadFileError, std::format("Cannot stat file {}.", path.string())));
+
+        return FileStamp{
+            static_cast<int64_t>((static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime),
+            (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow,
+            0
         };
+#else
+        struct ::stat status{};
+        if (::stat(path.c_str(), &status) != 0)
+            return std::unexpected(make_error(ErrorCode::CannotReadFileError, std::format("Cannot stat file {}.", path.string())));
 
-        std::hash<std::string_view> hasher;
-        return hasher(std::string_view{ contents });
+        return FileStamp{
+            static_cast<int64_t>(status.st_mtim.tv_sec) * 1'000'000'000 + status.st_mtim.tv_nsec,
+            static_cast<uint64_t>(status.st_size),
+            static_cast<uint64_t>(status.st_ino)
+        };
+#endif
     }
 
     static inline ExpectedVoid write(
@@ -74,6 +287,68 @@ namespace NeoShafa::Util {
         return {};
     }
 
+    static inline ExpectedVoid write_binary(const std::filesystem::path& path, std::string_view content)
+    {
+        std::ofstream file{ path, std::ios::out | std::ios::binary | std::ios::trunc };
+        if (!file)
+            return std::unexpected(make_error(ErrorCode::CannotWriteFileError, std::format("Cannot open file {} for writing.", path.string())));
+
+        file.write(content.data(), static_cast<std::streamsize>(content.size()));
+        if (!file)
+            return std::unexpected(make_error(ErrorCode::CannotWriteFileError, std::format("Cannot write file {}.", path.string())));
+
+        return {};
+    }
+
+    // Sibling of `path` no other writer uses: the process id tells processes apart, a
+    // counter the threads and calls of this one, so concurrent writers of the same file
+    // never truncate or rename each other's half-written copy.
+    static inline std::filesystem::path temporary_path(const std::filesystem::path& path)
+    {
+#ifdef _WIN32
+        const auto processId = static_cast<uint64_t>(::GetCurrentProcessId());
+#else
+        const auto processId = static_cast<uint64_t>(::getpid());
+#endif
+        static std::atomic<uint64_t> counter{};
+        std::filesystem::path temporaryPath{ path };
+        temporaryPath += std::format(".{}.{}.tmp", processId, counter.fetch_add(1, std::memory_order_relaxed));
+        return temporaryPath;
+    }
+
+    // Writes the whole content to a sibling temporary file, flushes it to disk and renames
+    // it over the target, so readers only ever see the previous or the new file.
+    static inline ExpectedVoid write_atomic(const std::filesystem::path& path, std::string_view content)
+    {
+        const std::filesystem::path temporaryPath = temporary_path(path);
+
+#ifdef _WIN32
+        std::FILE* file = ::_wfopen(temporaryPath.c_str(), L"wb");
+#else
+        std::FILE* file = std::fopen(temporaryPath.c_str(), "wb");
+#endif
+        if (!file)
+            return std::unexpected(make_error(ErrorCode::CannotWriteFileError, std::format("Cannot open file {} for writing.", temporaryPath.string())));
+
+        bool written = std::fwrite(content.data(), 1, content.size(), file) == content.size() && std::fflush(file) == 0;
+#ifdef _WIN32
+        written = written && ::FlushFileBuffers(reinterpret_cast<HANDLE>(::_get_osfhandle(::_fileno(file))));
+#else
+        written = written && ::fsync(::fileno(file)) == 0;
+#endif
+        written = std::fclose(file) == 0 && written;
+
+        std::error_code errorCode{};
+        if (written)
+            std::filesystem::rename(temporaryPath, path, errorCode);
+        if (!written || errorCode) {
+            std::filesystem::remove(temporaryPath, errorCode);
+            return std::unexpected(make_error(ErrorCode::CannotWriteFileError, std::format("Cannot replace file {}.", path.string())));
+        }
+
+        return {};
+    }
+
     static inline Expected<std::vector<std::string>> read(const std::filesystem::path& path)
     {
         std::ifstream file{ path };
@@ -90,6 +365,18 @@ namespace NeoShafa::Util {
         return lines;
     }
 
+    static inline Expected<std::string> read_all(const std::filesystem::path& path)
+    {
+        std::ifstream file{ path, std::ios::binary };
+        if (!file)
+            return std::unexpected(make_error(ErrorCode::CannotReadFileError, std::format("Cannot open file {}.", path.string())));
+
+        return std::string{
+            std::istreambuf_iterator<char>(file),
+            std::istreambuf_iterator<char>()
+        };
+    }
+
     static inline size_t write_callback(void* ptr, size_t size, size_t nmemb, FILE* stream) noexcept {
         return fwrite(ptr, size, nmemb, stream);
     }
@@ -130,57 +417,26 @@ namespace NeoShafa::Util {
         return {};
     }
 
+    // Waits for one command, both output streams joined. Run through g_processEngine, so a
+    // child writing to stderr first can not deadlock the read.
     inline static Expected<std::string> run_command(
         const std::filesystem::path& executable,
         const std::vector<std::string>& args,
-		int32_t& exitCode
+		int32_t& exitCode,
+        const std::filesystem::path& workingDirectory = {}
     ) {
-        if (!std::filesystem::exists(executable))
-            return std::unexpected(
-                Core::make_error(
-                    Core::ErrorCode::RunningCommandError,
-                    std::format("Executable not found at {}", executable.string())
-                )
-            );
+        auto res = g_processEngine.run(executable, args, workingDirectory);
+        if (!res) return std::unexpected(res.error());
 
-        BoostProcess::ipstream pipeStream{};
-        BoostProcess::ipstream errorStream{};
-        std::string out{};
-        try {
-            BoostProcess::child child{
+        exitCode = res->exitCode;
+        if (res->exitCode != 0) {
+            std::println(
+                std::cerr,
+                "ERROR: {} exited with an error code: {}",
                 executable.string(),
-                args,
-                BoostProcess::std_out > pipeStream,
-                BoostProcess::std_err > errorStream
-            };
-
-            std::stringstream sstream{};
-            sstream << pipeStream.rdbuf();
-            sstream << errorStream.rdbuf();
-            out = sstream.str();
-
-            child.wait();
-			exitCode = child.exit_code();
-            if (child.exit_code() != 0) {
-                std::println(
-                    std::cerr,
-                    "ERROR: {} exited with an error code: {}",
-                    executable.string(),
-                    child.exit_code()
-                );
-            }
-        }
-        catch (const boost::process::process_error& error) {
-            return std::unexpected(
-                Core::make_error(
-                    Core::ErrorCode::RunningCommandError,
-					std::format("Error executing command: {}", error.what())
-                )
-		    );
-        }
-        if (!out.empty()) {
-            out.erase(out.find_last_not_of("\r\n") + 1);
+                res->exitCode
+            );
         }
-        return out;
+        return res->output();
     }
 }
\ No newline at end of file
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <print>
+#include <iostream>
+#include <future>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <toml.hpp>
+
+#include "Util.hpp"
+#include "JobPool.hpp"
+#include "ProjectData.hpp"
+#include "ProjectSession.hpp"
+
+namespace NeoShafa {
+	// Projects built together from one root config.toml listing the members and what each
+	// of them depends on:
+	//   [[WorkspaceMember]]
+	//   Path = "libs/core"
+	//
+	//   [[WorkspaceMember]]
+	//   Path = "app"
+	//   Dependencies = ["libs/core"]
+	// Every member is a regular project with its own config.toml and .shafaCache. A member
+	// starts once its dependencies are built, so independent ones compile at the same time
+	// on the shared job pool and g_processEngine, and it links the libraries they produce.
+	class Workspace {
+	public:
+		enum class Mode {
+			Configure,
+			Build,
+			FullBuild
+		};
+
+	public:
+		inline Workspace(const std::filesystem::path& workspaceRoot, JobPool* jobPool) noexcept :
+			m_workspaceRoot(workspaceRoot), m_jobPool(jobPool) {}
+		~Workspace() = default;
+
+		Workspace(const Workspace&) = delete;
+		Workspace& operator=(const Workspace&) = delete;
+
+		inline static bool is_workspace(const std::filesystem::path& workspaceRoot)
+		{
+			const std::filesystem::path configFilePath = workspaceRoot / g_projectConfigureFileName;
+			if (!std::filesystem::exists(configFilePath))
+				return false;
+			auto tryData = toml::try_parse(configFilePath, toml::spec::v(1, 1, 0));
+			return tryData.is_ok() && tryData.unwrap().contains(m_memberKey.data());
+		}
+
+		// Reads the members and orders them so every member comes after its dependencies.
+		inline Core::ExpectedVoid load()
+		{
+			const std::filesystem::path configFilePath = m_workspaceRoot / g_projectConfigureFileName;
+			auto tryData = toml::try_parse(configFilePath, toml::spec::v(1, 1, 0));
+			if (!tryData.is_ok())
+				return std::unexpected(Core::make_error(Core::ErrorCode::UnexpectedParsingError, "Unexpected parsing error."));
+
+			const auto data = tryData.unwrap();
+			if (!data.contains(m_memberKey.data()) || !data.at(m_memberKey.data()).is_array())
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::WorkspaceConfigError, std::format("{} must be an array of tables.", m_memberKey))
+				);
+
+			std::vector<Member> members{};
+			std::unordered_map<std::string, size_t> memberIndices{};
+			for (const auto& element : data.at(m_memberKey.data()).as_array()) {
+				if (!element.is_table() || !element.contains("Path") || !element.at("Path").is_string())
+					return std::unexpected(
+						Core::make_error(Core::ErrorCode::WorkspaceConfigError, std::format("Every {} needs a Path.", m_memberKey))
+					);
+
+				Member member{ std::filesystem::path{ element.at("Path").as_string() }.lexically_normal().generic_string() };
+				if (element.contains("Dependencies") && element.at("Dependencies").is_array())
+					for (const auto& dependency : element.at("Dependencies").as_array())
+						if (dependency.is_string())
+							member.dependencies.push_back(std::filesystem::path{ dependency.as_string() }.lexically_normal().generic_string());
+
+				if (!memberIndices.emplace(member.path, members.size()).second)
+					return std::unexpected(
+						Core::make_error(Core::ErrorCode::WorkspaceConfigError, std::format("Workspace member {} is listed twice.", member.path))
+					);
+				members.push_back(std::move(member));
+			}
+
+			for (auto& member : members)
+				for (const auto& dependency : member.dependencies) {
+					const auto it = memberIndices.find(dependency);
+					if (it == memberIndices.end())
+						return std::unexpected(
+							Core::make_error(
+								Core::ErrorCode::WorkspaceConfigError,
+								std::format("Workspace member {} depends on {}, which is not a member.", member.path, dependency)
+							)
+						);
+					member.dependencyIndices.push_back(it->second);
+				}
+
+			// Members whose dependencies are all placed go next, whatever is left is a cycle.
+			std::vector<size_t> pendingDependencies(members.size());
+			std::vector<std::vector<size_t>> dependents(members.size());
+			std::vector<size_t> order{};
+			for (size_t i = 0; i < members.size(); ++i) {
+				pendingDependencies[i] = members[i].dependencyIndices.size();
+				for (const size_t dependency : members[i].dependencyIndices)
+					dependents[dependency].push_back(i);
+				if (pendingDependencies[i] == 0)
+					order.push_back(i);
+			}
+			for (size_t next = 0; next < order.size(); ++next)
+				for (const size_t dependent : dependents[order[next]])
+					if (--pendingDependencies[dependent] == 0)
+						order.push_back(dependent);
+
+			if (order.size() != members.size()) {
+				std::string cycle{};
+				for (size_t i = 0; i < members.size(); ++i)
+					if (pendingDependencies[i] != 0)
+						cycle.append(cycle.empty() ? "" : ", ").append(members[i].path);
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::WorkspaceConfigError, std::format("Workspace members depend on each other: {}.", cycle))
+				);
+			}
+
+			for (const size_t index : order) {
+				members[index].session = std::make_unique<ProjectSession>(m_workspaceRoot / members[index].path, m_jobPool);
+				m_members.push_back(std::move(members[index]));
+			}
+			// Indices were positions in the config, they become positions in build order.
+			std::vector<size_t> position(order.size());
+			for (size_t i = 0; i < order.size(); ++i)
+				position[order[i]] = i;
+			for (auto& member : m_members)
+				for (auto& dependency : member.dependencyIndices)
+					dependency = position[dependency];
+
+			return {};
+		}
+
+		inline size_t size() const noexcept { return m_members.size(); }
+
+		// Every member builds the same named configuration.
+		inline Core::ExpectedVoid set_configuration(const std::string& configuration)
+		{
+			for (auto& member : m_members)
+				if (auto res = member.session->set_configuration(configuration); !res)
+					return res;
+			return {};
+		}
+
+		// Every member runs on its own thread once its dependencies succeeded, the dependents
+		// of a failed member are skipped. Returns whether every member succeeded.
+		inline bool run(Mode mode)
+		{
+			std::vector<std::promise<bool>> finished(m_members.size());
+			std::vector<std::shared_future<bool>> results{};
+			for (auto& promise : finished)
+				results.push_back(promise.get_future().share());
+
+			std::vector<std::jthread> threads{};
+			threads.reserve(m_members.size());
+			for (size_t i = 0; i < m_members.size(); ++i)
+				threads.emplace_back([this, i, mode, &finished, &results] {
+					g_buildTrace.enter_lane(BuildTrace::member_lane(i), m_members[i].path);
+					bool succeeded{ false };
+					try {
+						succeeded = run_member(i, mode, results);
+					}
+					catch (const std::exception& exception) {
+						std::println("ERROR: {}: {}", m_members[i].path, exception.what());
+					}
+					finished[i].set_value(succeeded);
+				});
+			threads.clear();
+
+			return std::ranges::all_of(results, [](const std::shared_future<bool>& result) { return result.get(); });
+		}
+
+	private:
+		struct Member {
+			std::string path{};
+			std::vector<std::string> dependencies{};
+			std::vector<size_t> dependencyIndices{};
+			std::unique_ptr<ProjectSession> session{};
+		};
+
+		inline static constexpr std::string_view m_memberKey{ "WorkspaceMember" };
+
+	private:
+		inline bool run_member(size_t index, Mode mode, const std::vector<std::shared_future<bool>>& results)
+		{
+			Member& member = m_members[index];
+			for (const size_t dependency : member.dependencyIndices)
+				if (!results[dependency].get()) {
+					std::println("WARNING: Skipping {}, its dependency {} failed.", member.path, m_members[dependency].path);
+					return false;
+				}
+
+			ProjectSession& session = *member.session;
+			if (!std::filesystem::exists(session.environment().projectRoot / g_projectConfigureFileName)) {
+				std::println("ERROR: Workspace member {} has no {}.", member.path, g_projectConfigureFileName);
+				return false;
+			}
+
+			auto span = g_buildTrace.span(member.path, "workspace");
+			std::println("INFO: {} {}.", mode == Mode::Configure ? "Configuring" : "Building", member.path);
+			if (mode == Mode::Configure)
+				return session.configure();
+
+			session.build().set_link_libraries(link_libraries(member));
+			const std::vector<std::filesystem::path> dependencyChanges = dependency_changes(member);
+			if (mode == Mode::FullBuild)
+				return session.full_build(dependencyChanges);
+
+			return session.prepare_build() && session.build_changes(dependencyChanges);
+		}
+
+		// The libraries of the member's dependencies, followed by what those link in turn
+		// when they are archives, since an archive does not carry its dependencies.
+		inline std::vector<std::filesystem::path> link_libraries(const Member& member) const
+		{
+			const std::string_view executable = (*ProjectCompilationData::supportedProjectTypes)[ProjectCompilationData::supportedProjectTypes.Executable];
+			const std::string_view staticLibrary = (*ProjectCompilationData::supportedProjectTypes)[ProjectCompilationData::supportedProjectTypes.StaticLibrary];
+
+			std::vector<std::filesystem::path> libraries{};
+			const auto add = [&libraries](const std::filesystem::path& library) {
+				if (std::ranges::find(libraries, library) == libraries.end())
+					libraries.push_back(library);
+			};
+			for (const size_t index : member.dependencyIndices) {
+				ProjectSession& dependency = *m_members[index].session;
+				const std::string& projectType = dependency.statistics().projectCompilationData.projectType;
+				if (projectType == executable)
+					continue;
+				add(dependency.build().link_library());
+				if (projectType == staticLibrary)
+					for (const auto& library : dependency.build().link_libraries())
+						add(library);
+			}
+			return libraries;
+		}
+
+		inline std::vector<std::filesystem::path> dependency_changes(const Member& member) const
+		{
+			std::vector<std::filesystem::path> changes{};
+			for (const size_t index : member.dependencyIndices) {
+				const auto& changedFiles = m_members[index].session->changed_files();
+				changes.insert(changes.end(), changedFiles.begin(), changedFiles.end());
+			}
+			std::ranges::sort(changes);
+			changes.erase(std::unique(changes.begin(), changes.end()), changes.end());
+			return changes;
+		}
+
+	private:
+		std::filesystem::path m_workspaceRoot{};
+		JobPool* m_jobPool{};
+
+		std::vector<Member> m_members{};
+	};
+}
@@ -8,8 +8,10 @@
 int32_t main(int32_t argc, char** argv) {
 	NeoShafa::Router router{ argc, argv };
 
-	router.run();
-	
-		             
+	if (const auto res = router.run(); !res) {
+		std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+		return static_cast<int32_t>(res.error().code);
+	}
+
 	return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,300 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "Util.hpp"
+#include "Json.hpp"
+#include "SyntheticProject.hpp"
+
+namespace NeoShafa::Benchmark {
+	struct Sample {
+		int32_t exitCode{};
+		double wallSeconds{};
+		double userSeconds{};
+		double systemSeconds{};
+		uint64_t peakRssKiB{};
+		// Counted with `strace -f -c` in a second run of the same step, so tracing does not
+		// distort the timed run. Empty when not requested or unavailable.
+		std::optional<uint64_t> syscalls{};
+	};
+
+	struct Scenario {
+		std::string name{};
+		std::vector<std::string> arguments{};
+		std::function<Core::ExpectedVoid(const SyntheticProject&, uint32_t)> prepare{};
+	};
+
+	struct ScenarioResult {
+		std::string projectType{};
+		std::string scenario{};
+		std::vector<Sample> samples{};
+	};
+
+	// Runs NeoShafa as a child process in the project root, the way a developer runs it,
+	// and measures the whole process tree: on POSIX the rusage wait4 reports covers every
+	// compiler and linker the build waited for. Windows only sees the NeoShafa process.
+	class BuildBenchmark {
+	public:
+		BuildBenchmark() = default;
+		~BuildBenchmark() = default;
+
+		inline BuildBenchmark(std::filesystem::path neoShafaPath, bool countSyscalls) :
+			m_neoShafaPath(std::move(neoShafaPath)), m_countSyscalls(countSyscalls) {}
+
+		// Cold full build, no-op build, one source edited, the most included header edited
+		// and a config.toml edit, in that order, so every step starts from the previous one.
+		inline static std::vector<Scenario> scenarios()
+		{
+			const auto cleanCache = [](const SyntheticProject& project, uint32_t) -> Core::ExpectedVoid {
+				std::error_code errorCode{};
+				std::filesystem::remove_all(project.root() / ".shafaCache", errorCode);
+				std::filesystem::remove_all(project.root() / "bin", errorCode);
+				return {};
+			};
+			const auto unchanged = [](const SyntheticProject&, uint32_t) -> Core::ExpectedVoid { return {}; };
+
+			return {
+				{ "cold_full_build", { "--full_build" }, cleanCache },
+				{ "noop_build", { "--build", "--local" }, unchanged },
+				{ "touch_source", { "--build", "--local" }, [](const SyntheticProject& project, uint32_t edit) {
+					return project.touch_source(0, edit);
+				} },
+				{ "touch_header", { "--build", "--local" }, [](const SyntheticProject& project, uint32_t edit) {
+					return project.touch_header(0, edit);
+				} },
+				{ "edit_config", { "--build", "--local" }, [](const SyntheticProject& project, uint32_t edit) {
+					return project.edit_config(edit);
+				} },
+			};
+		}
+
+		inline Core::Expected<std::vector<ScenarioResult>> run(
+			const SyntheticProject& project,
+			std::string_view projectType,
+			uint32_t repetitions
+		) const {
+			const std::vector<Scenario> steps = scenarios();
+			std::vector<ScenarioResult> results{};
+			for (const auto& step : steps)
+				results.push_back({ std::string{ projectType }, step.name });
+
+			uint32_t edit{};
+			for (uint32_t repetition = 0; repetition < repetitions; ++repetition)
+				for (size_t i = 0; i < steps.size(); ++i) {
+					if (auto res = steps[i].prepare(project, edit++); !res)
+						return std::unexpected(res.error());
+					auto sample = measure(project.root(), steps[i].arguments);
+					if (!sample) return std::unexpected(sample.error());
+
+					if (m_countSyscalls) {
+						if (auto res = steps[i].prepare(project, edit++); !res)
+							return std::unexpected(res.error());
+						sample->syscalls = count_syscalls(project.root(), steps[i].arguments);
+					}
+					results[i].samples.push_back(*sample);
+				}
+
+			return results;
+		}
+
+		// Builds a project with a source that does not compile. The run fails when NeoShafa
+		// still exits with 0, since the exit codes of the benchmarked builds would then
+		// hide failures as well.
+		inline Core::ExpectedVoid check_failure_detected(const SyntheticProject& project) const
+		{
+			if (auto res = project.generate(); !res)
+				return res;
+			if (auto res = project.break_source(0); !res)
+				return res;
+
+			auto sample = measure(project.root(), { "--full_build" });
+			if (!sample) return std::unexpected(sample.error());
+			if (sample->exitCode == 0)
+				return std::unexpected(
+					Core::make_error(
+						Core::ErrorCode::GenericBuildError,
+						std::format("{} exited with 0 on the broken project in {}, failed builds would go unnoticed.", m_neoShafaPath.string(), project.root().string())
+					)
+				);
+			return {};
+		}
+
+		inline static std::string to_json(const std::vector<ScenarioResult>& results, std::string_view options)
+		{
+			std::string content{ std::format("{{\n\"options\":{},\n\"results\":[", options) };
+			for (size_t i = 0; i < results.size(); ++i) {
+				const ScenarioResult& result = results[i];
+				std::vector<double> wallTimes{};
+				for (const auto& sample : result.samples)
+					wallTimes.push_back(sample.wallSeconds);
+				std::ranges::sort(wallTimes);
+
+				content.append(std::format(
+					"{}\n{{\"projectType\":{},\"scenario\":{},\"medianWallSeconds\":{:.6f},\"samples\":[",
+					i == 0 ? "" : ",", Json::quote(result.projectType), Json::quote(result.scenario),
+					wallTimes.empty() ? 0.0 : wallTimes[wallTimes.size() / 2]
+				));
+				for (size_t j = 0; j < result.samples.size(); ++j) {
+					const Sample& sample = result.samples[j];
+					content.append(std::format(
+						"{}{{\"exitCode\":{},\"wallSeconds\":{:.6f},\"userSeconds\":{:.6f},\"systemSeconds\":{:.6f},\"peakRssKiB\":{},\"syscalls\":{}}}",
+						j == 0 ? "" : ",", sample.exitCode, sample.wallSeconds, sample.userSeconds, sample.systemSeconds,
+						sample.peakRssKiB, sample.syscalls ? std::to_string(*sample.syscalls) : "null"
+					));
+				}
+				content.append("]}");
+			}
+			content.append("\n]\n}\n");
+			return content;
+		}
+
+	private:
+		inline Core::Expected<Sample> measure(
+			const std::filesystem::path& projectRoot,
+			const std::vector<std::string>& arguments
+		) const {
+			std::vector<std::string> command{ m_neoShafaPath.string() };
+			command.insert(command.end(), arguments.begin(), arguments.end());
+			return spawn(projectRoot, command);
+		}
+
+		inline std::optional<uint64_t> count_syscalls(
+			const std::filesystem::path& projectRoot,
+			const std::vector<std::string>& arguments
+		) const {
+#ifdef _WIN32
+			return std::nullopt;
+#else
+			const std::filesystem::path strace = Util::BoostProcess::search_path("strace").string();
+			if (strace.empty())
+				return std::nullopt;
+
+			const std::filesystem::path summary = projectRoot / ".strace-summary";
+			std::vector<std::string> command{ strace.string(), "-f", "-c", "-o", summary.string(), m_neoShafaPath.string() };
+			command.insert(command.end(), arguments.begin(), arguments.end());
+			if (const auto res = spawn(projectRoot, command); !res)
+				return std::nullopt;
+
+			// The last row is "100.00 seconds usecs/call calls [errors] total".
+			auto lines = Util::read(summary);
+			std::error_code errorCode{};
+			std::filesystem::remove(summary, errorCode);
+			if (!lines)
+				return std::nullopt;
+			for (auto it = lines->rbegin(); it != lines->rend(); ++it) {
+				std::vector<std::string_view> fields{};
+				for (std::string_view line{ *it }; !line.empty();) {
+					line.remove_prefix(std::min(line.find_first_not_of(' '), line.size()));
+					const size_t end = std::min(line.find(' '), line.size());
+					if (end != 0)
+						fields.push_back(line.substr(0, end));
+					line.remove_prefix(end);
+				}
+				if (fields.size() >= 5 && fields.back() == "total") {
+					uint64_t calls{};
+					std::from_chars(fields[3].data(), fields[3].data() + fields[3].size(), calls);
+					return calls;
+				}
+			}
+			return std::nullopt;
+#endif
+		}
+
+		// Output goes to bench.log in the project, so it does not interleave with the report.
+		inline static Core::Expected<Sample> spawn(
+			const std::filesystem::path& workingDirectory,
+			const std::vector<std::string>& command
+		) {
+			const std::filesystem::path logPath = workingDirectory / "bench.log";
+			Sample sample{};
+			const auto begin = std::chrono::steady_clock::now();
+#ifdef _WIN32
+			try {
+				Util::BoostProcess::child child{
+					command.front(),
+					std::vector<std::string>{ command.begin() + 1, command.end() },
+					Util::BoostProcess::start_dir = workingDirectory.string(),
+					(Util::BoostProcess::std_out & Util::BoostProcess::std_err) > logPath.string()
+				};
+				child.wait();
+				sample.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+				sample.exitCode = child.exit_code();
+
+				FILETIME creationTime{}, exitTime{}, kernelTime{}, userTime{};
+				if (GetProcessTimes(child.native_handle(), &creationTime, &exitTime, &kernelTime, &userTime)) {
+					const auto seconds = [](const FILETIME& time) {
+						return static_cast<double>((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 1e7;
+					};
+					sample.userSeconds = seconds(userTime);
+					sample.systemSeconds = seconds(kernelTime);
+				}
+				PROCESS_MEMORY_COUNTERS counters{};
+				if (GetProcessMemoryInfo(child.native_handle(), &counters, sizeof(counters)))
+					sample.peakRssKiB = counters.PeakWorkingSetSize / 1024;
+			}
+			catch (const std::exception& exception) {
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::ExecutionError, std::format("Cannot run {}: {}", command.front(), exception.what()))
+				);
+			}
+#else
+			std::vector<char*> argv{};
+			for (const auto& argument : command)
+				argv.push_back(const_cast<char*>(argument.c_str()));
+			argv.push_back(nullptr);
+
+			const pid_t pid = fork();
+			if (pid < 0)
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::ExecutionError, std::format("Cannot fork for {}.", command.front()))
+				);
+			if (pid == 0) {
+				const int log = ::open(logPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+				if (log >= 0) {
+					dup2(log, STDOUT_FILENO);
+					dup2(log, STDERR_FILENO);
+				}
+				if (chdir(workingDirectory.c_str()) == 0)
+					execv(argv.front(), argv.data());
+				_exit(127);
+			}
+
+			int status{};
+			rusage usage{};
+			if (wait4(pid, &status, 0, &usage) < 0)
+				return std::unexpected(
+					Core::make_error(Core::ErrorCode::ExecutionError, std::format("Cannot wait for {}.", command.front()))
+				);
+			sample.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+			sample.exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+			sample.userSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+			sample.systemSeconds = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+			sample.peakRssKiB = static_cast<uint64_t>(usage.ru_maxrss);
+#endif
+			return sample;
+		}
+
+	private:
+		std::filesystem::path m_neoShafaPath{};
+		bool m_countSyscalls{ false };
+	};
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <string>
+#include <string_view>
+
+#include "Util.hpp"
+
+namespace NeoShafa::Benchmark {
+	struct SyntheticProjectOptions {
+		uint32_t sources{ 200 };
+		uint32_t headers{ 50 };
+		// Project headers every source includes; each header also includes up to two
+		// lower-numbered ones, so touching header 0 reaches most of the project.
+		uint32_t includeFanOut{ 8 };
+		std::string projectType{ "Executable" };
+	};
+
+	// Deterministic project NeoShafa can build with any supported compiler: sources under
+	// src/, headers under include/ and a config.toml for the requested `ProjectType`.
+	class SyntheticProject {
+	public:
+		SyntheticProject() = default;
+		~SyntheticProject() = default;
+
+		inline SyntheticProject(std::filesystem::path root, SyntheticProjectOptions options) :
+			m_root(std::move(root)), m_options(std::move(options)) {}
+
+		inline const std::filesystem::path& root() const noexcept { return m_root; }
+
+		inline Core::ExpectedVoid generate() const
+		{
+			std::error_code errorCode{};
+			std::filesystem::remove_all(m_root, errorCode);
+			std::filesystem::create_directories(m_root / "src", errorCode);
+			std::filesystem::create_directories(m_root / "include", errorCode);
+			if (errorCode)
+				return std::unexpected(
+					Core::make_error(
+						Core::ErrorCode::CannotWriteFileError,
+						std::format("Cannot create {}: {}", m_root.string(), errorCode.message())
+					)
+				);
+
+			if (auto res = Util::write_atomic(config_path(), config(m_options.projectType, "1.0.0")); !res)
+				return res;
+
+			for (uint32_t header = 0; header < m_options.headers; ++header)
+				if (auto res = Util::write_atomic(header_path(header), header_content(header)); !res)
+					return res;
+
+			for (uint32_t source = 0; source < m_options.sources; ++source)
+				if (auto res = Util::write_atomic(source_path(source), source_content(source)); !res)
+					return res;
+
+			if (m_options.projectType == "Executable")
+				return Util::write_atomic(m_root / "src" / "main.cpp", "int main() { return 0; }\n");
+			return {};
+		}
+
+		// Sources are diffed by content, so every edit appends a new line rather than only
+		// moving the modification time.
+		inline Core::ExpectedVoid touch_source(uint32_t source, uint32_t edit) const {
+			return append(source_path(source), std::format("// edit {}\n", edit));
+		}
+
+		inline Core::ExpectedVoid touch_header(uint32_t header, uint32_t edit) const {
+			return append(header_path(header), std::format("// edit {}\n", edit));
+		}
+
+		// Makes the source fail to compile, for the project proving failed builds are noticed.
+		inline Core::ExpectedVoid break_source(uint32_t source) const {
+			return append(source_path(source), "#error Broken on purpose by NeoShafaBenchmark.\n");
+		}
+
+		// Changes the project version only, so the configuration is parsed again without
+		// changing any compile command.
+		inline Core::ExpectedVoid edit_config(uint32_t edit) const {
+			return Util::write_atomic(config_path(), config(m_options.projectType, std::format("1.0.{}", edit + 1)));
+		}
+
+		inline std::filesystem::path config_path() const { return m_root / "config.toml"; }
+
+		inline std::filesystem::path source_path(uint32_t source) const {
+			return m_root / "src" / std::format("source_{}.cpp", source);
+		}
+
+		inline std::filesystem::path header_path(uint32_t header) const {
+			return m_root / "include" / std::format("header_{}.hpp", header);
+		}
+
+	private:
+		inline static std::string config(std::string_view projectType, std::string_view version)
+		{
+			return std::format(
+				"ProjectName = \"Synthetic\"\n"
+				"ProjectVersion = \"{}\"\n"
+				"ProjectLanguage = \"C++\"\n"
+				"ProjectType = \"{}\"\n"
+				"\n"
+				"cCompilerVersion = \"c17\"\n"
+				"cppCompilerVersion = \"c++20\"\n",
+				version, projectType
+			);
+		}
+
+		inline std::string header_content(uint32_t header) const
+		{
+			std::string content{ "#pragma once\n\n#include <array>\n#include <cstdint>\n" };
+			for (uint32_t include = 1; include <= 2 && include <= header; ++include)
+				content.append(std::format("#include \"header_{}.hpp\"\n", (header - include) / 2));
+
+			content.append(std::format(
+				"\nnamespace synthetic {{\n"
+				"\ttemplate <typename T, std::size_t N>\n"
+				"\tstruct Table{0} {{\n"
+				"\t\tstd::array<T, N> values{{}};\n"
+				"\t\tconstexpr T sum() const {{ T total{{}}; for (const T& value : values) total += value; return total; }}\n"
+				"\t}};\n"
+				"\n"
+				"\tinline std::uint64_t header_{0}(std::uint64_t value) {{ return value * {1}u + {0}u; }}\n"
+				"}}\n",
+				header, header * 2 + 1
+			));
+			return content;
+		}
+
+		inline std::string source_content(uint32_t source) const
+		{
+			std::string content{ "#include <cstdint>\n" };
+			std::string body{};
+			for (uint32_t include = 0; include < m_options.includeFanOut && m_options.headers != 0; ++include) {
+				const uint32_t header = (source * 7 + include * 13) % m_options.headers;
+				content.append(std::format("#include \"../include/header_{}.hpp\"\n", header));
+				body.append(std::format(
+					"\ttotal += synthetic::header_{0}(total) + synthetic::Table{0}<std::uint64_t, {1}>{{}}.sum();\n",
+					header, include + 1
+				));
+			}
+
+			content.append(std::format(
+				"\nstd::uint64_t source_{}(std::uint64_t total) {{\n{}\treturn total;\n}}\n",
+				source, body
+			));
+			return content;
+		}
+
+		inline static Core::ExpectedVoid append(const std::filesystem::path& path, std::string_view line)
+		{
+			auto res = Util::read_all(path);
+			if (!res) return std::unexpected(res.error());
+			return Util::write_atomic(path, res.value().append(line));
+		}
+
+	private:
+		std::filesystem::path m_root{};
+		SyntheticProjectOptions m_options{};
+	};
+}
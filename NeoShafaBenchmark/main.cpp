@@ -0,0 +1,121 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <print>
+#include <cstdint>
+#include <iostream>
+
+#include <boost/program_options.hpp>
+
+#include "ProjectData.hpp"
+#include "BuildBenchmark.hpp"
+
+// End-to-end benchmark of the NeoShafa command line on generated projects. Prints or
+// writes one JSON document, so a run can be compared against the previous release.
+int32_t main(int32_t argc, char** argv) {
+	using namespace NeoShafa;
+	namespace program_options = boost::program_options;
+
+	const std::filesystem::path self = std::filesystem::absolute(argv[0]);
+#ifdef _WIN32
+	const std::string defaultNeoShafa = (self.parent_path() / "NeoShafa.exe").string();
+#else
+	const std::string defaultNeoShafa = (self.parent_path() / "NeoShafa").string();
+#endif
+
+	program_options::options_description description{ "Allowed options" };
+	description.add_options()
+		("help,h", "Produce help message.")
+		("neoshafa", program_options::value<std::string>()->default_value(defaultNeoShafa), "NeoShafa executable to benchmark.")
+		("sources", program_options::value<uint32_t>()->default_value(200), "Source files per project.")
+		("headers", program_options::value<uint32_t>()->default_value(50), "Header files per project.")
+		("fan_out", program_options::value<uint32_t>()->default_value(8), "Project headers every source includes.")
+		("types", program_options::value<std::vector<std::string>>()->multitoken(), "Project types to generate, all by default.")
+		("repetitions", program_options::value<uint32_t>()->default_value(3), "Runs of every scenario.")
+		("work_dir", program_options::value<std::string>()->default_value((std::filesystem::temp_directory_path() / "neoshafa-benchmark").string()), "Where the projects are generated.")
+		("output,o", program_options::value<std::string>(), "Write the JSON report to this file instead of stdout.")
+		("syscalls", "Count system calls with strace in an extra run of every step (Linux).");
+
+	program_options::variables_map variableMap{};
+	try {
+		program_options::store(program_options::parse_command_line(argc, argv, description), variableMap);
+		program_options::notify(variableMap);
+	}
+	catch (const program_options::error& exception) {
+		std::println(std::cerr, "ERROR: {}", exception.what());
+		return static_cast<int32_t>(Core::ErrorCode::GenericError);
+	}
+	if (variableMap.count("help")) {
+		std::cout << description << '\n';
+		return 0;
+	}
+
+	std::vector<std::string> projectTypes{};
+	if (variableMap.count("types"))
+		projectTypes = variableMap.at("types").as<std::vector<std::string>>();
+	else
+		for (const auto& projectType : *ProjectCompilationData::supportedProjectTypes)
+			projectTypes.emplace_back(projectType);
+
+	const std::filesystem::path neoShafaPath = std::filesystem::absolute(variableMap.at("neoshafa").as<std::string>());
+	if (!std::filesystem::exists(neoShafaPath)) {
+		std::println(std::cerr, "ERROR: {} does not exist.", neoShafaPath.string());
+		return static_cast<int32_t>(Core::ErrorCode::FileNotFoundError);
+	}
+
+	Benchmark::SyntheticProjectOptions projectOptions{
+		variableMap.at("sources").as<uint32_t>(),
+		variableMap.at("headers").as<uint32_t>(),
+		variableMap.at("fan_out").as<uint32_t>()
+	};
+	const uint32_t repetitions = std::max<uint32_t>(1, variableMap.at("repetitions").as<uint32_t>());
+	const std::filesystem::path workDirectory = std::filesystem::absolute(variableMap.at("work_dir").as<std::string>());
+	const Benchmark::BuildBenchmark benchmark{ neoShafaPath, variableMap.count("syscalls") != 0 };
+
+	const Benchmark::SyntheticProject brokenProject{ workDirectory / "broken", { 1, 0, 0, "Executable" } };
+	if (const auto res = benchmark.check_failure_detected(brokenProject); !res) {
+		std::println(std::cerr, "ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+		return static_cast<int32_t>(res.error().code);
+	}
+
+	std::vector<Benchmark::ScenarioResult> results{};
+	for (const auto& projectType : projectTypes) {
+		projectOptions.projectType = projectType;
+		const Benchmark::SyntheticProject project{ workDirectory / projectType, projectOptions };
+		if (const auto res = project.generate(); !res) {
+			std::println(std::cerr, "ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+			return static_cast<int32_t>(res.error().code);
+		}
+
+		std::println(std::cerr, "INFO: Benchmarking {} in {}.", projectType, project.root().string());
+		auto res = benchmark.run(project, projectType, repetitions);
+		if (!res) {
+			std::println(std::cerr, "ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+			return static_cast<int32_t>(res.error().code);
+		}
+		results.insert(results.end(), res->begin(), res->end());
+	}
+
+	const std::string options = std::format(
+		"{{\"neoshafa\":{},\"sources\":{},\"headers\":{},\"fanOut\":{},\"repetitions\":{}}}",
+		Json::quote(neoShafaPath.string()), projectOptions.sources, projectOptions.headers, projectOptions.includeFanOut, repetitions
+	);
+	const std::string report = Benchmark::BuildBenchmark::to_json(results, options);
+	if (variableMap.count("output")) {
+		if (const auto res = Util::write_atomic(variableMap.at("output").as<std::string>(), report); !res) {
+			std::println(std::cerr, "ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+			return static_cast<int32_t>(res.error().code);
+		}
+	}
+	else
+		std::print("{}", report);
+
+	// Any failed build makes the run fail, so CI does not compare broken numbers.
+	for (const auto& result : results)
+		for (const auto& sample : result.samples)
+			if (sample.exitCode != 0) {
+				std::println(std::cerr, "ERROR: {} {} exited with {}.", result.projectType, result.scenario, sample.exitCode);
+				return static_cast<int32_t>(Core::ErrorCode::GenericBuildError);
+			}
+
+	return 0;
+}
@@ -0,0 +1,182 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <print>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "Util.hpp"
+#include "ProjectData.hpp"
+#include "ProjectDataScraper.hpp"
+#include "ProjectConfigure.hpp"
+#include "SourceCache.hpp"
+
+// Microbenchmarks of the helpers every NeoShafa invocation runs, over the input sizes
+// real projects reach, so a change shows up as a bend in the scaling curve.
+namespace {
+	using namespace NeoShafa;
+
+	// Inputs live in one scratch directory that is removed when the process exits.
+	struct ScratchDirectory {
+		inline ScratchDirectory() : path(std::filesystem::temp_directory_path() / "neoshafa-microbenchmark") {
+			std::error_code errorCode{};
+			std::filesystem::remove_all(path, errorCode);
+			std::filesystem::create_directories(path, errorCode);
+		}
+		inline ~ScratchDirectory() {
+			std::error_code errorCode{};
+			std::filesystem::remove_all(path, errorCode);
+		}
+		std::filesystem::path path{};
+	};
+
+	const std::filesystem::path& scratch_directory() {
+		static const ScratchDirectory scratchDirectory{};
+		return scratchDirectory.path;
+	}
+
+	ProjectEnvironment environment_in(const std::filesystem::path& projectRoot) {
+		ProjectEnvironment projectEnvironment{};
+		projectEnvironment.projectRoot = projectRoot;
+		projectEnvironment.projectCachePath = projectRoot / g_projectCacheFolderName;
+		projectEnvironment.projectSourceCacheFilePath = projectEnvironment.projectCachePath / g_projectSourceCacheFileName;
+		return projectEnvironment;
+	}
+
+	// Paths spread over 64 directories, like a project tree, with made-up stamps and digests.
+	std::vector<SourceFile> synthetic_sources(size_t count) {
+		std::vector<SourceFile> sourceFiles{};
+		sourceFiles.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			std::filesystem::path path = scratch_directory() / "project" / std::format("module_{}", i % 64) / std::format("source_{}.cpp", i);
+			sourceFiles.push_back({ ContentHash::hash(path.string()), { static_cast<int64_t>(i), 1024 + i, i }, std::move(path) });
+		}
+		return sourceFiles;
+	}
+
+	const ProjectEnvironment& source_cache_environment(size_t count) {
+		static std::unordered_map<size_t, ProjectEnvironment> environments{};
+		if (const auto it = environments.find(count); it != environments.end())
+			return it->second;
+
+		ProjectEnvironment projectEnvironment = environment_in(scratch_directory() / std::format("cache_{}", count));
+		std::error_code errorCode{};
+		std::filesystem::create_directories(projectEnvironment.projectCachePath, errorCode);
+		if (const auto res = SourceCache::save(projectEnvironment.projectSourceCacheFilePath, synthetic_sources(count)); !res)
+			std::println("ERROR: {}({})", res.error().message, static_cast<int32_t>(res.error().code));
+		return environments.emplace(count, std::move(projectEnvironment)).first->second;
+	}
+
+	void BM_HashFile(benchmark::State& state) {
+		const size_t size = static_cast<size_t>(state.range(0));
+		const std::filesystem::path path = scratch_directory() / std::format("hash_{}.bin", size);
+		std::string content(size, '\0');
+		for (size_t i = 0; i < size; ++i)
+			content[i] = static_cast<char>(i * 131 + (i >> 8));
+		if (const auto res = Util::write_binary(path, content); !res) {
+			state.SkipWithError(res.error().message.c_str());
+			return;
+		}
+
+		for (auto _ : state)
+			benchmark::DoNotOptimize(Util::hash(path));
+		state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(size));
+	}
+	BENCHMARK(BM_HashFile)->RangeMultiplier(8)->Range(4 << 10, 64 << 20)->Unit(benchmark::kMicrosecond);
+
+	// The binary source cache replaced the text cache that was split line by line, so its
+	// serialization is what every successful build now pays instead.
+	void BM_SerializeSourceCache(benchmark::State& state) {
+		const std::vector<SourceFile> sourceFiles = synthetic_sources(static_cast<size_t>(state.range(0)));
+		for (auto _ : state)
+			benchmark::DoNotOptimize(SourceCache::serialize(sourceFiles));
+		state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+	}
+	BENCHMARK(BM_SerializeSourceCache)->RangeMultiplier(10)->Range(1'000, 100'000)->Unit(benchmark::kMicrosecond);
+
+	// Maps the cache and materializes every entry, as the first --build of a process does.
+	void BM_GetSourceCache(benchmark::State& state) {
+		const ProjectEnvironment& projectEnvironment = source_cache_environment(static_cast<size_t>(state.range(0)));
+		ProjectStatistics projectStatistics{};
+		for (auto _ : state) {
+			ProjectConfigure projectConfigure{ &projectEnvironment, &projectStatistics };
+			benchmark::DoNotOptimize(projectConfigure.get_source_cache());
+		}
+		state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+	}
+	BENCHMARK(BM_GetSourceCache)->RangeMultiplier(10)->Range(1'000, 100'000)->Unit(benchmark::kMicrosecond);
+
+	// One source in a hundred differs from the cache, the rest are looked up and match.
+	void BM_DifferenceSourceCache(benchmark::State& state) {
+		const size_t count = static_cast<size_t>(state.range(0));
+		const ProjectEnvironment& projectEnvironment = source_cache_environment(count);
+		ProjectStatistics projectStatistics{};
+		ProjectConfigure projectConfigure{ &projectEnvironment, &projectStatistics };
+
+		std::vector<SourceFile> sourceFiles = synthetic_sources(count);
+		for (size_t i = 0; i < sourceFiles.size(); i += 100)
+			sourceFiles[i].hash = ContentHash::hash(std::format("edited {}", i));
+		projectConfigure.set_source_files(std::move(sourceFiles));
+
+		for (auto _ : state)
+			benchmark::DoNotOptimize(projectConfigure.get_difference_source_cache());
+		state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+	}
+	BENCHMARK(BM_DifferenceSourceCache)->RangeMultiplier(10)->Range(1'000, 100'000)->Unit(benchmark::kMicrosecond);
+
+	// A config.toml whose flag arrays hold the given number of entries each.
+	void BM_ProjectSetup(benchmark::State& state) {
+		const size_t flagCount = static_cast<size_t>(state.range(0));
+		const ProjectEnvironment projectEnvironment = environment_in(scratch_directory() / std::format("config_{}", flagCount));
+		std::error_code errorCode{};
+		std::filesystem::create_directories(projectEnvironment.projectRoot, errorCode);
+
+		std::string flags{};
+		for (size_t i = 0; i < flagCount; ++i)
+			flags.append(std::format("{}\"-DSYNTHETIC_DEFINE_{}=1\"", i == 0 ? "" : ", ", i));
+		const std::string config = std::format(
+			"ProjectName = \"Synthetic\"\n"
+			"ProjectVersion = \"1.0.0\"\n"
+			"ProjectLanguage = \"C++\"\n"
+			"ProjectType = \"Executable\"\n"
+			"cCompilerVersion = \"c17\"\n"
+			"cppCompilerVersion = \"c++20\"\n"
+			"cCompilerFlags = [{0}]\n"
+			"cppCompilerFlags = [{0}]\n"
+			"projectLinkerFlags = [{0}]\n",
+			flags
+		);
+		if (const auto res = Util::write_atomic(projectEnvironment.projectRoot / g_projectConfigureFileName, config); !res) {
+			state.SkipWithError(res.error().message.c_str());
+			return;
+		}
+
+		ProjectStatistics projectStatistics{};
+		ProjectDataScraper projectDataScraper{ &projectEnvironment, &projectStatistics };
+		for (auto _ : state) {
+			auto res = projectDataScraper.project_setup();
+			if (!res) {
+				state.SkipWithError(res.error().message.c_str());
+				return;
+			}
+		}
+		state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(config.size()));
+	}
+	BENCHMARK(BM_ProjectSetup)->RangeMultiplier(10)->Range(10, 10'000)->Unit(benchmark::kMicrosecond);
+
+	// Registers every config key in variablesSignatures, once per invocation.
+	void BM_ProjectStatisticsConstruction(benchmark::State& state) {
+		for (auto _ : state) {
+			ProjectStatistics projectStatistics{};
+			benchmark::DoNotOptimize(projectStatistics);
+		}
+	}
+	BENCHMARK(BM_ProjectStatisticsConstruction);
+}
+
+BENCHMARK_MAIN();